@@ -1,14 +1,17 @@
 #define PY_SSIZE_T_CLEAN
 #include <Python.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <ctype.h>
+#include <limits.h>
+#include <pythread.h>
 
 // Version number. Only need to update when
 // API changes.
-#define module_version "3.2.0"
+#define module_version "3.8.0"
 
 // Use for returning errors
 #define err_size 500
@@ -34,11 +37,19 @@ typedef struct {
     long index;
     long length;
     long line_no;
+    long token_start;
+    long token_length;
     char last_delimiter;
+    char error[err_size];
 } parser_data;
 
 // Initialize the parser
-parser_data parser = {NULL, NULL, done_parsing, 0, 0, 0, ' '};
+parser_data parser = {NULL, NULL, done_parsing, 0, 0, 0, 0, 0, ' ', ""};
+
+// The possible results of scanning for the next token
+#define TOKEN_FOUND 0
+#define TOKEN_DONE 1
+#define TOKEN_ERROR 2
 
 void reset_parser(parser_data * parser){
 
@@ -54,7 +65,10 @@ void reset_parser(parser_data * parser){
     parser->index = 0;
     parser->length = 0;
     parser->line_no = 0;
+    parser->token_start = 0;
+    parser->token_length = 0;
     parser->last_delimiter = ' ';
+    parser->error[0] = '\0';
 }
 
 static PyObject *
@@ -132,29 +146,6 @@ char *str_replace(const char *orig, char *rep, char *with) {
     return result;
 }
 
-// Creates a new string that is all lower-case
-// You must free the result if result is non-NULL.
-char *str_to_lowercase(const char *orig) {
-    char *result; // the return string
-
-    // sanity checks and initialization
-    if (!orig)
-        return NULL;
-
-    result = malloc(strlen(orig) + 1);
-
-    if (!result)
-        return NULL;
-
-    for(int i = 0; orig[i]; i++){
-        result[i] = tolower(orig[i]);
-    }
-
-    return result;
-}
-
-
-
 /* Use to look for common unset bits between strings.
 void get_common_bits(void){
     char one[5] = "data_";
@@ -276,31 +267,16 @@ void update_line_number(parser_data * parser, long start_pos, long length){
     }
 }
 
-/* Returns a new token char * */
-char * update_token(parser_data * parser, long length, char delimiter){
-
-    if (parser->token != done_parsing){
-        free(parser->token);
-    }
+/* Records the token of the given length starting at the current index
+   and moves the index past it and the character that ended it. */
+int set_token(parser_data * parser, long length, char delimiter){
 
-    // Allocate space for the token and copy the data into it
-    parser->token = malloc(length+1);
-    memcpy(parser->token, &parser->full_data[parser->index], length);
-    parser->token[length] = '\0';
-
-    // Figure out what to set the last delimiter as
-    if (parser->index == 0){
-        if (delimiter == '#') {
-            parser->last_delimiter = '#';
-        } else {
-            parser->last_delimiter = ' ';
-        }
-    } else {
-        parser->last_delimiter = delimiter;
-    }
+    parser->token_start = parser->index;
+    parser->token_length = length;
+    parser->last_delimiter = delimiter;
 
     // Check if reference
-    if ((parser->token[0] == '$') && (parser->last_delimiter == ' ') && (length >1)) {
+    if ((delimiter == ' ') && (length > 1) && (parser->full_data[parser->index] == '$')) {
         parser->last_delimiter = '$';
     }
 
@@ -308,7 +284,7 @@ char * update_token(parser_data * parser, long length, char delimiter){
     update_line_number(parser, parser->index, length + 1);
 
     parser->index += length + 1;
-    return parser->token;
+    return TOKEN_FOUND;
 }
 
 
@@ -324,155 +300,247 @@ long get_line_number(parser_data * parser){
     return num_lines + 1;
 }
 
-/* Gets one token from the file/string. Returns NULL on error and
-   done_parsing if there are no more tokens. */
-char * get_token(parser_data * parser){
+/* Finds the closing quote of a quoted value starting at the current index.
+   Returns the offset of the closing quote from the character after the
+   opening quote, or -1 on error (with the parser error set). */
+long find_end_quote(parser_data * parser, char * quote, char * name){
 
-    //printf("Cur index: %ld\n", parser->index + 1);
+    long end_quote = get_index(parser->full_data, quote, parser->index + 1);
 
-    // Reset the delimiter
-    parser->last_delimiter = '?';
+    // Handle the case where there is no terminating quote in the file
+    if (end_quote == -1){
+        snprintf(parser->error, err_size, "Invalid file. %s quoted value was not terminated. Error on line: %ld", name, get_line_number(parser));
+        return -1;
+    }
 
-    // Set up a tmp str pointer to use for searches
-    char * search;
-    // And an error char array
-    char err[err_size] = "Unknown error.";
+    // Make sure we don't stop for quotes that are not followed by whitespace
+    while ((parser->index+end_quote+2 < parser->length) && (!is_whitespace(parser->full_data[parser->index+end_quote+2]))){
+        long next_index = get_index(parser->full_data, quote, parser->index+end_quote+2);
+        if (next_index == -1){
+            snprintf(parser->error, err_size, "Invalid file. %s quoted value was never terminated at end of file.", name);
+            return -1;
+        }
+        end_quote += next_index + 1;
+    }
 
-    // Nothing left
-    if (parser->token == done_parsing){
-        return parser->token;
+    // See if the quote has a newline
+    if (check_multiline(parser, end_quote)){
+        snprintf(parser->error, err_size, "Invalid file. %s quoted value was not terminated on the same line it began. Error on line: %ld", name, get_line_number(parser));
+        return -1;
     }
 
+    return end_quote;
+}
+
+/* Scans for the next token. This never touches Python state, so it is safe
+   to call with the GIL released. Returns TOKEN_FOUND with the token position
+   stored in token_start and token_length, TOKEN_DONE if there are no more
+   tokens, or TOKEN_ERROR with the reason stored in the parser error. */
+int next_token(parser_data * parser){
+
+    // Reset the delimiter
+    parser->last_delimiter = '?';
+
     // Skip whitespace
     pass_whitespace(parser);
 
     // Stop if we are at the end
     if (parser->index >= parser->length){
-        free(parser->token);
-        parser->token = done_parsing;
-        return parser->token;
+        return TOKEN_DONE;
     }
 
     // See if this is a comment - if so skip it
     if (parser->full_data[parser->index] == '#'){
-        search = "\n";
-        long length = get_index(parser->full_data, search, parser->index);
+        long length = get_index(parser->full_data, "\n", parser->index);
 
         // Handle the edge case where this is the last line of the file and there is no newline
         if (length == -1){
-            free(parser->token);
-            parser->token = done_parsing;
-            return parser->token;
+            parser->index = parser->length;
+            return TOKEN_DONE;
         }
 
         // Return the comment
-        return update_token(parser, length, '#');
+        return set_token(parser, length, '#');
     }
 
     // See if this is a multiline value
     if ((parser->length - parser->index > 1) && (parser->full_data[parser->index] == ';') && (parser->full_data[parser->index+1] == '\n')){
-        search = "\n;";
-        long length = get_index(parser->full_data, search, parser->index);
+        long length = get_index(parser->full_data, "\n;", parser->index);
 
         // Handle the edge case where this is the last line of the file and there is no newline
         if (length == -1){
-            snprintf(err, sizeof(err), "Invalid file. Semicolon-delineated value was not terminated. Error on line: %ld", get_line_number(parser));
-            PyErr_SetString(PyExc_ValueError, err);
-            free(parser->token);
-            parser->token = NULL;
-            return parser->token;
+            snprintf(parser->error, err_size, "Invalid file. Semicolon-delineated value was not terminated. Error on line: %ld", get_line_number(parser));
+            return TOKEN_ERROR;
         }
 
         // We started with a newline so make sure to count it
         parser->line_no++;
 
         parser->index += 2;
-        return update_token(parser, length-1, ';');
+        return set_token(parser, length-1, ';');
     }
 
     // Handle values quoted with '
     if (parser->full_data[parser->index] == '\''){
-        search = "'";
-        long end_quote = get_index(parser->full_data, search, parser->index + 1);
-
-        // Handle the case where there is no terminating quote in the file
+        long end_quote = find_end_quote(parser, "'", "Single");
         if (end_quote == -1){
-            snprintf(err, sizeof(err), "Invalid file. Single quoted value was not terminated. Error on line: %ld", get_line_number(parser));
-            PyErr_SetString(PyExc_ValueError, err);
-            free(parser->token);
-            parser->token = NULL;
-            return parser->token;
-        }
-
-        // Make sure we don't stop for quotes that are not followed by whitespace
-        while ((parser->index+end_quote+2 < parser->length) && (!is_whitespace(parser->full_data[parser->index+end_quote+2]))){
-            long next_index = get_index(parser->full_data, search, parser->index+end_quote+2);
-            if (next_index == -1){
-                PyErr_SetString(PyExc_ValueError, "Invalid file. Single quoted value was never terminated at end of file.");
-                free(parser->token);
-                parser->token = NULL;
-                return parser->token;
-            }
-            end_quote += next_index + 1;
-        }
-
-        // See if the quote has a newline
-        if (check_multiline(parser, end_quote)){
-            snprintf(err, sizeof(err), "Invalid file. Single quoted value was not terminated on the same line it began. Error on line: %ld", get_line_number(parser));
-            PyErr_SetString(PyExc_ValueError, err);
-            free(parser->token);
-            parser->token = NULL;
-            return parser->token;
+            return TOKEN_ERROR;
         }
 
         // Move the index 1 to skip the '
         parser->index++;
-        return update_token(parser, end_quote, '\'');
+        return set_token(parser, end_quote, '\'');
     }
 
     // Handle values quoted with "
     if (parser->full_data[parser->index] == '\"'){
-        search = "\"";
-        long end_quote = get_index(parser->full_data, search, parser->index + 1);
-
-        // Handle the case where there is no terminating quote in the file
+        long end_quote = find_end_quote(parser, "\"", "Double");
         if (end_quote == -1){
-            snprintf(err, sizeof(err), "Invalid file. Double quoted value was not terminated. Error on line: %ld", get_line_number(parser));
-            PyErr_SetString(PyExc_ValueError, err);
-            free(parser->token);
-            parser->token = NULL;
-            return parser->token;
+            return TOKEN_ERROR;
         }
 
-        // Make sure we don't stop for quotes that are not followed by whitespace
-        while ((parser->index+end_quote+2 < parser->length) && (!is_whitespace(parser->full_data[parser->index+end_quote+2]))){
-            long next_index = get_index(parser->full_data, search, parser->index+end_quote+2);
-            if (next_index == -1){
-                PyErr_SetString(PyExc_ValueError, "Invalid file. Double quoted value was never terminated at end of file.");
-                free(parser->token);
-                parser->token = NULL;
-                return parser->token;
+        // Move the index 1 to skip the "
+        parser->index++;
+        return set_token(parser, end_quote, '"');
+    }
+
+    // Nothing special. Just get the token
+    long end_pos = get_next_whitespace(parser->full_data, parser->index);
+    return set_token(parser, end_pos - parser->index, ' ');
+}
+
+/* Gets one token from the file/string. Returns NULL on error and
+   done_parsing if there are no more tokens. */
+char * get_token(parser_data * parser){
+
+    // Nothing left
+    if (parser->token == done_parsing){
+        parser->last_delimiter = '?';
+        return parser->token;
+    }
+
+    free(parser->token);
+    parser->token = NULL;
+
+    int status = next_token(parser);
+    if (status == TOKEN_DONE){
+        parser->token = done_parsing;
+        return parser->token;
+    }
+    if (status == TOKEN_ERROR){
+        PyErr_SetString(PyExc_ValueError, parser->error);
+        return parser->token;
+    }
+
+    // Allocate space for the token and copy the data into it
+    parser->token = malloc(parser->token_length + 1);
+    memcpy(parser->token, &parser->full_data[parser->token_start], parser->token_length);
+    parser->token[parser->token_length] = '\0';
+    return parser->token;
+}
+
+/* Unwraps embedded STAR if all lines of a semicolon-delimited value start
+   with three spaces. Works in place and returns the new length. */
+long unwrap_embedded_star(char * token, long length){
+
+    if ((length < 4) || (strncmp(token, "\n   ", 4) != 0)){
+        return length;
+    }
+
+    bool embedded_semicolon = false;
+    long c;
+    for (c=0; c<length - 4; c++){
+        if (token[c] == '\n'){
+            if (token[c+1] != ' ' || token[c+2] != ' ' || token[c+3] != ' '){
+                return length;
+            }
+            if (token[c+4] == ';'){
+                embedded_semicolon = true;
             }
-            end_quote += next_index + 1;
         }
+    }
+    if (!embedded_semicolon){
+        return length;
+    }
 
-        // See if the quote has a newline
-        if (check_multiline(parser, end_quote)){
-            snprintf(err, sizeof(err), "Invalid file. Double quoted value was not terminated on the same line it began. Error on line: %ld", get_line_number(parser));
-            PyErr_SetString(PyExc_ValueError, err);
-            free(parser->token);
-            parser->token = NULL;
-            return parser->token;
+    // Actually shift the text over, dropping the trailing newline
+    long read = 0, write = 0;
+    length--;
+    while (read < length){
+        token[write++] = token[read];
+        if ((token[read] == '\n') && (read + 3 < length) && (token[read+1] == ' ') &&
+            (token[read+2] == ' ') && (token[read+3] == ' ')){
+            read += 4;
+        } else {
+            read++;
         }
+    }
+    return write;
+}
 
-        // Move the index 1 to skip the "
-        parser->index++;
-        return update_token(parser, end_quote, '"');
+// The kinds of tokens. These only depend on the text of the token (other
+//  than REF) so the delimiter must be checked to see if a keyword or tag
+//  was quoted.
+enum token_kind {
+    KIND_DATA,
+    KIND_SAVE_START,
+    KIND_SAVE_END,
+    KIND_LOOP,
+    KIND_STOP,
+    KIND_TAG,
+    KIND_VALUE,
+    KIND_GLOBAL,
+    KIND_REF
+};
+
+// Compares the start of a token to a lower case keyword, ignoring case
+bool starts_with_keyword(const char * token, long length, const char * keyword, long keyword_length){
+    if (length < keyword_length){
+        return false;
+    }
+    long x;
+    for (x = 0; x < keyword_length; x++){
+        char c = token[x];
+        if ((c >= 'A') && (c <= 'Z')){
+            c += 'a' - 'A';
+        }
+        if (c != keyword[x]){
+            return false;
+        }
     }
+    return true;
+}
 
-    // Nothing special. Just get the token
-    long end_pos = get_next_whitespace(parser->full_data, parser->index);
-    return update_token(parser, end_pos - parser->index, ' ');
+/* Works out the kind of a token with a few byte compares. */
+char get_token_kind(const char * token, long length, char delimiter){
+
+    if (delimiter == '$'){
+        return KIND_REF;
+    }
+    if (length == 0){
+        return KIND_VALUE;
+    }
+    if (token[0] == '_'){
+        return KIND_TAG;
+    }
+    // All of the keywords have an underscore after four or six letters
+    if ((length >= 5) && (token[4] == '_')){
+        if (starts_with_keyword(token, length, "data_", 5)){
+            return KIND_DATA;
+        }
+        if (starts_with_keyword(token, length, "save_", 5)){
+            return length == 5 ? KIND_SAVE_END : KIND_SAVE_START;
+        }
+        if ((length == 5) && starts_with_keyword(token, length, "loop_", 5)){
+            return KIND_LOOP;
+        }
+        if ((length == 5) && starts_with_keyword(token, length, "stop_", 5)){
+            return KIND_STOP;
+        }
+    } else if ((length >= 7) && (token[6] == '_') && starts_with_keyword(token, length, "global_", 7)){
+        return KIND_GLOBAL;
+    }
+    return KIND_VALUE;
 }
 
 /* IDEA: Implementing the tokenizer following this pattern may
@@ -513,47 +581,108 @@ bool ends_with(const char * str, const char * suffix)
     (0 == strcmp(str + (str_len-suffix_len), suffix));
 }
 
-/*
-    Automatically quotes the value in the appropriate way. Don't
-    quote values you send to this method or they will show up in
-    another set of quotes as part of the actual data. E.g.:
-
-    quote_value('"e. coli"') returns '\'"e. coli"\''
-
-    while
-
-    quote_value("e. coli") returns "'e. coli'"
-*/
-static PyObject * quote_value(PyObject *self, PyObject *args){
-    char * format;
-    PyObject * orig;
-    PyObject * result;
+// How often strings were created through the ASCII fast path
+unsigned long long tokens_ascii = 0;
+unsigned long long tokens_unicode = 0;
+unsigned long long quoted_ascii = 0;
+unsigned long long quoted_unicode = 0;
+
+/* Checks whether a buffer only contains ASCII, eight bytes at a time. */
+bool is_ascii(const char * str, Py_ssize_t length){
+    const unsigned char * bytes = (const unsigned char *)str;
+    uint64_t combined = 0;
+    Py_ssize_t x = 0;
+    for (; x + 8 <= length; x += 8){
+        uint64_t word;
+        memcpy(&word, &bytes[x], 8);
+        combined |= word;
+    }
+    for (; x < length; x++){
+        combined |= bytes[x];
+    }
+    return (combined & 0x8080808080808080ULL) == 0;
+}
 
-    // Get the object to clean
-    if (!PyArg_ParseTuple(args, "O", &orig)){
-        PyErr_SetString(PyExc_ValueError, "Failed to parse the input arguments.");
-        return NULL;
+/* Creates a str of a known length, using the compact ASCII constructor when
+   the caller knows, or it can be quickly checked, that the text is ASCII. */
+PyObject * make_string(const char * str, Py_ssize_t length, bool known_ascii){
+    if (known_ascii || is_ascii(str, length)){
+        tokens_ascii++;
+        PyObject * result = PyUnicode_New(length, 127);
+        // Empty tokens may have no buffer at all
+        if (result != NULL && length > 0){
+            memcpy(PyUnicode_1BYTE_DATA(result), str, length);
+        }
+        return result;
     }
+    tokens_unicode++;
+    return PyUnicode_DecodeUTF8(str, length, NULL);
+}
 
-    // Convert the python object to a string
-    PyObject * temp = PyObject_Str(orig);
-    if (temp == NULL){
-        PyErr_SetString(PyExc_ValueError, "Failed to convert the object you passed to a string using __str__().");
-        Py_DECREF(temp);
-        return NULL;
+/* Creates prefix + str + suffix for quote_value(). */
+PyObject * build_string(const char * prefix, const char * str, Py_ssize_t length, const char * suffix, bool ascii){
+    Py_ssize_t prefix_length = strlen(prefix);
+    Py_ssize_t suffix_length = strlen(suffix);
+    Py_ssize_t total = prefix_length + length + suffix_length;
+
+    if (ascii){
+        quoted_ascii++;
+        PyObject * result = PyUnicode_New(total, 127);
+        if (result != NULL){
+            Py_UCS1 * data = PyUnicode_1BYTE_DATA(result);
+            memcpy(data, prefix, prefix_length);
+            if (length > 0){
+                memcpy(data + prefix_length, str, length);
+            }
+            memcpy(data + prefix_length + length, suffix, suffix_length);
+        }
+        return result;
     }
 
-    const char * str = PyUnicode_AsUTF8(temp);
+    quoted_unicode++;
+    char * buffer = malloc(total);
+    if (buffer == NULL){
+        return PyErr_NoMemory();
+    }
+    memcpy(buffer, prefix, prefix_length);
+    if (length > 0){
+        memcpy(buffer + prefix_length, str, length);
+    }
+    memcpy(buffer + prefix_length + length, suffix, suffix_length);
+    PyObject * result = PyUnicode_DecodeUTF8(buffer, total, NULL);
+    free(buffer);
+    return result;
+}
 
-    // Figure out how long the string is
-    long len = strlen(str);
+static PyObject *
+string_stats(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *keywords[] = {"reset", NULL};
+    int reset = 0;
 
-    // Don't allow the empty string
-    if (len == 0){
-        PyErr_SetString(PyExc_ValueError, "Empty strings are not allowed as values. Use the None singleton, or '.' to represent null values.");
-        Py_DECREF(temp);
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|p", keywords, &reset))
         return NULL;
+
+    PyObject * result = Py_BuildValue("{sKsKsKsK}", "tokens_ascii", tokens_ascii, "tokens_unicode", tokens_unicode,
+                                      "quoted_ascii", quoted_ascii, "quoted_unicode", quoted_unicode);
+    if (reset){
+        tokens_ascii = tokens_unicode = quoted_ascii = quoted_unicode = 0;
+    }
+    return result;
+}
+
+/* Returns original if it was provided, otherwise creates a str of the text. */
+PyObject * original_or_text(const char * str, Py_ssize_t len, PyObject * original){
+    if (original != NULL){
+        Py_INCREF(original);
+        return original;
     }
+    return make_string(str, len, false);
+}
+
+/* Quotes a value which contains a newline. Needs a null terminated string. */
+PyObject * quote_multiline(const char * str, Py_ssize_t len, bool ascii, PyObject * original){
+    PyObject * result;
 
     // If it is a STAR-format multiline comment already, we need to escape it
     if (strstr(str, "\n;") != NULL){
@@ -562,47 +691,57 @@ static PyObject * quote_value(PyObject *self, PyObject *args){
         char * replaced_string;
         replaced_string = str_replace(str, "\n", "\n   ");
 
-        // But always newline terminate it
-        if (!ends_with(replaced_string, "\n")){
-            // Must start with newline too
-            if (replaced_string[0] != '\n'){
-                format = "\n   %s\n";
-            } else {
-                format = "%s\n";
-            }
-        } else {
-            if (replaced_string[0] != '\n'){
-                format = "\n   %s";
-            } else {
-                format = "%s";
-            }
-        }
-
-        PyObject* result = PyUnicode_FromFormat(format, replaced_string);
+        // But always newline terminate it, and it must start with a newline too
+        result = build_string(replaced_string[0] != '\n' ? "\n   " : "",
+                              replaced_string, strlen(replaced_string),
+                              ends_with(replaced_string, "\n") ? "" : "\n", ascii);
         free(replaced_string);
-        Py_DECREF(temp);
         return(result);
     }
 
     // If it's going on it's own line, don't touch it
-    if (strstr(str, "\n") != NULL){
-        // But always newline terminate it
-        if (str[len-1] != '\n'){
-            result = PyUnicode_FromFormat("%s\n", str);
-            Py_DECREF(temp);
-            return result;
-        } else {
-            // Return as is if it already ends with a newline
-            result = PyUnicode_FromString(str);
-            Py_DECREF(temp);
-            return result;
+    // But always newline terminate it
+    if (str[len-1] != '\n'){
+        return build_string("", str, len, "\n", ascii);
+    }
+    // Return as is if it already ends with a newline
+    return original_or_text(str, len, original);
+}
+
+/* Quotes len bytes of text in the way described for quote_value(). If the
+   text doesn't need quoting then original is returned if it was provided
+   (in which case str must be its UTF-8 text), otherwise a str is created from
+   the text as is. This allows quoting values straight from the tokenized
+   data. */
+PyObject * quote_text(const char * str, Py_ssize_t len, bool ascii, PyObject * original){
+    PyObject * result;
+
+    // Don't allow the empty string
+    if (len == 0){
+        PyErr_SetString(PyExc_ValueError, "Empty strings are not allowed as values. Use the None singleton, or '.' to represent null values.");
+        return NULL;
+    }
+
+    if (memchr(str, '\n', len) != NULL){
+        // A str is already null terminated, but text from the tokenized data isn't
+        if (original != NULL){
+            return quote_multiline(str, len, ascii, original);
         }
+        char * terminated = malloc(len + 1);
+        if (terminated == NULL){
+            return PyErr_NoMemory();
+        }
+        memcpy(terminated, str, len);
+        terminated[len] = '\0';
+        result = quote_multiline(terminated, len, ascii, NULL);
+        free(terminated);
+        return result;
     }
 
     // If it has single and double quotes it will need to go on its
     //  own line under certain conditions...
-    bool has_single = strstr(str, "'") != NULL;
-    bool has_double = strstr(str, "\"") != NULL;
+    bool has_single = memchr(str, '\'', len) != NULL;
+    bool has_double = memchr(str, '"', len) != NULL;
 
     bool can_wrap_single = true;
     bool can_wrap_double = true;
@@ -623,19 +762,13 @@ static PyObject * quote_value(PyObject *self, PyObject *args){
 
         // Return the string with whatever type of quoting we are allowed
         if ((!can_wrap_single) && (!can_wrap_double)){
-            result = PyUnicode_FromFormat("%s\n", str);
-            Py_DECREF(temp);
-            return result;
+            return build_string("", str, len, "\n", ascii);
         }
         if (can_wrap_single) {
-            result = PyUnicode_FromFormat("'%s'", str);
-            Py_DECREF(temp);
-            return result;
+            return build_string("'", str, len, "'", ascii);
         }
         if (can_wrap_double) {
-            result = PyUnicode_FromFormat("\"%s\"", str);
-            Py_DECREF(temp);
-            return result;
+            return build_string("\"", str, len, "\"", ascii);
         }
     }
 
@@ -650,12 +783,10 @@ static PyObject * quote_value(PyObject *self, PyObject *args){
     }
 
     if (!needs_wrapping) {
-        char *lower_case = str_to_lowercase(str);
-
-        // If the third bit of the third char is 0 then it might be a reserved
-        //  keyword. (See get_common_bits to see how this was calculated.)
-        if ((starts_with(lower_case, "data_") || starts_with(lower_case, "save_") || starts_with(lower_case, "loop_") ||
-             starts_with(lower_case, "stop_") || starts_with(lower_case, "global_"))) {
+        // Check if it might be a reserved keyword
+        if (starts_with_keyword(str, len, "data_", 5) || starts_with_keyword(str, len, "save_", 5) ||
+            starts_with_keyword(str, len, "loop_", 5) || starts_with_keyword(str, len, "stop_", 5) ||
+            starts_with_keyword(str, len, "global_", 7)) {
             needs_wrapping = true;
         }
 
@@ -679,26 +810,56 @@ static PyObject * quote_value(PyObject *self, PyObject *args){
                 }
             }
         }
-        free(lower_case);
     }
 
     if (needs_wrapping) {
         // If there is a single quote wrap in double quotes
         if (has_single) {
-            result = PyUnicode_FromFormat("\"%s\"", str);
-            Py_DECREF(temp);
-            return result;
+            return build_string("\"", str, len, "\"", ascii);
         }
         // Either there is a double quote or no quotes
-        else {
-            result = PyUnicode_FromFormat("'%s'", str);
-            Py_DECREF(temp);
-            return result;
-        }
+        return build_string("'", str, len, "'", ascii);
     }
 
     // If we got here it's good to go as it is
-    result = PyUnicode_FromString(str);
+    return original_or_text(str, len, original);
+}
+
+/*
+    Automatically quotes the value in the appropriate way. Don't
+    quote values you send to this method or they will show up in
+    another set of quotes as part of the actual data. E.g.:
+
+    quote_value('"e. coli"') returns '\'"e. coli"\''
+
+    while
+
+    quote_value("e. coli") returns "'e. coli'"
+*/
+static PyObject * quote_value(PyObject *self, PyObject *args){
+    PyObject * orig;
+
+    // Get the object to clean
+    if (!PyArg_ParseTuple(args, "O", &orig)){
+        PyErr_SetString(PyExc_ValueError, "Failed to parse the input arguments.");
+        return NULL;
+    }
+
+    // Convert the python object to a string
+    PyObject * temp = PyObject_Str(orig);
+    if (temp == NULL){
+        PyErr_SetString(PyExc_ValueError, "Failed to convert the object you passed to a string using __str__().");
+        return NULL;
+    }
+
+    Py_ssize_t len;
+    const char * str = PyUnicode_AsUTF8AndSize(temp, &len);
+    if (str == NULL){
+        Py_DECREF(temp);
+        return NULL;
+    }
+
+    PyObject * result = quote_text(str, len, PyUnicode_IS_ASCII(temp), temp);
     Py_DECREF(temp);
     return result;
 }
@@ -748,55 +909,4131 @@ bool StartsWith(const char *a, const char *b)
    return 0;
 }
 
-static PyObject *
-PARSE_get_token_full(PyObject *self)
-{
-    char * token;
-    token = get_token(&parser);
-    parser_data * my_parser = &parser;
+/* Gets the next token other than comments for the global parser, with
+   embedded STAR unwrapped. Returns NULL on error. */
+char * get_token_no_comments(void){
+    char * token = get_token(&parser);
 
     // Skip comments
-    while (my_parser->last_delimiter == '#'){
+    while (parser.last_delimiter == '#'){
         token = get_token(&parser);
     }
 
+    if ((token != NULL) && (token != done_parsing) && (parser.last_delimiter == ';')){
+        parser.token_length = unwrap_embedded_star(token, parser.token_length);
+        token[parser.token_length] = '\0';
+    }
+    return token;
+}
+
+static PyObject *
+PARSE_get_token_full(PyObject *self)
+{
+    char * token = get_token_no_comments();
+
     // Pass errors up the chain
     if (token == NULL){
         return NULL;
     }
 
-    // Unwrap embedded STAR if all lines start with three spaces
-    if ((my_parser->last_delimiter == ';') && (starts_with(token, "\n   "))){
-        bool shift_over = true;
+    if (token == done_parsing){
+        // Return python none if done parsing
+        return Py_BuildValue("OlC", Py_None, parser.line_no, parser.last_delimiter);
+    }
+
+    return Py_BuildValue("NlC", make_string(token, parser.token_length, false), parser.line_no,
+                         parser.last_delimiter);
+}
 
-        size_t token_len = strlen(token);
-        unsigned long int c;
-        for (c=0; c<token_len - 4; c++){
-            if (token[c] == '\n'){
-                if (token[c+1] != ' ' || token[c+2] != ' ' || token[c+3] != ' '){
-                    shift_over = false;
-                }
-            }
-        }
+static PyObject *
+PARSE_get_token_typed(PyObject *self)
+{
+    char * token = get_token_no_comments();
 
-        // Actually shift the text over
-        if ((shift_over == true) && (strstr(token, "\n   ;") != NULL)){
-            // Remove the trailing newline
-            token[token_len-1] = '\0';
-            token = str_replace(token, "\n   ", "\n");
-        }
+    // Pass errors up the chain
+    if (token == NULL){
+        return NULL;
     }
 
     if (token == done_parsing){
         // Return python none if done parsing
-        Py_INCREF(Py_None);
-
-        return Py_BuildValue("OlC", Py_None, my_parser->line_no, my_parser->last_delimiter);
+        return Py_BuildValue("OlCO", Py_None, parser.line_no, parser.last_delimiter, Py_None);
     }
-    return Py_BuildValue("slC", token, my_parser->line_no, my_parser->last_delimiter);
+
+    return Py_BuildValue("NlCi", make_string(token, parser.token_length, false), parser.line_no,
+                         parser.last_delimiter, get_token_kind(token, parser.token_length, parser.last_delimiter));
 }
 
-static PyObject *
+/* Normalizes the line endings of the data in the same way as
+   Parser.load_data() and moves '\n; data' started multi-line values to
+   '\n;\ndata'. Returns a newly malloc'd string or NULL if out of memory. */
+char * normalize_data(const char * data, long length, long * new_length){
+
+    // Fix DOS line endings
+    char * fixed = malloc(length + 1);
+    if (fixed == NULL){
+        return NULL;
+    }
+    long x, pos = 0;
+    for (x = 0; x < length; x++){
+        if (data[x] == '\r'){
+            fixed[pos++] = '\n';
+            if ((x + 1 < length) && (data[x+1] == '\n')){
+                x++;
+            }
+        } else {
+            fixed[pos++] = data[x];
+        }
+    }
+
+    // Every moved value consumes at least four characters and adds one
+    char * result = malloc(pos + pos / 4 + 2);
+    if (result == NULL){
+        free(fixed);
+        return NULL;
+    }
+
+    long out = 0;
+    x = 0;
+    while (x < pos){
+        if ((x + 2 < pos) && (fixed[x] == '\n') && (fixed[x+1] == ';') && (fixed[x+2] != '\n')){
+            char * end = memchr(&fixed[x+2], '\n', pos - x - 2);
+            if (end != NULL){
+                long line_end = end - fixed;
+                result[out++] = '\n';
+                result[out++] = ';';
+                result[out++] = '\n';
+                memcpy(&result[out], &fixed[x+2], line_end - x - 1);
+                out += line_end - x - 1;
+                x = line_end + 1;
+                continue;
+            }
+        }
+        result[out++] = fixed[x++];
+    }
+    result[out] = '\0';
+    free(fixed);
+
+    *new_length = out;
+    return result;
+}
+
+// Values at most this long are interned while parsing, since short values
+//  like '.', 'H' and 'ALA' repeat so often
+#define INTERN_MAX_LENGTH 16
+#define INTERN_SLOTS 8192
+// Stop adding values once the table is this full, to bound its size
+#define INTERN_MAX_ENTRIES (INTERN_SLOTS / 4 * 3)
+
+/* An open addressing hash table of the short ASCII values created while
+   parsing, so that repeated values share one str. */
+typedef struct {
+    PyObject ** slots;
+    Py_ssize_t entries;
+    unsigned long long interned;
+    unsigned long long added;
+    unsigned long long not_interned;
+} intern_table;
+
+/* Creates a str like make_string(), but returns the same str again for
+   repeats of a short ASCII value. */
+PyObject * make_interned_string(intern_table * table, const char * str, Py_ssize_t length, bool known_ascii){
+
+    if ((length > INTERN_MAX_LENGTH) || !(known_ascii || is_ascii(str, length))){
+        table->not_interned++;
+        return make_string(str, length, known_ascii);
+    }
+    if (table->slots == NULL){
+        table->slots = calloc(INTERN_SLOTS, sizeof(PyObject *));
+        if (table->slots == NULL){
+            table->not_interned++;
+            return make_string(str, length, true);
+        }
+    }
+
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    Py_ssize_t x;
+    for (x = 0; x < length; x++){
+        hash ^= (unsigned char)str[x];
+        hash *= 16777619u;
+    }
+
+    size_t slot = hash & (INTERN_SLOTS - 1);
+    while (table->slots[slot] != NULL){
+        PyObject * existing = table->slots[slot];
+        if ((PyUnicode_GET_LENGTH(existing) == length) &&
+            (memcmp(PyUnicode_1BYTE_DATA(existing), str, length) == 0)){
+            table->interned++;
+            Py_INCREF(existing);
+            return existing;
+        }
+        slot = (slot + 1) & (INTERN_SLOTS - 1);
+    }
+
+    PyObject * result = make_string(str, length, true);
+    if (result != NULL){
+        if (table->entries < INTERN_MAX_ENTRIES){
+            Py_INCREF(result);
+            table->slots[slot] = result;
+            table->entries++;
+            table->added++;
+        } else {
+            table->not_interned++;
+        }
+    }
+    return result;
+}
+
+void intern_table_clear(intern_table * table){
+    if (table->slots != NULL){
+        size_t x;
+        for (x = 0; x < INTERN_SLOTS; x++){
+            Py_XDECREF(table->slots[x]);
+        }
+        free(table->slots);
+        table->slots = NULL;
+    }
+    table->entries = 0;
+}
+
+// The position of one token within a token stream's data
+typedef struct {
+    long start;
+    unsigned int length;
+    unsigned int line_no;
+    char delimiter;
+    char kind;
+} token_span;
+
+/* A fully tokenized copy of some data. Tokenizing happens up front without
+   the GIL, after which the tokens can be consumed in order just like with
+   get_token_full(). Any error is raised once the tokens before it have been
+   consumed. */
+typedef struct {
+    PyObject_HEAD
+    char * data;
+    long length;
+    token_span * tokens;
+    Py_ssize_t num_tokens;
+    Py_ssize_t position;
+    long final_line_no;
+    // Whether all of the data is ASCII
+    bool ascii;
+    bool failed;
+    bool out_of_memory;
+    char error[err_size];
+    intern_table interned;
+} TokenStream;
+
+/* One piece of the data to tokenize. Large data is split into chunks which
+   are tokenized concurrently, each starting from a guess of where a token
+   begins. The guesses are checked against where the previous chunk actually
+   stopped, and a chunk is tokenized again if its guess turned out wrong. */
+typedef struct {
+    char * data;
+    long length;
+    // Tokenize the tokens starting in [start, end)
+    long start;
+    long end;
+    // Newlines before start, and the line_no the scan was started with
+    long line_offset;
+    long start_line_no;
+    // Newlines in [start, end), used to work out the following line_offset
+    long newlines;
+    token_span * tokens;
+    Py_ssize_t num_tokens;
+    Py_ssize_t capacity;
+    // Where the last token ended and the line_no at that point
+    long token_end;
+    long token_end_line_no;
+    long line_no;
+    int status;
+    bool out_of_memory;
+    char error[err_size];
+    PyThread_type_lock finished;
+} token_chunk;
+
+/* Tokenizes one chunk. Called without the GIL. */
+void scan_chunk(token_chunk * chunk){
+
+    parser_data scanner = {NULL, chunk->data, NULL, chunk->start, chunk->length, chunk->start_line_no, 0, 0, ' ', ""};
+    chunk->token_end = chunk->start;
+    chunk->token_end_line_no = chunk->start_line_no;
+    chunk->num_tokens = 0;
+
+    while (true){
+        // Stop once the next token belongs to the next chunk
+        if (chunk->end < chunk->length){
+            pass_whitespace(&scanner);
+            if (scanner.index >= chunk->end){
+                chunk->status = TOKEN_FOUND;
+                break;
+            }
+        }
+
+        int status = next_token(&scanner);
+
+        if (status == TOKEN_DONE){
+            chunk->status = TOKEN_DONE;
+            break;
+        }
+        if (status == TOKEN_ERROR){
+            chunk->status = TOKEN_ERROR;
+            memcpy(chunk->error, scanner.error, err_size);
+            break;
+        }
+        chunk->token_end = scanner.index;
+        chunk->token_end_line_no = scanner.line_no;
+
+        // Skip comments
+        if (scanner.last_delimiter == '#'){
+            continue;
+        }
+
+        if (chunk->num_tokens == chunk->capacity){
+            chunk->capacity = chunk->capacity ? chunk->capacity * 2 : 1024;
+            token_span * grown = realloc(chunk->tokens, chunk->capacity * sizeof(token_span));
+            if (grown == NULL){
+                chunk->out_of_memory = true;
+                return;
+            }
+            chunk->tokens = grown;
+        }
+
+        token_span * span = &chunk->tokens[chunk->num_tokens++];
+        span->start = scanner.token_start;
+        span->length = (unsigned int)scanner.token_length;
+        span->line_no = (unsigned int)scanner.line_no;
+        span->delimiter = scanner.last_delimiter;
+        span->kind = get_token_kind(&chunk->data[span->start], scanner.token_length, span->delimiter);
+    }
+    chunk->line_no = scanner.line_no;
+}
+
+/* Counts the newlines in the chunk and then tokenizes it. */
+void count_and_scan_chunk(token_chunk * chunk){
+
+    char * pos = &chunk->data[chunk->start];
+    char * stop = &chunk->data[chunk->end];
+    while ((pos = memchr(pos, '\n', stop - pos)) != NULL){
+        chunk->newlines++;
+        pos++;
+    }
+
+    scan_chunk(chunk);
+}
+
+/* Thread entry point for the chunks after the first. */
+void scan_chunk_thread(void * arg){
+    token_chunk * chunk = (token_chunk *)arg;
+
+    count_and_scan_chunk(chunk);
+    PyThread_release_lock(chunk->finished);
+}
+
+/* Picks where a chunk should start: preferably at a saveframe, otherwise at
+   the next line. Returns -1 if there is no line start in (target, limit). */
+long find_chunk_start(char * data, long target, long limit){
+
+    char * newline = memchr(&data[target], '\n', limit - target);
+    if (newline == NULL){
+        return -1;
+    }
+    long fallback = newline - data + 1;
+    if (fallback >= limit){
+        return -1;
+    }
+
+    // Only look a little way ahead for a saveframe to keep the chunks even
+    long search_limit = target + (limit - target) / 4;
+    char * pos = newline;
+    while (pos != NULL){
+        long line_start = pos - data + 1;
+        if (line_start + 5 > search_limit){
+            break;
+        }
+        if (strncmp(&data[line_start], "save_", 5) == 0){
+            return line_start;
+        }
+        pos = memchr(&data[line_start], '\n', search_limit - line_start);
+    }
+    return fallback;
+}
+
+/* Tokenizes all of the stream's data using up to the given number of
+   threads, but not fewer than chunk_size characters per thread. Called
+   without the GIL. */
+void scan_tokens(TokenStream * stream, int threads, long chunk_size){
+
+    long num_chunks = 1;
+    if ((threads > 1) && (chunk_size > 0)){
+        num_chunks = stream->length / chunk_size;
+        if (num_chunks > threads){
+            num_chunks = threads;
+        }
+        if (num_chunks < 1){
+            num_chunks = 1;
+        }
+    }
+
+    token_chunk * chunks = calloc(num_chunks, sizeof(token_chunk));
+    if (chunks == NULL){
+        stream->out_of_memory = true;
+        return;
+    }
+
+    // Work out the chunk boundaries
+    long x, used = 1;
+    chunks[0].start = 0;
+    for (x = 1; x < num_chunks; x++){
+        long target = stream->length / num_chunks * x;
+        long start = find_chunk_start(stream->data, target, target + stream->length / num_chunks);
+        if (start != -1){
+            chunks[used].start = start;
+            used++;
+        }
+    }
+    num_chunks = used;
+    for (x = 0; x < num_chunks; x++){
+        chunks[x].data = stream->data;
+        chunks[x].length = stream->length;
+        chunks[x].end = (x + 1 < num_chunks) ? chunks[x + 1].start : stream->length;
+    }
+
+    // Tokenize the later chunks in other threads while this one does the first
+    for (x = 1; x < num_chunks; x++){
+        chunks[x].finished = PyThread_allocate_lock();
+        if (chunks[x].finished != NULL){
+            PyThread_acquire_lock(chunks[x].finished, WAIT_LOCK);
+            if (PyThread_start_new_thread(scan_chunk_thread, &chunks[x]) == PYTHREAD_INVALID_THREAD_ID){
+                PyThread_release_lock(chunks[x].finished);
+                PyThread_free_lock(chunks[x].finished);
+                chunks[x].finished = NULL;
+            }
+        }
+        // Couldn't start a thread - do it ourselves
+        if (chunks[x].finished == NULL){
+            count_and_scan_chunk(&chunks[x]);
+        }
+    }
+    count_and_scan_chunk(&chunks[0]);
+    for (x = 1; x < num_chunks; x++){
+        if (chunks[x].finished != NULL){
+            PyThread_acquire_lock(chunks[x].finished, WAIT_LOCK);
+            PyThread_free_lock(chunks[x].finished);
+        }
+    }
+
+    // Work out the line numbers each chunk's lines start from
+    long line_offset = 0;
+    for (x = 0; x < num_chunks; x++){
+        chunks[x].line_offset = line_offset;
+        line_offset += chunks[x].newlines;
+    }
+
+    // Check each chunk started where the one before it actually stopped, and
+    //  tokenize it again from there if not
+    long last = 0;
+    for (x = 1; x < num_chunks; x++){
+        token_chunk * previous = &chunks[x - 1];
+        if (previous->out_of_memory || previous->status != TOKEN_FOUND){
+            break;
+        }
+        if (previous->token_end > chunks[x].start){
+            chunks[x].start = previous->token_end;
+            chunks[x].start_line_no = previous->token_end_line_no + previous->line_offset;
+            chunks[x].line_offset = 0;
+            chunks[x].out_of_memory = false;
+            scan_chunk(&chunks[x]);
+        }
+        last = x;
+    }
+    if (chunks[last].out_of_memory){
+        stream->out_of_memory = true;
+    }
+
+    // Join the tokens of the chunks that were used
+    Py_ssize_t total = 0;
+    for (x = 0; x <= last; x++){
+        total += chunks[x].num_tokens;
+    }
+    if (!stream->out_of_memory){
+        if (last == 0){
+            stream->tokens = chunks[0].tokens;
+            chunks[0].tokens = NULL;
+        } else {
+            stream->tokens = malloc((total ? total : 1) * sizeof(token_span));
+            if (stream->tokens == NULL){
+                stream->out_of_memory = true;
+            } else {
+                Py_ssize_t pos = 0, y;
+                for (x = 0; x <= last; x++){
+                    for (y = 0; y < chunks[x].num_tokens; y++){
+                        stream->tokens[pos] = chunks[x].tokens[y];
+                        stream->tokens[pos].line_no += (unsigned int)chunks[x].line_offset;
+                        pos++;
+                    }
+                }
+            }
+        }
+        stream->num_tokens = total;
+        stream->final_line_no = chunks[last].line_no + chunks[last].line_offset;
+        if (chunks[last].status == TOKEN_ERROR){
+            stream->failed = true;
+            memcpy(stream->error, chunks[last].error, err_size);
+        }
+    }
+
+    for (x = 0; x < num_chunks; x++){
+        free(chunks[x].tokens);
+    }
+    free(chunks);
+
+    if (stream->out_of_memory){
+        return;
+    }
+
+    // Unwrapping rewrites the data in place, so it must wait until the
+    //  scan is finished to keep the line numbers in error messages right
+    Py_ssize_t y;
+    for (y = 0; y < stream->num_tokens; y++){
+        token_span * span = &stream->tokens[y];
+        if (span->delimiter == ';'){
+            span->length = (unsigned int)unwrap_embedded_star(&stream->data[span->start], span->length);
+        }
+    }
+}
+
+static void
+TokenStream_dealloc(TokenStream *self)
+{
+    intern_table_clear(&self->interned);
+    free(self->data);
+    free(self->tokens);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+/* Returns the next token as a tuple, optionally including the kind. Returns
+   NULL without an exception set when there are no more tokens. */
+static PyObject *
+TokenStream_next_token(TokenStream *self, bool typed)
+{
+    if (self->position < self->num_tokens){
+        token_span * span = &self->tokens[self->position++];
+        PyObject * token = make_interned_string(&self->interned, &self->data[span->start], span->length, self->ascii);
+        if (token == NULL){
+            return NULL;
+        }
+        if (typed){
+            return Py_BuildValue("NICi", token, span->line_no, span->delimiter, span->kind);
+        }
+        return Py_BuildValue("NIC", token, span->line_no, span->delimiter);
+    }
+    if (self->failed){
+        PyErr_SetString(PyExc_ValueError, self->error);
+    }
+    return NULL;
+}
+
+static PyObject *
+TokenStream_next(TokenStream *self)
+{
+    return TokenStream_next_token(self, false);
+}
+
+static PyObject *
+TokenStream_get_token_full(TokenStream *self, PyObject *Py_UNUSED(ignored))
+{
+    PyObject * result = TokenStream_next_token(self, false);
+    if ((result == NULL) && (!PyErr_Occurred())){
+        return Py_BuildValue("OlC", Py_None, self->final_line_no, '?');
+    }
+    return result;
+}
+
+static PyObject *
+TokenStream_get_token_typed(TokenStream *self, PyObject *Py_UNUSED(ignored))
+{
+    PyObject * result = TokenStream_next_token(self, true);
+    if ((result == NULL) && (!PyErr_Occurred())){
+        return Py_BuildValue("OlCO", Py_None, self->final_line_no, '?', Py_None);
+    }
+    return result;
+}
+
+static Py_ssize_t
+TokenStream_len(TokenStream *self)
+{
+    return self->num_tokens;
+}
+
+/* The values of one loop, stored as the positions of their tokens within a
+   TokenStream's data. A str is only created for a value once it is asked for,
+   after which it is kept. */
+typedef struct {
+    PyObject_HEAD
+    TokenStream * stream;
+    Py_ssize_t first;
+    Py_ssize_t count;
+    Py_ssize_t width;
+    // The values created so far, or NULL if none have been
+    PyObject ** values;
+} LoopValues;
+
+static void
+LoopValues_dealloc(LoopValues *self)
+{
+    if (self->values != NULL){
+        Py_ssize_t x;
+        for (x = 0; x < self->count; x++){
+            Py_XDECREF(self->values[x]);
+        }
+        free(self->values);
+    }
+    Py_XDECREF(self->stream);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static Py_ssize_t
+LoopValues_len(LoopValues *self)
+{
+    return self->count;
+}
+
+/* Returns a new reference to a value, creating it if necessary. */
+static PyObject *
+LoopValues_value(LoopValues *self, Py_ssize_t index)
+{
+    if (self->values == NULL){
+        self->values = calloc(self->count, sizeof(PyObject *));
+        if (self->values == NULL){
+            return PyErr_NoMemory();
+        }
+    }
+    PyObject * value = self->values[index];
+    if (value == NULL){
+        token_span * span = &self->stream->tokens[self->first + index];
+        value = make_interned_string(&self->stream->interned, &self->stream->data[span->start], span->length,
+                                     self->stream->ascii);
+        if (value == NULL){
+            return NULL;
+        }
+        self->values[index] = value;
+    }
+    Py_INCREF(value);
+    return value;
+}
+
+static PyObject *
+LoopValues_item(LoopValues *self, Py_ssize_t index)
+{
+    if ((index < 0) || (index >= self->count)){
+        PyErr_SetString(PyExc_IndexError, "Loop value index out of range.");
+        return NULL;
+    }
+    return LoopValues_value(self, index);
+}
+
+static PyObject *
+LoopValues_rows(LoopValues *self, PyObject *Py_UNUSED(ignored))
+{
+    Py_ssize_t num_rows = self->count / self->width;
+    PyObject * rows = PyList_New(num_rows);
+    if (rows == NULL){
+        return NULL;
+    }
+
+    Py_ssize_t row_pos, col_pos;
+    for (row_pos = 0; row_pos < num_rows; row_pos++){
+        PyObject * row = PyList_New(self->width);
+        if (row == NULL){
+            Py_DECREF(rows);
+            return NULL;
+        }
+        PyList_SET_ITEM(rows, row_pos, row);
+        for (col_pos = 0; col_pos < self->width; col_pos++){
+            PyObject * value = LoopValues_value(self, row_pos * self->width + col_pos);
+            if (value == NULL){
+                Py_DECREF(rows);
+                return NULL;
+            }
+            PyList_SET_ITEM(row, col_pos, value);
+        }
+    }
+    return rows;
+}
+
+static PyObject *
+LoopValues_column(LoopValues *self, PyObject *args)
+{
+    Py_ssize_t column;
+    if (!PyArg_ParseTuple(args, "n", &column))
+        return NULL;
+    if ((column < 0) || (column >= self->width)){
+        PyErr_SetString(PyExc_IndexError, "Loop column index out of range.");
+        return NULL;
+    }
+
+    Py_ssize_t num_rows = self->count / self->width;
+    PyObject * result = PyList_New(num_rows);
+    if (result == NULL){
+        return NULL;
+    }
+    Py_ssize_t row_pos;
+    for (row_pos = 0; row_pos < num_rows; row_pos++){
+        PyObject * value = LoopValues_value(self, row_pos * self->width + column);
+        if (value == NULL){
+            Py_DECREF(result);
+            return NULL;
+        }
+        PyList_SET_ITEM(result, row_pos, value);
+    }
+    return result;
+}
+
+/* Returns the rows with every value quoted as by quote_value(). Values are
+   quoted straight from the tokenized data, so values which don't need
+   quoting are copied as they are without the value itself being created. */
+static PyObject *
+LoopValues_quoted(LoopValues *self, PyObject *Py_UNUSED(ignored))
+{
+    Py_ssize_t num_rows = self->count / self->width;
+    PyObject * rows = PyList_New(num_rows);
+    if (rows == NULL){
+        return NULL;
+    }
+
+    Py_ssize_t row_pos, col_pos;
+    for (row_pos = 0; row_pos < num_rows; row_pos++){
+        PyObject * row = PyList_New(self->width);
+        if (row == NULL){
+            Py_DECREF(rows);
+            return NULL;
+        }
+        PyList_SET_ITEM(rows, row_pos, row);
+        for (col_pos = 0; col_pos < self->width; col_pos++){
+            Py_ssize_t index = row_pos * self->width + col_pos;
+            PyObject * value = self->values != NULL ? self->values[index] : NULL;
+            PyObject * quoted;
+            // quote_text() needs the text of the value itself if the value is provided
+            if (value != NULL){
+                Py_ssize_t length;
+                const char * text = PyUnicode_AsUTF8AndSize(value, &length);
+                quoted = text == NULL ? NULL : quote_text(text, length, PyUnicode_IS_ASCII(value), value);
+            } else {
+                token_span * span = &self->stream->tokens[self->first + index];
+                const char * text = &self->stream->data[span->start];
+                quoted = quote_text(text, span->length, self->stream->ascii || is_ascii(text, span->length), NULL);
+            }
+            if (quoted == NULL){
+                Py_DECREF(rows);
+                return NULL;
+            }
+            PyList_SET_ITEM(row, col_pos, quoted);
+        }
+    }
+    return rows;
+}
+
+static PyTypeObject LoopValuesType;
+
+/* Returns the rows from start up to stop as another LoopValues, without
+   creating any of the values. */
+static PyObject *
+LoopValues_slice(LoopValues *self, PyObject *args)
+{
+    Py_ssize_t start, stop;
+    if (!PyArg_ParseTuple(args, "nn", &start, &stop))
+        return NULL;
+    Py_ssize_t num_rows = self->count / self->width;
+    if ((start < 0) || (stop < 0)){
+        PyErr_SetString(PyExc_IndexError, "Loop rows can only be sliced with non-negative indices.");
+        return NULL;
+    }
+    if (stop > num_rows){
+        stop = num_rows;
+    }
+    if (start > stop){
+        start = stop;
+    }
+
+    LoopValues * values = PyObject_New(LoopValues, &LoopValuesType);
+    if (values == NULL){
+        return NULL;
+    }
+    Py_INCREF(self->stream);
+    values->stream = self->stream;
+    values->first = self->first + start * self->width;
+    values->count = (stop - start) * self->width;
+    values->width = self->width;
+    values->values = NULL;
+    return (PyObject *)values;
+}
+
+static PyObject *
+LoopValues_get_width(LoopValues *self, void *closure)
+{
+    return PyLong_FromSsize_t(self->width);
+}
+
+static PyMethodDef LoopValues_methods[] = {
+    {"rows", (PyCFunction)LoopValues_rows, METH_NOARGS,
+     "Returns the values as a list of rows."},
+    {"column", (PyCFunction)LoopValues_column, METH_VARARGS,
+     "Returns the values of one column as a list."},
+    {"quoted", (PyCFunction)LoopValues_quoted, METH_NOARGS,
+     "Returns the rows with the values quoted as quote_value() would."},
+    {"slice", (PyCFunction)LoopValues_slice, METH_VARARGS,
+     "Returns the rows from start up to stop as another LoopValues."},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef LoopValues_getset[] = {
+    {"width", (getter)LoopValues_get_width, NULL, "The number of values in each row.", NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+static PySequenceMethods LoopValues_as_sequence = {
+    .sq_length = (lenfunc)LoopValues_len,
+    .sq_item = (ssizeargfunc)LoopValues_item,
+};
+
+static PyTypeObject LoopValuesType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "cnmrstar.LoopValues",
+    .tp_doc = "The values of a loop, created as they are needed. Create with TokenStream.read_loop_values().",
+    .tp_basicsize = sizeof(LoopValues),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_dealloc = (destructor)LoopValues_dealloc,
+    .tp_methods = LoopValues_methods,
+    .tp_getset = LoopValues_getset,
+    .tp_as_sequence = &LoopValues_as_sequence,
+};
+
+/* Whether the parser takes a token within the data of a loop as a value,
+   rather than as the end of the loop (or an error). */
+bool is_loop_value(const token_span * span){
+    if (span->kind == KIND_STOP){
+        return false;
+    }
+    if (span->delimiter != ' '){
+        return true;
+    }
+    switch (span->kind){
+        case KIND_TAG:
+        case KIND_SAVE_END:
+        case KIND_LOOP:
+            return false;
+        case KIND_DATA:
+            return span->length != 5;
+        case KIND_GLOBAL:
+            return span->length != 7;
+        default:
+            return true;
+    }
+}
+
+/* Reads the values of a loop, starting with the token that was returned
+   last. Stops before the first token that isn't a loop value, so that it is
+   the next token returned. */
+static PyObject *
+TokenStream_read_loop_values(TokenStream *self, PyObject *args)
+{
+    Py_ssize_t width;
+    if (!PyArg_ParseTuple(args, "n", &width))
+        return NULL;
+    if (width < 1){
+        PyErr_SetString(PyExc_ValueError, "A loop must have at least one tag to read its values.");
+        return NULL;
+    }
+    if ((self->position < 1) || (self->position > self->num_tokens)){
+        PyErr_SetString(PyExc_ValueError, "There is no current token to start reading loop values from.");
+        return NULL;
+    }
+
+    Py_ssize_t first = self->position - 1;
+    Py_ssize_t end = self->position;
+    while ((end < self->num_tokens) && is_loop_value(&self->tokens[end])){
+        end++;
+    }
+
+    LoopValues * values = PyObject_New(LoopValues, &LoopValuesType);
+    if (values == NULL){
+        return NULL;
+    }
+    Py_INCREF(self);
+    values->stream = self;
+    values->first = first;
+    values->count = end - first;
+    values->width = width;
+    values->values = NULL;
+
+    self->position = end;
+    return (PyObject *)values;
+}
+
+static PyObject *
+TokenStream_intern_stats(TokenStream *self, PyObject *Py_UNUSED(ignored))
+{
+    return Py_BuildValue("{sKsKsKsn}", "interned", self->interned.interned, "added", self->interned.added,
+                         "not_interned", self->interned.not_interned, "entries", self->interned.entries);
+}
+
+static PyMethodDef TokenStream_methods[] = {
+    {"get_token_full", (PyCFunction)TokenStream_get_token_full, METH_NOARGS,
+     "Get the next token as well as the line number and delimiter."},
+    {"get_token_typed", (PyCFunction)TokenStream_get_token_typed, METH_NOARGS,
+     "Get the next token as well as the line number, delimiter, and kind of token."},
+    {"read_loop_values", (PyCFunction)TokenStream_read_loop_values, METH_VARARGS,
+     "Read the values of a loop with the given number of tags, starting with the current token.\n"
+     "Returns a LoopValues."},
+    {"intern_stats", (PyCFunction)TokenStream_intern_stats, METH_NOARGS,
+     "Returns how many of the values created so far were interned (shared with an earlier\n"
+     "value), added to the intern table, or not interned, and the size of the table."},
+    {NULL, NULL, 0, NULL}
+};
+
+static PySequenceMethods TokenStream_as_sequence = {
+    .sq_length = (lenfunc)TokenStream_len,
+};
+
+static PyTypeObject TokenStreamType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "cnmrstar.TokenStream",
+    .tp_doc = "The tokens of some NMR-STAR data. Create with tokenize().",
+    .tp_basicsize = sizeof(TokenStream),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_dealloc = (destructor)TokenStream_dealloc,
+    .tp_iter = PyObject_SelfIter,
+    .tp_iternext = (iternextfunc)TokenStream_next,
+    .tp_methods = TokenStream_methods,
+    .tp_as_sequence = &TokenStream_as_sequence,
+};
+
+/* Returns a new TokenStream with no data or tokens, or NULL with an
+   exception set. */
+static TokenStream * new_token_stream(bool ascii){
+    TokenStream * stream = PyObject_New(TokenStream, &TokenStreamType);
+    if (stream == NULL)
+        return NULL;
+    stream->data = NULL;
+    stream->length = 0;
+    stream->tokens = NULL;
+    stream->num_tokens = 0;
+    stream->position = 0;
+    stream->final_line_no = 0;
+    stream->ascii = ascii;
+    stream->failed = false;
+    stream->out_of_memory = false;
+    stream->error[0] = '\0';
+    memset(&stream->interned, 0, sizeof(intern_table));
+    return stream;
+}
+
+static PyObject *
+PARSE_tokenize(PyObject *self, PyObject *args)
+{
+    PyObject * data;
+    int threads = 1;
+    long chunk_size = 0;
+
+    if (!PyArg_ParseTuple(args, "U|il", &data, &threads, &chunk_size))
+        return NULL;
+
+    Py_ssize_t length;
+    const char * utf8 = PyUnicode_AsUTF8AndSize(data, &length);
+    if (utf8 == NULL)
+        return NULL;
+    if (memchr(utf8, '\0', length) != NULL){
+        PyErr_SetString(PyExc_ValueError, "embedded null character");
+        return NULL;
+    }
+    if (length > UINT_MAX){
+        PyErr_SetString(PyExc_ValueError, "Data is too large to tokenize.");
+        return NULL;
+    }
+
+    TokenStream * stream = new_token_stream(PyUnicode_IS_ASCII(data));
+    if (stream == NULL)
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    stream->data = normalize_data(utf8, length, &stream->length);
+    if (stream->data == NULL){
+        stream->out_of_memory = true;
+    } else {
+        scan_tokens(stream, threads, chunk_size);
+    }
+    Py_END_ALLOW_THREADS
+
+    if (stream->out_of_memory){
+        Py_DECREF(stream);
+        return PyErr_NoMemory();
+    }
+    return (PyObject *)stream;
+}
+
+/* JSON. encode_json() writes exactly what json.dumps(obj, default=default)
+   would, without building the text of each value as a separate str. The
+   values of lazily parsed loops are written straight from the tokenized
+   data. decode_json() reads what json.loads() would, except that the values
+   of loops (arrays of arrays of strings under a "data" key) are stored as
+   LoopValues rather than created as lists of str. */
+
+typedef struct {
+    char * data;
+    Py_ssize_t length;
+    Py_ssize_t allocated;
+} json_buffer;
+
+/* Makes room for extra more bytes. Returns false with an exception set if
+   out of memory. */
+static bool json_reserve(json_buffer * buffer, Py_ssize_t extra){
+    if (buffer->length + extra <= buffer->allocated){
+        return true;
+    }
+    Py_ssize_t allocated = buffer->allocated * 2;
+    if (allocated < buffer->length + extra){
+        allocated = buffer->length + extra;
+    }
+    if (allocated < 4096){
+        allocated = 4096;
+    }
+    char * data = realloc(buffer->data, allocated);
+    if (data == NULL){
+        PyErr_NoMemory();
+        return false;
+    }
+    buffer->data = data;
+    buffer->allocated = allocated;
+    return true;
+}
+
+static bool json_write(json_buffer * buffer, const char * text, Py_ssize_t length){
+    if (!json_reserve(buffer, length)){
+        return false;
+    }
+    memcpy(&buffer->data[buffer->length], text, length);
+    buffer->length += length;
+    return true;
+}
+
+static const char json_hex[] = "0123456789abcdef";
+
+static void json_write_escape(char * out, Py_UCS4 c){
+    out[0] = '\\';
+    out[1] = 'u';
+    out[2] = json_hex[(c >> 12) & 0xf];
+    out[3] = json_hex[(c >> 8) & 0xf];
+    out[4] = json_hex[(c >> 4) & 0xf];
+    out[5] = json_hex[c & 0xf];
+}
+
+/* Writes one character of a string the way json.dumps() does with
+   ensure_ascii. There must be room for 12 bytes. */
+static void json_write_char(json_buffer * buffer, Py_UCS4 c){
+    char * out = &buffer->data[buffer->length];
+    if ((c >= ' ') && (c <= '~') && (c != '"') && (c != '\\')){
+        out[0] = (char)c;
+        buffer->length++;
+        return;
+    }
+    char short_escape = 0;
+    switch (c){
+        case '"': short_escape = '"'; break;
+        case '\\': short_escape = '\\'; break;
+        case '\b': short_escape = 'b'; break;
+        case '\f': short_escape = 'f'; break;
+        case '\n': short_escape = 'n'; break;
+        case '\r': short_escape = 'r'; break;
+        case '\t': short_escape = 't'; break;
+    }
+    if (short_escape){
+        out[0] = '\\';
+        out[1] = short_escape;
+        buffer->length += 2;
+    } else if (c >= 0x10000){
+        c -= 0x10000;
+        json_write_escape(out, 0xd800 | ((c >> 10) & 0x3ff));
+        json_write_escape(out + 6, 0xdc00 | (c & 0x3ff));
+        buffer->length += 12;
+    } else {
+        json_write_escape(out, c);
+        buffer->length += 6;
+    }
+}
+
+static bool json_write_str(json_buffer * buffer, PyObject * str){
+#if PY_VERSION_HEX < 0x030C0000
+    if (PyUnicode_READY(str) < 0){
+        return false;
+    }
+#endif
+    Py_ssize_t length = PyUnicode_GET_LENGTH(str);
+    if (!json_reserve(buffer, 2 + length * (PyUnicode_IS_ASCII(str) ? 6 : 12))){
+        return false;
+    }
+    buffer->data[buffer->length++] = '"';
+    int kind = PyUnicode_KIND(str);
+    const void * data = PyUnicode_DATA(str);
+    Py_ssize_t x;
+    for (x = 0; x < length; x++){
+        json_write_char(buffer, PyUnicode_READ(kind, data, x));
+    }
+    buffer->data[buffer->length++] = '"';
+    return true;
+}
+
+/* Writes a string from valid UTF-8, such as the tokenized data. */
+static bool json_write_utf8(json_buffer * buffer, const char * text, Py_ssize_t length){
+    // No character takes more than six times as many bytes escaped
+    if (!json_reserve(buffer, 2 + length * 6)){
+        return false;
+    }
+    buffer->data[buffer->length++] = '"';
+    const unsigned char * bytes = (const unsigned char *)text;
+    Py_ssize_t x = 0;
+    while (x < length){
+        Py_UCS4 c = bytes[x];
+        if ((c < 0x80) || (x + 1 >= length)){
+            x++;
+        } else if ((c < 0xe0) || (x + 2 >= length)){
+            c = ((c & 0x1f) << 6) | (bytes[x+1] & 0x3f);
+            x += 2;
+        } else if ((c < 0xf0) || (x + 3 >= length)){
+            c = ((c & 0x0f) << 12) | ((bytes[x+1] & 0x3f) << 6) | (bytes[x+2] & 0x3f);
+            x += 3;
+        } else {
+            c = ((c & 0x07) << 18) | ((bytes[x+1] & 0x3f) << 12) | ((bytes[x+2] & 0x3f) << 6) | (bytes[x+3] & 0x3f);
+            x += 4;
+        }
+        json_write_char(buffer, c);
+    }
+    buffer->data[buffer->length++] = '"';
+    return true;
+}
+
+/* Writes the text of a repr() and releases it. */
+static bool json_write_repr(json_buffer * buffer, PyObject * repr){
+    if (repr == NULL){
+        return false;
+    }
+    Py_ssize_t length;
+    const char * text = PyUnicode_AsUTF8AndSize(repr, &length);
+    bool result = (text != NULL) && json_write(buffer, text, length);
+    Py_DECREF(repr);
+    return result;
+}
+
+static bool json_write_float(json_buffer * buffer, PyObject * obj){
+    double value = PyFloat_AS_DOUBLE(obj);
+    if (Py_IS_NAN(value)){
+        return json_write(buffer, "NaN", 3);
+    }
+    if (Py_IS_INFINITY(value)){
+        return value > 0 ? json_write(buffer, "Infinity", 8) : json_write(buffer, "-Infinity", 9);
+    }
+    return json_write_repr(buffer, PyFloat_Type.tp_repr(obj));
+}
+
+typedef struct {
+    const char * text;
+    Py_ssize_t length;
+} json_text;
+
+/* How the rows of a loop are written. Normally this is as an array of
+   arrays, but encode_json_rows() can write each row in other ways, such as
+   an object with a key for each tag. */
+typedef struct {
+    json_text open;
+    json_text close;
+    json_text row_start;
+    json_text row_end;
+    // Written between rows
+    json_text separator;
+    // Written before each value of a row, or NULL to separate the values with ", "
+    json_text * prefixes;
+    Py_ssize_t num_prefixes;
+} json_row_format;
+
+static const json_row_format json_array_format = {{"[", 1}, {"]", 1}, {"[", 1}, {"]", 1}, {", ", 2}, NULL, 0};
+
+static bool json_write_text(json_buffer * buffer, json_text text){
+    return json_write(buffer, text.text, text.length);
+}
+
+/* Raises ValueError if the rows don't have one value for each prefix. */
+static bool json_check_width(const json_row_format * format, Py_ssize_t width){
+    if ((format->prefixes != NULL) && (width != format->num_prefixes)){
+        PyErr_Format(PyExc_ValueError, "The rows have %zd values, but %zd were expected.", width,
+                     format->num_prefixes);
+        return false;
+    }
+    return true;
+}
+
+static bool json_write_row_start(json_buffer * buffer, const json_row_format * format, Py_ssize_t row){
+    return ((row == 0) || json_write_text(buffer, format->separator)) && json_write_text(buffer, format->row_start);
+}
+
+static bool json_write_value_prefix(json_buffer * buffer, const json_row_format * format, Py_ssize_t column){
+    if (format->prefixes != NULL){
+        return json_write_text(buffer, format->prefixes[column]);
+    }
+    return (column == 0) || json_write(buffer, ", ", 2);
+}
+
+/* Writes the values as rows (as LoopValues.rows() would return them)
+   without creating the values. */
+static bool json_write_loop_values(json_buffer * buffer, LoopValues * values, const json_row_format * format){
+    if (!json_check_width(format, values->width) || !json_write_text(buffer, format->open)){
+        return false;
+    }
+    Py_ssize_t num_rows = values->count / values->width, row, column;
+    for (row = 0; row < num_rows; row++){
+        if (!json_write_row_start(buffer, format, row)){
+            return false;
+        }
+        for (column = 0; column < values->width; column++){
+            token_span * span = &values->stream->tokens[values->first + row * values->width + column];
+            if (!json_write_value_prefix(buffer, format, column) ||
+                !json_write_utf8(buffer, &values->stream->data[span->start], span->length)){
+                return false;
+            }
+        }
+        if (!json_write_text(buffer, format->row_end)){
+            return false;
+        }
+    }
+    return json_write_text(buffer, format->close);
+}
+
+// What json_write_object() needs besides the buffer
+typedef struct {
+    // Called for objects JSON has no type for, as with json.dumps()
+    PyObject * default_function;
+    // Objects of this type are written as the rows of their _columns, or NULL
+    PyObject * columns_type;
+} json_encoder;
+
+static bool json_write_object(json_buffer * buffer, PyObject * obj, json_encoder * encoder);
+
+/* Writes a key of a dict, which json.dumps() turns into a string if it is
+   a number, bool or None. */
+static bool json_write_key(json_buffer * buffer, PyObject * key){
+    if (PyUnicode_Check(key)){
+        return json_write_str(buffer, key);
+    }
+    if (!PyLong_Check(key) && !PyFloat_Check(key) && (key != Py_None)){
+        PyErr_Format(PyExc_TypeError, "keys must be str, int, float, bool or None, not %.100s", Py_TYPE(key)->tp_name);
+        return false;
+    }
+    if (!json_write(buffer, "\"", 1)){
+        return false;
+    }
+    bool result;
+    if (key == Py_True){
+        result = json_write(buffer, "true", 4);
+    } else if (key == Py_False){
+        result = json_write(buffer, "false", 5);
+    } else if (key == Py_None){
+        result = json_write(buffer, "null", 4);
+    } else if (PyFloat_Check(key)){
+        result = json_write_float(buffer, key);
+    } else {
+        result = json_write_repr(buffer, PyLong_Type.tp_repr(key));
+    }
+    return result && json_write(buffer, "\"", 1);
+}
+
+static bool json_write_array(json_buffer * buffer, PyObject * obj, json_encoder * encoder){
+    if (PySequence_Fast_GET_SIZE(obj) == 0){
+        return json_write(buffer, "[]", 2);
+    }
+    if (!json_write(buffer, "[", 1)){
+        return false;
+    }
+    Py_ssize_t x;
+    for (x = 0; x < PySequence_Fast_GET_SIZE(obj); x++){
+        if ((x > 0) && !json_write(buffer, ", ", 2)){
+            return false;
+        }
+        PyObject * item = PySequence_Fast_GET_ITEM(obj, x);
+        Py_INCREF(item);
+        bool result = json_write_object(buffer, item, encoder);
+        Py_DECREF(item);
+        if (!result){
+            return false;
+        }
+    }
+    return json_write(buffer, "]", 1);
+}
+
+static bool json_write_dict(json_buffer * buffer, PyObject * obj, json_encoder * encoder){
+    if (PyDict_GET_SIZE(obj) == 0){
+        return json_write(buffer, "{}", 2);
+    }
+    PyObject * items = PyMapping_Items(obj);
+    if (items == NULL){
+        return false;
+    }
+    bool result = json_write(buffer, "{", 1);
+    Py_ssize_t x;
+    for (x = 0; result && (x < PyList_GET_SIZE(items)); x++){
+        PyObject * item = PyList_GET_ITEM(items, x);
+        if (!PyTuple_Check(item) || (PyTuple_GET_SIZE(item) != 2)){
+            PyErr_SetString(PyExc_ValueError, "items must return 2-tuples");
+            result = false;
+            break;
+        }
+        result = ((x == 0) || json_write(buffer, ", ", 2)) &&
+                 json_write_key(buffer, PyTuple_GET_ITEM(item, 0)) &&
+                 json_write(buffer, ": ", 2) &&
+                 json_write_object(buffer, PyTuple_GET_ITEM(item, 1), encoder);
+    }
+    Py_DECREF(items);
+    return result && json_write(buffer, "}", 1);
+}
+
+/* One column of a loop stored as columns. A categorical column (one with
+   a values tuple of the distinct values, and an array of codes) has each
+   distinct value written once up front, after which each row only copies
+   the JSON of its value. */
+typedef struct {
+    // The values of a column that isn't categorical
+    PyObject * values;
+    // The codes of a categorical column, if codes.obj isn't NULL
+    Py_buffer codes;
+    // Where the JSON of each distinct value starts in the encoded buffer
+    Py_ssize_t * offsets;
+    Py_ssize_t num_values;
+} json_column;
+
+/* Gets the distinct values and the codes of a categorical column (one with
+   a values tuple, and an array of unsigned integer codes). Returns a new
+   reference to the values, or NULL, without an exception set, if the
+   column isn't one. */
+static PyObject * load_categorical(PyObject * obj, Py_buffer * codes_buffer){
+    if (PyList_Check(obj) || PyTuple_Check(obj) || !PyObject_HasAttrString(obj, "codes") ||
+        !PyObject_HasAttrString(obj, "values")){
+        return NULL;
+    }
+    PyObject * values = PyObject_GetAttrString(obj, "values");
+    PyObject * codes = PyObject_GetAttrString(obj, "codes");
+    bool result = false;
+    if ((values != NULL) && (codes != NULL) && PyTuple_Check(values) &&
+        (PyObject_GetBuffer(codes, codes_buffer, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) == 0)){
+        const char * format = codes_buffer->format;
+        Py_ssize_t size = codes_buffer->itemsize;
+        if ((format != NULL) && (strchr("BHILQ", format[0]) != NULL) && (format[1] == '\0') &&
+            ((size == 1) || (size == 2) || (size == 4) || (size == 8))){
+            result = true;
+        } else {
+            PyBuffer_Release(codes_buffer);
+            codes_buffer->obj = NULL;
+        }
+    }
+    PyErr_Clear();
+    Py_XDECREF(codes);
+    if (!result){
+        Py_XDECREF(values);
+        return NULL;
+    }
+    return values;
+}
+
+static Py_ssize_t categorical_code(Py_buffer * codes_buffer, Py_ssize_t row){
+    const char * codes = (const char *)codes_buffer->buf;
+    switch (codes_buffer->itemsize){
+        case 1: return ((const uint8_t *)codes)[row];
+        case 2: return ((const uint16_t *)codes)[row];
+        case 4: return ((const uint32_t *)codes)[row];
+        default: return (Py_ssize_t)((const uint64_t *)codes)[row];
+    }
+}
+
+/* Sets up a categorical column. Returns false, without an exception set,
+   if the column isn't one. */
+static bool json_load_categorical(json_column * column, PyObject * obj, json_buffer * encoded,
+                                  json_encoder * encoder){
+    PyObject * values = load_categorical(obj, &column->codes);
+    if (values == NULL){
+        return false;
+    }
+
+    column->num_values = PyTuple_GET_SIZE(values);
+    column->offsets = malloc((column->num_values + 1) * sizeof(Py_ssize_t));
+    if (column->offsets == NULL){
+        Py_DECREF(values);
+        PyErr_NoMemory();
+        return true;
+    }
+    Py_ssize_t x;
+    for (x = 0; x < column->num_values; x++){
+        column->offsets[x] = encoded->length;
+        if (!json_write_object(encoded, PyTuple_GET_ITEM(values, x), encoder)){
+            break;
+        }
+    }
+    column->offsets[x] = encoded->length;
+    Py_DECREF(values);
+    return true;
+}
+
+/* Writes the rows of some columns, as json.dumps(list(zip(*columns)))
+   would with the default format. */
+static bool json_write_columns(json_buffer * buffer, PyObject * columns, json_encoder * encoder,
+                               const json_row_format * format){
+    PyObject * fast = PySequence_Fast(columns, "The columns must be a sequence.");
+    if (fast == NULL){
+        return false;
+    }
+    Py_ssize_t num_columns = PySequence_Fast_GET_SIZE(fast);
+    json_column * loaded = calloc(num_columns ? num_columns : 1, sizeof(json_column));
+    json_buffer encoded = {NULL, 0, 0};
+    bool result = loaded != NULL;
+    if (!result){
+        PyErr_NoMemory();
+    }
+
+    Py_ssize_t num_rows = 0, x, row;
+    for (x = 0; result && (x < num_columns); x++){
+        PyObject * column = PySequence_Fast_GET_ITEM(fast, x);
+        Py_ssize_t length;
+        if (json_load_categorical(&loaded[x], column, &encoded, encoder)){
+            result = !PyErr_Occurred();
+            length = loaded[x].codes.len / loaded[x].codes.itemsize;
+        } else {
+            loaded[x].values = PySequence_Fast(column, "Each column must be a sequence.");
+            result = loaded[x].values != NULL;
+            length = result ? PySequence_Fast_GET_SIZE(loaded[x].values) : 0;
+        }
+        // Like zip(), stop at the end of the shortest column
+        if ((x == 0) || (length < num_rows)){
+            num_rows = length;
+        }
+    }
+
+    if (num_columns == 0){
+        num_rows = 0;
+    }
+    if (result){
+        result = json_check_width(format, num_columns) && json_write_text(buffer, format->open);
+        for (row = 0; result && (row < num_rows); row++){
+            result = json_write_row_start(buffer, format, row);
+            for (x = 0; result && (x < num_columns); x++){
+                if (!json_write_value_prefix(buffer, format, x)){
+                    result = false;
+                    break;
+                }
+                json_column * column = &loaded[x];
+                if (column->values != NULL){
+                    result = json_write_object(buffer, PySequence_Fast_GET_ITEM(column->values, row), encoder);
+                    continue;
+                }
+                Py_ssize_t code = categorical_code(&column->codes, row);
+                if ((code < 0) || (code >= column->num_values)){
+                    PyErr_SetString(PyExc_ValueError, "A categorical column has a code with no value.");
+                    result = false;
+                    break;
+                }
+                result = json_write(buffer, &encoded.data[column->offsets[code]],
+                                    column->offsets[code + 1] - column->offsets[code]);
+            }
+            result = result && json_write_text(buffer, format->row_end);
+        }
+        result = result && json_write_text(buffer, format->close);
+    }
+
+    if (loaded != NULL){
+        for (x = 0; x < num_columns; x++){
+            Py_XDECREF(loaded[x].values);
+            if (loaded[x].codes.obj != NULL){
+                PyBuffer_Release(&loaded[x].codes);
+            }
+            free(loaded[x].offsets);
+        }
+        free(loaded);
+    }
+    free(encoded.data);
+    Py_DECREF(fast);
+    return result;
+}
+
+static bool json_write_object(json_buffer * buffer, PyObject * obj, json_encoder * encoder){
+    if (obj == Py_None){
+        return json_write(buffer, "null", 4);
+    }
+    if (obj == Py_True){
+        return json_write(buffer, "true", 4);
+    }
+    if (obj == Py_False){
+        return json_write(buffer, "false", 5);
+    }
+    if (PyUnicode_Check(obj)){
+        return json_write_str(buffer, obj);
+    }
+    if (PyLong_Check(obj)){
+        return json_write_repr(buffer, PyLong_Type.tp_repr(obj));
+    }
+    if (PyFloat_Check(obj)){
+        return json_write_float(buffer, obj);
+    }
+    if (Py_TYPE(obj) == &LoopValuesType){
+        return json_write_loop_values(buffer, (LoopValues *)obj, &json_array_format);
+    }
+
+    if (Py_EnterRecursiveCall(" while encoding a JSON object")){
+        return false;
+    }
+    bool result;
+    if (PyList_Check(obj) || PyTuple_Check(obj)){
+        result = json_write_array(buffer, obj, encoder);
+    } else if (PyDict_Check(obj)){
+        result = json_write_dict(buffer, obj, encoder);
+    } else if ((encoder->columns_type != NULL) && ((PyObject *)Py_TYPE(obj) == encoder->columns_type)){
+        PyObject * columns = PyObject_GetAttrString(obj, "_columns");
+        result = (columns != NULL) && json_write_columns(buffer, columns, encoder, &json_array_format);
+        Py_XDECREF(columns);
+    } else {
+        // Anything else is written as whatever the default function returns for it
+        PyObject * replacement = PyObject_CallFunctionObjArgs(encoder->default_function, obj, NULL);
+        result = (replacement != NULL) && json_write_object(buffer, replacement, encoder);
+        Py_XDECREF(replacement);
+    }
+    Py_LeaveRecursiveCall();
+    return result;
+}
+
+static PyObject *
+encode_json(PyObject *self, PyObject *args)
+{
+    json_encoder encoder = {NULL, NULL};
+    PyObject * obj;
+    if (!PyArg_ParseTuple(args, "OO|O", &obj, &encoder.default_function, &encoder.columns_type))
+        return NULL;
+    if (encoder.columns_type == Py_None){
+        encoder.columns_type = NULL;
+    }
+
+    json_buffer buffer = {NULL, 0, 0};
+    PyObject * result = NULL;
+    if (json_write_object(&buffer, obj, &encoder)){
+        result = PyUnicode_New(buffer.length, 127);
+        if (result != NULL){
+            memcpy(PyUnicode_1BYTE_DATA(result), buffer.data, buffer.length);
+        }
+    }
+    free(buffer.data);
+    return result;
+}
+
+/* Writes rows which are a list (or other sequence) of rows. */
+static bool json_write_row_list(json_buffer * buffer, PyObject * rows, json_encoder * encoder,
+                                const json_row_format * format){
+    PyObject * fast = PySequence_Fast(rows, "The rows must be a sequence.");
+    if (fast == NULL){
+        return false;
+    }
+    bool result = json_write_text(buffer, format->open);
+    Py_ssize_t row, column;
+    for (row = 0; result && (row < PySequence_Fast_GET_SIZE(fast)); row++){
+        PyObject * values = PySequence_Fast_GET_ITEM(fast, row);
+        result = json_write_row_start(buffer, format, row);
+        if (result && (format->prefixes == NULL) && !PyList_Check(values) && !PyTuple_Check(values)){
+            // Without prefixes, a row that isn't a list is written as json.dumps() would write it
+            result = json_write_object(buffer, values, encoder);
+            continue;
+        }
+        values = result ? PySequence_Fast(values, "Each row must be a sequence.") : NULL;
+        result = (values != NULL) && json_check_width(format, PySequence_Fast_GET_SIZE(values));
+        for (column = 0; result && (column < PySequence_Fast_GET_SIZE(values)); column++){
+            result = json_write_value_prefix(buffer, format, column) &&
+                     json_write_object(buffer, PySequence_Fast_GET_ITEM(values, column), encoder);
+        }
+        Py_XDECREF(values);
+        result = result && json_write_text(buffer, format->row_end);
+    }
+    Py_DECREF(fast);
+    return result && json_write_text(buffer, format->close);
+}
+
+/* Gets the text of a str which is already JSON. */
+static bool json_get_text(PyObject * str, json_text * text){
+    text->text = PyUnicode_AsUTF8AndSize(str, &text->length);
+    return text->text != NULL;
+}
+
+static PyObject *
+encode_json_rows(PyObject *self, PyObject *args)
+{
+    json_encoder encoder = {NULL, NULL};
+    json_row_format format = {{"", 0}, {"", 0}, {"", 0}, {"", 0}, {"", 0}, NULL, 0};
+    PyObject * rows, * row_start, * prefixes, * row_end, * separator;
+    if (!PyArg_ParseTuple(args, "OOOUOUU", &rows, &encoder.default_function, &encoder.columns_type, &row_start,
+                          &prefixes, &row_end, &separator))
+        return NULL;
+    if (encoder.columns_type == Py_None){
+        encoder.columns_type = NULL;
+    }
+    if (!json_get_text(row_start, &format.row_start) || !json_get_text(row_end, &format.row_end) ||
+        !json_get_text(separator, &format.separator))
+        return NULL;
+
+    PyObject * fast_prefixes = NULL;
+    if (prefixes != Py_None){
+        fast_prefixes = PySequence_Fast(prefixes, "The prefixes must be a sequence of str.");
+        if (fast_prefixes == NULL)
+            return NULL;
+        format.num_prefixes = PySequence_Fast_GET_SIZE(fast_prefixes);
+        format.prefixes = malloc((format.num_prefixes ? format.num_prefixes : 1) * sizeof(json_text));
+        if (format.prefixes == NULL){
+            Py_DECREF(fast_prefixes);
+            return PyErr_NoMemory();
+        }
+        Py_ssize_t x;
+        for (x = 0; x < format.num_prefixes; x++){
+            PyObject * prefix = PySequence_Fast_GET_ITEM(fast_prefixes, x);
+            if (!PyUnicode_Check(prefix)){
+                PyErr_SetString(PyExc_TypeError, "The prefixes must be a sequence of str.");
+                break;
+            }
+            if (!json_get_text(prefix, &format.prefixes[x])){
+                break;
+            }
+        }
+    }
+
+    json_buffer buffer = {NULL, 0, 0};
+    PyObject * result = NULL;
+    bool written = false;
+    if (!PyErr_Occurred()){
+        if (Py_TYPE(rows) == &LoopValuesType){
+            written = json_write_loop_values(&buffer, (LoopValues *)rows, &format);
+        } else if ((encoder.columns_type != NULL) && ((PyObject *)Py_TYPE(rows) == encoder.columns_type)){
+            PyObject * columns = PyObject_GetAttrString(rows, "_columns");
+            written = (columns != NULL) && json_write_columns(&buffer, columns, &encoder, &format);
+            Py_XDECREF(columns);
+        } else {
+            written = json_write_row_list(&buffer, rows, &encoder, &format);
+        }
+    }
+    if (written){
+        result = PyUnicode_New(buffer.length, 127);
+        if ((result != NULL) && (buffer.length > 0)){
+            memcpy(PyUnicode_1BYTE_DATA(result), buffer.data, buffer.length);
+        }
+    }
+    free(buffer.data);
+    free(format.prefixes);
+    Py_XDECREF(fast_prefixes);
+    return result;
+}
+
+typedef struct {
+    const char * text;
+    Py_ssize_t length;
+    Py_ssize_t position;
+    // Strings other than loop values are decoded into this
+    char * scratch;
+    Py_ssize_t scratch_size;
+    intern_table interned;
+    // Holds the loop values, created when the first loop is found
+    TokenStream * stream;
+    Py_ssize_t tokens_allocated;
+} json_reader;
+
+static PyObject * json_error(json_reader * reader){
+    if (!PyErr_Occurred()){
+        PyErr_Format(PyExc_ValueError, "Invalid JSON at position %zd.", reader->position);
+    }
+    return NULL;
+}
+
+static void json_skip_whitespace(json_reader * reader){
+    while (reader->position < reader->length){
+        char c = reader->text[reader->position];
+        if ((c != ' ') && (c != '\t') && (c != '\n') && (c != '\r')){
+            return;
+        }
+        reader->position++;
+    }
+}
+
+static char json_peek(json_reader * reader){
+    json_skip_whitespace(reader);
+    return reader->position < reader->length ? reader->text[reader->position] : '\0';
+}
+
+/* Returns how many bytes the string starting at the current position (just
+   after the opening quote) takes up, which is as many as it can need once
+   decoded. Returns -1 if it doesn't end. */
+static Py_ssize_t json_string_size(json_reader * reader){
+    Py_ssize_t end = reader->position;
+    while (end < reader->length){
+        char c = reader->text[end];
+        if (c == '"'){
+            return end - reader->position;
+        }
+        end += c == '\\' ? 2 : 1;
+    }
+    return -1;
+}
+
+static long json_read_hex(json_reader * reader, Py_ssize_t position){
+    if (position + 4 > reader->length){
+        return -1;
+    }
+    long value = 0;
+    int x;
+    for (x = 0; x < 4; x++){
+        char c = reader->text[position + x];
+        value <<= 4;
+        if ((c >= '0') && (c <= '9')){
+            value |= c - '0';
+        } else if ((c >= 'a') && (c <= 'f')){
+            value |= c - 'a' + 10;
+        } else if ((c >= 'A') && (c <= 'F')){
+            value |= c - 'A' + 10;
+        } else {
+            return -1;
+        }
+    }
+    return value;
+}
+
+/* Decodes the string starting at the current position (just after the
+   opening quote) into out as UTF-8, and moves past it. out needs room for
+   json_string_size() bytes. Lone surrogates are encoded as with
+   surrogatepass. Returns the decoded length, or -1 if the string isn't
+   valid. */
+static Py_ssize_t json_read_string(json_reader * reader, char * out, bool * ascii, bool * surrogates){
+    const unsigned char * text = (const unsigned char *)reader->text;
+    Py_ssize_t position = reader->position;
+    Py_ssize_t length = 0;
+    *ascii = true;
+    *surrogates = false;
+
+    while (position < reader->length){
+        unsigned char c = text[position];
+        if (c == '"'){
+            reader->position = position + 1;
+            return length;
+        }
+        if (c < 0x20){
+            return -1;
+        }
+        if (c != '\\'){
+            if (c >= 0x80){
+                *ascii = false;
+            }
+            out[length++] = (char)c;
+            position++;
+            continue;
+        }
+
+        if (position + 1 >= reader->length){
+            return -1;
+        }
+        c = text[position + 1];
+        position += 2;
+        switch (c){
+            case '"': case '\\': case '/': out[length++] = (char)c; continue;
+            case 'b': out[length++] = '\b'; continue;
+            case 'f': out[length++] = '\f'; continue;
+            case 'n': out[length++] = '\n'; continue;
+            case 'r': out[length++] = '\r'; continue;
+            case 't': out[length++] = '\t'; continue;
+            case 'u': break;
+            default: return -1;
+        }
+
+        long code = json_read_hex(reader, position);
+        if (code < 0){
+            return -1;
+        }
+        position += 4;
+        // Combine a surrogate pair, as json.loads() does
+        if ((code >= 0xd800) && (code < 0xdc00) && (position + 6 <= reader->length) && (text[position] == '\\') &&
+            (text[position + 1] == 'u')){
+            long low = json_read_hex(reader, position + 2);
+            if ((low >= 0xdc00) && (low < 0xe000)){
+                code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                position += 6;
+            }
+        }
+        if ((code >= 0xd800) && (code < 0xe000)){
+            *surrogates = true;
+        }
+
+        if (code < 0x80){
+            out[length++] = (char)code;
+            continue;
+        }
+        *ascii = false;
+        if (code < 0x800){
+            out[length++] = (char)(0xc0 | (code >> 6));
+        } else if (code < 0x10000){
+            out[length++] = (char)(0xe0 | (code >> 12));
+            out[length++] = (char)(0x80 | ((code >> 6) & 0x3f));
+        } else {
+            out[length++] = (char)(0xf0 | (code >> 18));
+            out[length++] = (char)(0x80 | ((code >> 12) & 0x3f));
+            out[length++] = (char)(0x80 | ((code >> 6) & 0x3f));
+        }
+        out[length++] = (char)(0x80 | (code & 0x3f));
+    }
+    return -1;
+}
+
+/* Reads a string which starts at the current position (just after the
+   opening quote) as a str. */
+static PyObject * json_read_str(json_reader * reader){
+    Py_ssize_t size = json_string_size(reader);
+    if (size < 0){
+        return json_error(reader);
+    }
+    if (size > reader->scratch_size){
+        char * scratch = realloc(reader->scratch, size);
+        if (scratch == NULL){
+            return PyErr_NoMemory();
+        }
+        reader->scratch = scratch;
+        reader->scratch_size = size;
+    }
+    bool ascii, surrogates;
+    Py_ssize_t length = json_read_string(reader, reader->scratch, &ascii, &surrogates);
+    if (length < 0){
+        return json_error(reader);
+    }
+    if (surrogates){
+        return PyUnicode_DecodeUTF8(reader->scratch, length, "surrogatepass");
+    }
+    return make_interned_string(&reader->interned, reader->scratch, length, ascii);
+}
+
+/* Reads a number, or NaN, Infinity or -Infinity, as json.loads() would. */
+static PyObject * json_read_number(json_reader * reader){
+    const char * text = reader->text;
+    Py_ssize_t start = reader->position;
+    Py_ssize_t end = start;
+    bool is_float = false;
+
+    if ((end < reader->length) && (text[end] == '-')){
+        end++;
+    }
+    if ((end + 8 <= reader->length) && (memcmp(&text[end], "Infinity", 8) == 0)){
+        reader->position = end + 8;
+        return PyFloat_FromDouble(end > start ? -Py_HUGE_VAL : Py_HUGE_VAL);
+    }
+    if ((end < reader->length) && (text[end] == '0')){
+        end++;
+    } else if ((end < reader->length) && (text[end] >= '1') && (text[end] <= '9')){
+        while ((end < reader->length) && isdigit((unsigned char)text[end])){
+            end++;
+        }
+    } else {
+        return json_error(reader);
+    }
+    if ((end + 1 < reader->length) && (text[end] == '.') && isdigit((unsigned char)text[end + 1])){
+        is_float = true;
+        end++;
+        while ((end < reader->length) && isdigit((unsigned char)text[end])){
+            end++;
+        }
+    }
+    if ((end < reader->length) && ((text[end] == 'e') || (text[end] == 'E'))){
+        Py_ssize_t exponent = end + 1;
+        if ((exponent < reader->length) && ((text[exponent] == '+') || (text[exponent] == '-'))){
+            exponent++;
+        }
+        if ((exponent < reader->length) && isdigit((unsigned char)text[exponent])){
+            is_float = true;
+            end = exponent;
+            while ((end < reader->length) && isdigit((unsigned char)text[end])){
+                end++;
+            }
+        }
+    }
+
+    char * number = malloc(end - start + 1);
+    if (number == NULL){
+        return PyErr_NoMemory();
+    }
+    memcpy(number, &text[start], end - start);
+    number[end - start] = '\0';
+    PyObject * result;
+    if (is_float){
+        double value = PyOS_string_to_double(number, NULL, NULL);
+        result = (value == -1.0) && PyErr_Occurred() ? NULL : PyFloat_FromDouble(value);
+    } else {
+        result = PyLong_FromString(number, NULL, 10);
+    }
+    free(number);
+    if (result != NULL){
+        reader->position = end;
+    }
+    return result;
+}
+
+/* Tries to read the value at the current position as the values of a loop:
+   an array of arrays of strings, all of the same length. Returns NULL
+   without an exception set, and without moving, if it isn't one, so that
+   it can be read as an ordinary value instead. */
+static PyObject * json_read_loop_values(json_reader * reader){
+    if ((json_peek(reader) != '[') || (reader->length > UINT_MAX)){
+        return NULL;
+    }
+
+    if (reader->stream == NULL){
+        TokenStream * stream = new_token_stream(true);
+        if (stream == NULL){
+            return NULL;
+        }
+        // No string is longer decoded than it was in the JSON
+        stream->data = malloc(reader->length + 1);
+        reader->stream = stream;
+        reader->tokens_allocated = 0;
+        if (stream->data == NULL){
+            PyErr_NoMemory();
+            return NULL;
+        }
+    }
+
+    TokenStream * stream = reader->stream;
+    Py_ssize_t start = reader->position;
+    Py_ssize_t first = stream->num_tokens;
+    long data_length = stream->length;
+    Py_ssize_t width = -1;
+    bool all_ascii = true;
+
+    reader->position++;
+    while (true){
+        if (json_peek(reader) != '['){
+            goto not_values;
+        }
+        reader->position++;
+        Py_ssize_t row_width = 0;
+        while (true){
+            if (json_peek(reader) != '"'){
+                goto not_values;
+            }
+            reader->position++;
+            if (stream->num_tokens == reader->tokens_allocated){
+                Py_ssize_t allocated = reader->tokens_allocated ? reader->tokens_allocated * 2 : 1024;
+                token_span * tokens = realloc(stream->tokens, allocated * sizeof(token_span));
+                if (tokens == NULL){
+                    PyErr_NoMemory();
+                    goto not_values;
+                }
+                stream->tokens = tokens;
+                reader->tokens_allocated = allocated;
+            }
+            bool ascii, surrogates;
+            char * out = &stream->data[stream->length];
+            Py_ssize_t length = json_read_string(reader, out, &ascii, &surrogates);
+            if ((length < 0) || surrogates || (memchr(out, '\0', length) != NULL)){
+                goto not_values;
+            }
+            all_ascii = all_ascii && ascii;
+            token_span * span = &stream->tokens[stream->num_tokens++];
+            span->start = stream->length;
+            span->length = (unsigned int)length;
+            span->line_no = 0;
+            span->delimiter = ' ';
+            span->kind = KIND_VALUE;
+            stream->length += length;
+            row_width++;
+
+            char next = json_peek(reader);
+            reader->position++;
+            if (next == ']'){
+                break;
+            }
+            if (next != ','){
+                goto not_values;
+            }
+        }
+        if (width < 0){
+            width = row_width;
+        } else if (row_width != width){
+            goto not_values;
+        }
+
+        char next = json_peek(reader);
+        reader->position++;
+        if (next == ']'){
+            break;
+        }
+        if (next != ','){
+            goto not_values;
+        }
+    }
+
+    LoopValues * values = PyObject_New(LoopValues, &LoopValuesType);
+    if (values == NULL){
+        return NULL;
+    }
+    Py_INCREF(stream);
+    values->stream = stream;
+    values->first = first;
+    values->count = stream->num_tokens - first;
+    values->width = width;
+    values->values = NULL;
+    stream->ascii = stream->ascii && all_ascii;
+    return (PyObject *)values;
+
+  not_values:
+    stream->num_tokens = first;
+    stream->length = data_length;
+    reader->position = start;
+    return NULL;
+}
+
+static PyObject * json_read_value(json_reader * reader);
+
+static PyObject * json_read_array(json_reader * reader){
+    PyObject * result = PyList_New(0);
+    if (result == NULL){
+        return NULL;
+    }
+    reader->position++;
+    if (json_peek(reader) == ']'){
+        reader->position++;
+        return result;
+    }
+    while (true){
+        PyObject * value = json_read_value(reader);
+        if ((value == NULL) || (PyList_Append(result, value) < 0)){
+            Py_XDECREF(value);
+            Py_DECREF(result);
+            return NULL;
+        }
+        Py_DECREF(value);
+        char next = json_peek(reader);
+        if (next == ']'){
+            reader->position++;
+            return result;
+        }
+        if (next != ','){
+            Py_DECREF(result);
+            return json_error(reader);
+        }
+        reader->position++;
+    }
+}
+
+static PyObject * json_read_dict(json_reader * reader){
+    PyObject * result = PyDict_New();
+    if (result == NULL){
+        return NULL;
+    }
+    reader->position++;
+    if (json_peek(reader) == '}'){
+        reader->position++;
+        return result;
+    }
+    while (true){
+        if (json_peek(reader) != '"'){
+            Py_DECREF(result);
+            return json_error(reader);
+        }
+        reader->position++;
+        PyObject * key = json_read_str(reader);
+        if (key == NULL){
+            Py_DECREF(result);
+            return NULL;
+        }
+        if (json_peek(reader) != ':'){
+            Py_DECREF(key);
+            Py_DECREF(result);
+            return json_error(reader);
+        }
+        reader->position++;
+
+        PyObject * value = NULL;
+        if (PyUnicode_CompareWithASCIIString(key, "data") == 0){
+            value = json_read_loop_values(reader);
+        }
+        if ((value == NULL) && !PyErr_Occurred()){
+            value = json_read_value(reader);
+        }
+        if ((value == NULL) || (PyDict_SetItem(result, key, value) < 0)){
+            Py_XDECREF(value);
+            Py_DECREF(key);
+            Py_DECREF(result);
+            return NULL;
+        }
+        Py_DECREF(value);
+        Py_DECREF(key);
+
+        char next = json_peek(reader);
+        if (next == '}'){
+            reader->position++;
+            return result;
+        }
+        if (next != ','){
+            Py_DECREF(result);
+            return json_error(reader);
+        }
+        reader->position++;
+    }
+}
+
+/* Returns whether the rest of the text starts with the given literal, and if so
+   moves past it. */
+static bool json_read_literal(json_reader * reader, const char * literal){
+    Py_ssize_t length = strlen(literal);
+    if ((reader->position + length > reader->length) || (memcmp(&reader->text[reader->position], literal, length) != 0)){
+        return false;
+    }
+    reader->position += length;
+    return true;
+}
+
+static PyObject * json_read_value(json_reader * reader){
+    PyObject * result = NULL;
+    if (Py_EnterRecursiveCall(" while decoding a JSON document")){
+        return NULL;
+    }
+    switch (json_peek(reader)){
+        case '{':
+            result = json_read_dict(reader);
+            break;
+        case '[':
+            result = json_read_array(reader);
+            break;
+        case '"':
+            reader->position++;
+            result = json_read_str(reader);
+            break;
+        case 'n':
+            if (json_read_literal(reader, "null")){
+                Py_INCREF(Py_None);
+                result = Py_None;
+            } else {
+                json_error(reader);
+            }
+            break;
+        case 't':
+            if (json_read_literal(reader, "true")){
+                Py_INCREF(Py_True);
+                result = Py_True;
+            } else {
+                json_error(reader);
+            }
+            break;
+        case 'f':
+            if (json_read_literal(reader, "false")){
+                Py_INCREF(Py_False);
+                result = Py_False;
+            } else {
+                json_error(reader);
+            }
+            break;
+        case 'N':
+            result = json_read_literal(reader, "NaN") ? PyFloat_FromDouble(Py_NAN) : json_error(reader);
+            break;
+        default:
+            result = json_read_number(reader);
+    }
+    Py_LeaveRecursiveCall();
+    return result;
+}
+
+static PyObject *
+decode_json(PyObject *self, PyObject *args)
+{
+    PyObject * text;
+    if (!PyArg_ParseTuple(args, "U", &text))
+        return NULL;
+
+    json_reader reader;
+    memset(&reader, 0, sizeof(json_reader));
+    reader.text = PyUnicode_AsUTF8AndSize(text, &reader.length);
+    if (reader.text == NULL)
+        return NULL;
+
+    PyObject * result = json_read_value(&reader);
+    if ((result != NULL) && (json_peek(&reader) != '\0' || reader.position < reader.length)){
+        Py_CLEAR(result);
+        json_error(&reader);
+    }
+
+    intern_table_clear(&reader.interned);
+    free(reader.scratch);
+    if (reader.stream != NULL){
+        // Give back what wasn't needed
+        TokenStream * stream = reader.stream;
+        char * data = realloc(stream->data, stream->length + 1);
+        if (data != NULL){
+            stream->data = data;
+        }
+        stream->data[stream->length] = '\0';
+        if (stream->num_tokens > 0){
+            token_span * tokens = realloc(stream->tokens, stream->num_tokens * sizeof(token_span));
+            if (tokens != NULL){
+                stream->tokens = tokens;
+            }
+        }
+        stream->position = stream->num_tokens;
+        Py_DECREF(stream);
+    }
+    return result;
+}
+
+/* Apache Arrow. The values of loops are exported and imported through the
+   Arrow C data interface (https://arrow.apache.org/docs/format/CDataInterface.html)
+   and the PyCapsules of the Arrow PyCapsule interface, so no Arrow library is
+   needed to build or use them. */
+
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+    const char * format;
+    const char * name;
+    const char * metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema ** children;
+    struct ArrowSchema * dictionary;
+    void (*release)(struct ArrowSchema *);
+    void * private_data;
+};
+
+struct ArrowArray {
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void ** buffers;
+    struct ArrowArray ** children;
+    struct ArrowArray * dictionary;
+    void (*release)(struct ArrowArray *);
+    void * private_data;
+};
+
+#endif
+
+#ifndef ARROW_C_STREAM_INTERFACE
+#define ARROW_C_STREAM_INTERFACE
+
+struct ArrowArrayStream {
+    int (*get_schema)(struct ArrowArrayStream *, struct ArrowSchema * out);
+    int (*get_next)(struct ArrowArrayStream *, struct ArrowArray * out);
+    const char * (*get_last_error)(struct ArrowArrayStream *);
+    void (*release)(struct ArrowArrayStream *);
+    void * private_data;
+};
+
+#endif
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#define arrow_reference_add(x) InterlockedIncrement(x)
+#define arrow_reference_remove(x) InterlockedDecrement(x)
+#else
+#define arrow_reference_add(x) __atomic_add_fetch(x, 1, __ATOMIC_ACQ_REL)
+#define arrow_reference_remove(x) __atomic_sub_fetch(x, 1, __ATOMIC_ACQ_REL)
+#endif
+
+// The types loop values are exported as, in the order of arrow_formats
+typedef enum {
+    ARROW_STRING,
+    ARROW_INT64,
+    ARROW_FLOAT64,
+    ARROW_DATE32
+} arrow_kind;
+
+static const char * arrow_formats[] = {"u", "l", "g", "tdD"};
+
+typedef struct {
+    arrow_kind kind;
+    char * name;
+    int64_t null_count;
+    // NULL if there are no nulls
+    uint8_t * validity;
+    // For strings, 32 bit offsets unless the values are too long for them
+    void * offsets;
+    bool large;
+    void * values;
+} arrow_column;
+
+/* The exported values of some loops. Shared by everything exported from
+   it, and freed once the last of them is released, from whatever thread
+   that happens on. */
+typedef struct {
+    volatile long references;
+    int64_t num_rows;
+    Py_ssize_t num_columns;
+    arrow_column * columns;
+    // Encoded schema metadata, or NULL
+    char * metadata;
+    Py_ssize_t metadata_length;
+} arrow_table;
+
+static void arrow_table_release(arrow_table * table){
+    if (arrow_reference_remove(&table->references) != 0){
+        return;
+    }
+    Py_ssize_t x;
+    for (x = 0; x < table->num_columns; x++){
+        free(table->columns[x].name);
+        free(table->columns[x].validity);
+        free(table->columns[x].offsets);
+        free(table->columns[x].values);
+    }
+    free(table->columns);
+    free(table->metadata);
+    free(table);
+}
+
+static const char * arrow_column_format(arrow_column * column){
+    return (column->kind == ARROW_STRING) && column->large ? "U" : arrow_formats[column->kind];
+}
+
+static void arrow_release_child_schema(struct ArrowSchema * schema){
+    free((char *)schema->name);
+    schema->release = NULL;
+}
+
+static void arrow_release_schema(struct ArrowSchema * schema){
+    int64_t x;
+    for (x = 0; x < schema->n_children; x++){
+        struct ArrowSchema * child = schema->children[x];
+        if ((child != NULL) && (child->release != NULL)){
+            child->release(child);
+        }
+        free(child);
+    }
+    free(schema->children);
+    free((char *)schema->metadata);
+    schema->release = NULL;
+}
+
+/* Fills in the schema of a table: a struct with a child for each column.
+   Returns false if out of memory, in which case nothing needs releasing. */
+static bool arrow_export_schema(arrow_table * table, struct ArrowSchema * out){
+    memset(out, 0, sizeof(struct ArrowSchema));
+    out->format = "+s";
+    out->name = "";
+    out->n_children = table->num_columns;
+    out->release = arrow_release_schema;
+    out->children = calloc(table->num_columns ? table->num_columns : 1, sizeof(struct ArrowSchema *));
+    if (table->metadata != NULL){
+        char * metadata = malloc(table->metadata_length);
+        if (metadata != NULL){
+            memcpy(metadata, table->metadata, table->metadata_length);
+        }
+        out->metadata = metadata;
+    }
+    if ((out->children == NULL) || ((table->metadata != NULL) && (out->metadata == NULL))){
+        out->n_children = 0;
+        arrow_release_schema(out);
+        return false;
+    }
+
+    Py_ssize_t x;
+    for (x = 0; x < table->num_columns; x++){
+        struct ArrowSchema * child = calloc(1, sizeof(struct ArrowSchema));
+        char * name = malloc(strlen(table->columns[x].name) + 1);
+        if ((child == NULL) || (name == NULL)){
+            free(child);
+            free(name);
+            arrow_release_schema(out);
+            return false;
+        }
+        strcpy(name, table->columns[x].name);
+        child->format = arrow_column_format(&table->columns[x]);
+        child->name = name;
+        child->flags = ARROW_FLAG_NULLABLE;
+        child->release = arrow_release_child_schema;
+        out->children[x] = child;
+    }
+    return true;
+}
+
+static void arrow_release_child_array(struct ArrowArray * array){
+    free(array->buffers);
+    arrow_table_release((arrow_table *)array->private_data);
+    array->release = NULL;
+}
+
+static void arrow_release_array(struct ArrowArray * array){
+    int64_t x;
+    for (x = 0; x < array->n_children; x++){
+        struct ArrowArray * child = array->children[x];
+        if ((child != NULL) && (child->release != NULL)){
+            child->release(child);
+        }
+        free(child);
+    }
+    free(array->children);
+    free(array->buffers);
+    arrow_table_release((arrow_table *)array->private_data);
+    array->release = NULL;
+}
+
+/* Fills in the values of a table as a struct array, sharing its buffers.
+   Returns false if out of memory, in which case nothing needs releasing. */
+static bool arrow_export_array(arrow_table * table, struct ArrowArray * out){
+    memset(out, 0, sizeof(struct ArrowArray));
+    out->length = table->num_rows;
+    out->n_buffers = 1;
+    out->n_children = table->num_columns;
+    out->buffers = calloc(1, sizeof(void *));
+    out->children = calloc(table->num_columns ? table->num_columns : 1, sizeof(struct ArrowArray *));
+    out->private_data = table;
+    out->release = arrow_release_array;
+    arrow_reference_add(&table->references);
+    if ((out->buffers == NULL) || (out->children == NULL)){
+        out->n_children = 0;
+        arrow_release_array(out);
+        return false;
+    }
+
+    Py_ssize_t x;
+    for (x = 0; x < table->num_columns; x++){
+        arrow_column * column = &table->columns[x];
+        struct ArrowArray * child = calloc(1, sizeof(struct ArrowArray));
+        int64_t num_buffers = column->kind == ARROW_STRING ? 3 : 2;
+        const void ** buffers = child != NULL ? calloc(num_buffers, sizeof(void *)) : NULL;
+        if (buffers == NULL){
+            free(child);
+            arrow_release_array(out);
+            return false;
+        }
+        buffers[0] = column->validity;
+        if (column->kind == ARROW_STRING){
+            buffers[1] = column->offsets;
+            buffers[2] = column->values;
+        } else {
+            buffers[1] = column->values;
+        }
+        child->length = table->num_rows;
+        child->null_count = column->null_count;
+        child->n_buffers = num_buffers;
+        child->buffers = buffers;
+        child->private_data = table;
+        child->release = arrow_release_child_array;
+        arrow_reference_add(&table->references);
+        out->children[x] = child;
+    }
+    return true;
+}
+
+typedef struct {
+    arrow_table * table;
+    bool done;
+} arrow_stream_data;
+
+static int arrow_stream_get_schema(struct ArrowArrayStream * stream, struct ArrowSchema * out){
+    return arrow_export_schema(((arrow_stream_data *)stream->private_data)->table, out) ? 0 : ENOMEM;
+}
+
+/* The stream has one batch, with all of the rows. */
+static int arrow_stream_get_next(struct ArrowArrayStream * stream, struct ArrowArray * out){
+    arrow_stream_data * data = (arrow_stream_data *)stream->private_data;
+    if (data->done){
+        memset(out, 0, sizeof(struct ArrowArray));
+        return 0;
+    }
+    if (!arrow_export_array(data->table, out)){
+        return ENOMEM;
+    }
+    data->done = true;
+    return 0;
+}
+
+static const char * arrow_stream_get_last_error(struct ArrowArrayStream * stream){
+    return "Out of memory.";
+}
+
+static void arrow_stream_release(struct ArrowArrayStream * stream){
+    arrow_stream_data * data = (arrow_stream_data *)stream->private_data;
+    arrow_table_release(data->table);
+    free(data);
+    stream->release = NULL;
+}
+
+static void arrow_schema_capsule_destructor(PyObject * capsule){
+    struct ArrowSchema * schema = PyCapsule_GetPointer(capsule, "arrow_schema");
+    if (schema != NULL){
+        if (schema->release != NULL){
+            schema->release(schema);
+        }
+        free(schema);
+    }
+}
+
+static void arrow_array_capsule_destructor(PyObject * capsule){
+    struct ArrowArray * array = PyCapsule_GetPointer(capsule, "arrow_array");
+    if (array != NULL){
+        if (array->release != NULL){
+            array->release(array);
+        }
+        free(array);
+    }
+}
+
+static void arrow_stream_capsule_destructor(PyObject * capsule){
+    struct ArrowArrayStream * stream = PyCapsule_GetPointer(capsule, "arrow_array_stream");
+    if (stream != NULL){
+        if (stream->release != NULL){
+            stream->release(stream);
+        }
+        free(stream);
+    }
+}
+
+typedef struct {
+    PyObject_HEAD
+    arrow_table * table;
+} ArrowTable;
+
+static void
+ArrowTable_dealloc(ArrowTable *self)
+{
+    if (self->table != NULL){
+        arrow_table_release(self->table);
+    }
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyObject *
+ArrowTable_schema_capsule(ArrowTable *self)
+{
+    struct ArrowSchema * schema = malloc(sizeof(struct ArrowSchema));
+    if ((schema == NULL) || !arrow_export_schema(self->table, schema)){
+        free(schema);
+        return PyErr_NoMemory();
+    }
+    PyObject * capsule = PyCapsule_New(schema, "arrow_schema", arrow_schema_capsule_destructor);
+    if (capsule == NULL){
+        schema->release(schema);
+        free(schema);
+    }
+    return capsule;
+}
+
+static PyObject *
+ArrowTable_arrow_c_schema(ArrowTable *self, PyObject *Py_UNUSED(ignored))
+{
+    return ArrowTable_schema_capsule(self);
+}
+
+static PyObject *
+ArrowTable_arrow_c_array(ArrowTable *self, PyObject *args, PyObject *kwargs)
+{
+    // The requested schema can be ignored, and is
+    static char *kwlist[] = {"requested_schema", NULL};
+    PyObject * requested_schema = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", kwlist, &requested_schema))
+        return NULL;
+
+    PyObject * schema = ArrowTable_schema_capsule(self);
+    if (schema == NULL)
+        return NULL;
+    struct ArrowArray * array = malloc(sizeof(struct ArrowArray));
+    if ((array == NULL) || !arrow_export_array(self->table, array)){
+        free(array);
+        Py_DECREF(schema);
+        return PyErr_NoMemory();
+    }
+    PyObject * capsule = PyCapsule_New(array, "arrow_array", arrow_array_capsule_destructor);
+    if (capsule == NULL){
+        array->release(array);
+        free(array);
+        Py_DECREF(schema);
+        return NULL;
+    }
+    return Py_BuildValue("NN", schema, capsule);
+}
+
+static PyObject *
+ArrowTable_arrow_c_stream(ArrowTable *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"requested_schema", NULL};
+    PyObject * requested_schema = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", kwlist, &requested_schema))
+        return NULL;
+
+    struct ArrowArrayStream * stream = calloc(1, sizeof(struct ArrowArrayStream));
+    arrow_stream_data * data = calloc(1, sizeof(arrow_stream_data));
+    if ((stream == NULL) || (data == NULL)){
+        free(stream);
+        free(data);
+        return PyErr_NoMemory();
+    }
+    arrow_reference_add(&self->table->references);
+    data->table = self->table;
+    stream->get_schema = arrow_stream_get_schema;
+    stream->get_next = arrow_stream_get_next;
+    stream->get_last_error = arrow_stream_get_last_error;
+    stream->release = arrow_stream_release;
+    stream->private_data = data;
+
+    PyObject * capsule = PyCapsule_New(stream, "arrow_array_stream", arrow_stream_capsule_destructor);
+    if (capsule == NULL){
+        stream->release(stream);
+        free(stream);
+    }
+    return capsule;
+}
+
+static PyObject *
+ArrowTable_get_num_rows(ArrowTable *self, void *closure)
+{
+    return PyLong_FromLongLong(self->table->num_rows);
+}
+
+static PyObject *
+ArrowTable_get_column_names(ArrowTable *self, void *closure)
+{
+    PyObject * names = PyList_New(self->table->num_columns);
+    Py_ssize_t x;
+    for (x = 0; (names != NULL) && (x < self->table->num_columns); x++){
+        PyObject * name = PyUnicode_FromString(self->table->columns[x].name);
+        if (name == NULL){
+            Py_CLEAR(names);
+            break;
+        }
+        PyList_SET_ITEM(names, x, name);
+    }
+    return names;
+}
+
+static PyObject *
+ArrowTable_get_column_formats(ArrowTable *self, void *closure)
+{
+    PyObject * formats = PyList_New(self->table->num_columns);
+    Py_ssize_t x;
+    for (x = 0; (formats != NULL) && (x < self->table->num_columns); x++){
+        PyObject * format = PyUnicode_FromString(arrow_column_format(&self->table->columns[x]));
+        if (format == NULL){
+            Py_CLEAR(formats);
+            break;
+        }
+        PyList_SET_ITEM(formats, x, format);
+    }
+    return formats;
+}
+
+static PyMethodDef ArrowTable_methods[] = {
+    {"__arrow_c_schema__", (PyCFunction)ArrowTable_arrow_c_schema, METH_NOARGS,
+     "Returns the schema as an arrow_schema PyCapsule."},
+    {"__arrow_c_array__", (PyCFunction)(void(*)(void))ArrowTable_arrow_c_array, METH_VARARGS | METH_KEYWORDS,
+     "Returns the schema and the values as arrow_schema and arrow_array PyCapsules."},
+    {"__arrow_c_stream__", (PyCFunction)(void(*)(void))ArrowTable_arrow_c_stream, METH_VARARGS | METH_KEYWORDS,
+     "Returns the values as an arrow_array_stream PyCapsule."},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef ArrowTable_getset[] = {
+    {"num_rows", (getter)ArrowTable_get_num_rows, NULL, "The number of rows.", NULL},
+    {"column_names", (getter)ArrowTable_get_column_names, NULL, "The names of the columns.", NULL},
+    {"column_formats", (getter)ArrowTable_get_column_formats, NULL,
+     "The Arrow format string of the type of each column.", NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+static PyTypeObject ArrowTableType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "cnmrstar.ArrowTable",
+    .tp_doc = "Loop values exported through the Arrow C data interface. Create with arrow_export().",
+    .tp_basicsize = sizeof(ArrowTable),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_dealloc = (destructor)ArrowTable_dealloc,
+    .tp_methods = ArrowTable_methods,
+    .tp_getset = ArrowTable_getset,
+};
+
+/* One column of a loop stored as columns: either a sequence of values, or
+   the distinct values and codes of a categorical column. */
+typedef struct {
+    PyObject * values;
+    PyObject * distinct;
+    Py_buffer codes;
+} loop_source_column;
+
+/* The values of a loop, as they are stored. For arrow_export(), positions
+   has the column of the loop for each exported column, or -1 if the loop
+   doesn't have it. */
+typedef struct {
+    LoopValues * lazy;
+    // The rows of a loop stored as rows
+    PyObject * rows;
+    // The columns of a loop stored as columns
+    loop_source_column * columns;
+    Py_ssize_t num_columns;
+    Py_ssize_t * positions;
+    int64_t num_rows;
+} loop_source;
+
+/* Sets up a source for the values of a loop as they are stored: LoopValues,
+   an object of columns_type (with the columns in its _columns attribute),
+   or a list of rows. Returns the width of the rows (PY_SSIZE_T_MAX for a
+   list of rows, which can have any width), or -1 with an exception set. */
+static Py_ssize_t load_loop_source(loop_source * source, PyObject * data, PyObject * columns_type){
+    Py_ssize_t width, y;
+    if (Py_TYPE(data) == &LoopValuesType){
+        source->lazy = (LoopValues *)data;
+        Py_INCREF(data);
+        source->num_rows = source->lazy->count / source->lazy->width;
+        return source->lazy->width;
+    }
+
+    if ((PyObject *)Py_TYPE(data) == columns_type){
+        PyObject * columns = PyObject_GetAttrString(data, "_columns");
+        PyObject * columns_fast = columns != NULL ? PySequence_Fast(columns, "The columns must be a sequence.") : NULL;
+        Py_XDECREF(columns);
+        if (columns_fast == NULL){
+            return -1;
+        }
+        width = source->num_columns = PySequence_Fast_GET_SIZE(columns_fast);
+        source->columns = calloc(width ? width : 1, sizeof(loop_source_column));
+        if (source->columns == NULL){
+            Py_DECREF(columns_fast);
+            PyErr_NoMemory();
+            return -1;
+        }
+        for (y = 0; y < width; y++){
+            PyObject * column = PySequence_Fast_GET_ITEM(columns_fast, y);
+            loop_source_column * loaded = &source->columns[y];
+            Py_ssize_t length;
+            loaded->distinct = load_categorical(column, &loaded->codes);
+            if (loaded->distinct != NULL){
+                length = loaded->codes.len / loaded->codes.itemsize;
+            } else {
+                loaded->values = PySequence_Fast(column, "Each column must be a sequence.");
+                if (loaded->values == NULL){
+                    Py_DECREF(columns_fast);
+                    return -1;
+                }
+                length = PySequence_Fast_GET_SIZE(loaded->values);
+            }
+            // Like zip(), stop at the end of the shortest column
+            if ((y == 0) || (length < source->num_rows)){
+                source->num_rows = length;
+            }
+        }
+        Py_DECREF(columns_fast);
+        return width;
+    }
+
+    source->rows = PySequence_Fast(data, "The rows must be a sequence.");
+    if (source->rows == NULL){
+        return -1;
+    }
+    source->num_rows = PySequence_Fast_GET_SIZE(source->rows);
+    for (y = 0; y < source->num_rows; y++){
+        PyObject * row = PySequence_Fast_GET_ITEM(source->rows, y);
+        if (!PyList_Check(row) && !PyTuple_Check(row)){
+            PyErr_SetString(PyExc_ValueError, "Each row must be a list or tuple.");
+            return -1;
+        }
+    }
+    return PY_SSIZE_T_MAX;
+}
+
+static void clear_loop_source(loop_source * source){
+    Py_XDECREF(source->lazy);
+    Py_XDECREF(source->rows);
+    if (source->columns != NULL){
+        Py_ssize_t y;
+        for (y = 0; y < source->num_columns; y++){
+            Py_XDECREF(source->columns[y].values);
+            Py_XDECREF(source->columns[y].distinct);
+            if (source->columns[y].codes.obj != NULL){
+                PyBuffer_Release(&source->columns[y].codes);
+            }
+        }
+        free(source->columns);
+    }
+    free(source->positions);
+}
+
+/* Gets the value of one cell, either as text or, for values which aren't
+   str, as an object. Strings are returned as text. Values are borrowed. */
+static bool loop_source_cell(loop_source * source, int64_t row, Py_ssize_t position, const char ** text,
+                       Py_ssize_t * length, PyObject ** obj){
+    *obj = NULL;
+    *text = NULL;
+    if (position < 0){
+        *obj = Py_None;
+        return true;
+    }
+    if (source->lazy != NULL){
+        token_span * span = &source->lazy->stream->tokens[source->lazy->first + row * source->lazy->width + position];
+        *text = &source->lazy->stream->data[span->start];
+        *length = span->length;
+        return true;
+    }
+
+    PyObject * value;
+    if (source->columns != NULL){
+        loop_source_column * column = &source->columns[position];
+        if (column->values != NULL){
+            value = PySequence_Fast_GET_ITEM(column->values, row);
+        } else {
+            Py_ssize_t code = categorical_code(&column->codes, row);
+            if ((code < 0) || (code >= PyTuple_GET_SIZE(column->distinct))){
+                PyErr_SetString(PyExc_ValueError, "A categorical column has a code with no value.");
+                return false;
+            }
+            value = PyTuple_GET_ITEM(column->distinct, code);
+        }
+    } else {
+        PyObject * values = PySequence_Fast_GET_ITEM(source->rows, row);
+        if (position >= PySequence_Fast_GET_SIZE(values)){
+            *obj = Py_None;
+            return true;
+        }
+        value = PySequence_Fast_GET_ITEM(values, position);
+    }
+
+    if (PyUnicode_Check(value)){
+        *text = PyUnicode_AsUTF8AndSize(value, length);
+        return *text != NULL;
+    }
+    *obj = value;
+    return true;
+}
+
+static bool is_null_text(const char * text, Py_ssize_t length){
+    return (length == 0) || ((length == 1) && ((text[0] == '.') || (text[0] == '?')));
+}
+
+/* The number of days from 1970-01-01 to a date, or false if it isn't a
+   valid date between the years 1 and 9999. */
+static bool arrow_days(long year, long month, long day, int32_t * days){
+    static const int month_days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    if ((year < 1) || (year > 9999) || (month < 1) || (month > 12) || (day < 1)){
+        return false;
+    }
+    bool leap = ((year % 4 == 0) && (year % 100 != 0)) || (year % 400 == 0);
+    if (day > month_days[month - 1] + ((month == 2) && leap ? 1 : 0)){
+        return false;
+    }
+    // From Howard Hinnant's days_from_civil()
+    year -= month <= 2;
+    long era = year / 400;
+    long year_of_era = year - era * 400;
+    long day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    long day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    *days = (int32_t)(era * 146097 + day_of_era - 719468);
+    return true;
+}
+
+/* Parses text as a value of the kind of a column. Returns false if it
+   isn't one. */
+static bool arrow_parse(arrow_kind kind, const char * text, Py_ssize_t length, void * out){
+    char number[64];
+    if ((length == 0) || (length >= (Py_ssize_t)sizeof(number))){
+        return false;
+    }
+    memcpy(number, text, length);
+    number[length] = '\0';
+    char * end;
+
+    if (kind == ARROW_INT64){
+        Py_ssize_t x = (number[0] == '-') || (number[0] == '+') ? 1 : 0;
+        if (x == length){
+            return false;
+        }
+        for (; x < length; x++){
+            if (!isdigit((unsigned char)number[x])){
+                return false;
+            }
+        }
+        errno = 0;
+        long long value = strtoll(number, &end, 10);
+        if (errno != 0){
+            return false;
+        }
+        *(int64_t *)out = value;
+        return true;
+    }
+    if (kind == ARROW_FLOAT64){
+        if (isspace((unsigned char)number[0])){
+            return false;
+        }
+        double value = PyOS_string_to_double(number, &end, NULL);
+        if ((value == -1.0) && PyErr_Occurred()){
+            PyErr_Clear();
+            return false;
+        }
+        if (*end != '\0'){
+            return false;
+        }
+        *(double *)out = value;
+        return true;
+    }
+
+    // A date, in the form the dictionary uses
+    long year, month, day;
+    int consumed = 0;
+    if ((sscanf(number, "%4ld-%2ld-%2ld%n", &year, &month, &day, &consumed) != 3) || (consumed != length) ||
+        !isdigit((unsigned char)number[0])){
+        return false;
+    }
+    return arrow_days(year, month, day, (int32_t *)out);
+}
+
+/* Parses a value which isn't a str, such as the int or Decimal that
+   convert_data_types gives, as a value of the kind of a column. */
+static bool arrow_parse_object(arrow_kind kind, PyObject * obj, void * out){
+    if ((kind == ARROW_INT64) && PyLong_Check(obj) && !PyBool_Check(obj)){
+        int overflow;
+        long long value = PyLong_AsLongLongAndOverflow(obj, &overflow);
+        if (overflow || ((value == -1) && PyErr_Occurred())){
+            PyErr_Clear();
+            return false;
+        }
+        *(int64_t *)out = value;
+        return true;
+    }
+    if ((kind == ARROW_FLOAT64) && PyFloat_Check(obj)){
+        *(double *)out = PyFloat_AS_DOUBLE(obj);
+        return true;
+    }
+    if (PyBool_Check(obj)){
+        return false;
+    }
+    PyObject * str = PyObject_Str(obj);
+    if (str == NULL){
+        PyErr_Clear();
+        return false;
+    }
+    Py_ssize_t length;
+    const char * text = PyUnicode_AsUTF8AndSize(str, &length);
+    bool result = (text != NULL) && arrow_parse(kind, text, length, out);
+    PyErr_Clear();
+    Py_DECREF(str);
+    return result;
+}
+
+/* Builds one column from the sources. If a value can't be parsed as the
+   kind of the column, sets *mismatch rather than raising an error. */
+static bool arrow_build_column(loop_source * sources, Py_ssize_t num_sources, Py_ssize_t index, int64_t num_rows,
+                               arrow_column * column, bool * mismatch){
+    *mismatch = false;
+    size_t item_size = column->kind == ARROW_INT64 || column->kind == ARROW_FLOAT64 ? 8 : 4;
+    column->validity = calloc((num_rows + 7) / 8 + 1, 1);
+    json_buffer strings = {NULL, 0, 0};
+    int64_t * offsets = NULL;
+    if (column->kind == ARROW_STRING){
+        offsets = malloc((num_rows + 1) * sizeof(int64_t));
+        column->offsets = offsets;
+        if (offsets != NULL){
+            offsets[0] = 0;
+        }
+    } else {
+        column->values = malloc(num_rows ? num_rows * item_size : 1);
+    }
+    if ((column->validity == NULL) || ((column->kind == ARROW_STRING) ? offsets == NULL : column->values == NULL)){
+        PyErr_NoMemory();
+        return false;
+    }
+
+    int64_t row = 0;
+    Py_ssize_t x;
+    for (x = 0; x < num_sources; x++){
+        loop_source * source = &sources[x];
+        int64_t source_row;
+        for (source_row = 0; source_row < source->num_rows; source_row++, row++){
+            const char * text;
+            Py_ssize_t length = 0;
+            PyObject * obj;
+            if (!loop_source_cell(source, source_row, source->positions[index], &text, &length, &obj)){
+                free(strings.data);
+                return false;
+            }
+            bool is_null = (obj == Py_None) || ((text != NULL) && is_null_text(text, length));
+
+            if (column->kind == ARROW_STRING){
+                PyObject * str = NULL;
+                if (!is_null && (obj != NULL)){
+                    str = PyObject_Str(obj);
+                    text = str != NULL ? PyUnicode_AsUTF8AndSize(str, &length) : NULL;
+                    if (text == NULL){
+                        Py_XDECREF(str);
+                        free(strings.data);
+                        return false;
+                    }
+                }
+                bool written = is_null || json_write(&strings, text, length);
+                Py_XDECREF(str);
+                if (!written){
+                    free(strings.data);
+                    return false;
+                }
+                offsets[row + 1] = strings.length;
+            } else if (!is_null){
+                char * out = (char *)column->values + row * item_size;
+                if (!((obj != NULL) ? arrow_parse_object(column->kind, obj, out) :
+                                      arrow_parse(column->kind, text, length, out))){
+                    *mismatch = true;
+                    return true;
+                }
+            } else {
+                memset((char *)column->values + row * item_size, 0, item_size);
+            }
+
+            if (is_null){
+                column->null_count++;
+            } else {
+                column->validity[row / 8] |= (uint8_t)(1 << (row % 8));
+            }
+        }
+    }
+
+    if (column->null_count == 0){
+        free(column->validity);
+        column->validity = NULL;
+    }
+    if (column->kind == ARROW_STRING){
+        if (strings.data == NULL){
+            strings.data = malloc(1);
+            if (strings.data == NULL){
+                PyErr_NoMemory();
+                return false;
+            }
+        }
+        column->values = strings.data;
+        column->large = strings.length > INT32_MAX;
+        if (!column->large){
+            // Arrow's usual string type has 32 bit offsets, which fit in the same buffer
+            int32_t * small = (int32_t *)offsets;
+            int64_t y;
+            for (y = 0; y <= num_rows; y++){
+                small[y] = (int32_t)offsets[y];
+            }
+        }
+    }
+    return true;
+}
+
+/* Encodes the schema metadata of a table, which has a single key. */
+static bool arrow_encode_metadata(arrow_table * table, PyObject * key, PyObject * value){
+    Py_ssize_t key_length, value_length;
+    const char * key_text = PyUnicode_AsUTF8AndSize(key, &key_length);
+    const char * value_text = key_text != NULL ? PyUnicode_AsUTF8AndSize(value, &value_length) : NULL;
+    if (value_text == NULL){
+        return false;
+    }
+    table->metadata_length = 12 + key_length + value_length;
+    table->metadata = malloc(table->metadata_length);
+    if (table->metadata == NULL){
+        PyErr_NoMemory();
+        return false;
+    }
+    int32_t lengths[3] = {1, (int32_t)key_length, (int32_t)value_length};
+    memcpy(table->metadata, &lengths[0], 4);
+    memcpy(table->metadata + 4, &lengths[1], 4);
+    memcpy(table->metadata + 8, key_text, key_length);
+    memcpy(table->metadata + 8 + key_length, &lengths[2], 4);
+    memcpy(table->metadata + 12 + key_length, value_text, value_length);
+    return true;
+}
+
+static PyObject *
+arrow_export(PyObject *self, PyObject *args)
+{
+    PyObject * sources_arg, * names, * kinds, * columns_type, * metadata_key = Py_None, * metadata_value = Py_None;
+    if (!PyArg_ParseTuple(args, "OOOO|OO", &sources_arg, &names, &kinds, &columns_type, &metadata_key,
+                          &metadata_value))
+        return NULL;
+
+    PyObject * sources_fast = PySequence_Fast(sources_arg, "The sources must be a sequence.");
+    PyObject * names_fast = sources_fast != NULL ? PySequence_Fast(names, "The names must be a sequence.") : NULL;
+    PyObject * kinds_fast = names_fast != NULL ? PySequence_Fast(kinds, "The kinds must be a sequence.") : NULL;
+    if (kinds_fast == NULL){
+        Py_XDECREF(sources_fast);
+        Py_XDECREF(names_fast);
+        return NULL;
+    }
+
+    Py_ssize_t num_sources = PySequence_Fast_GET_SIZE(sources_fast);
+    Py_ssize_t num_columns = PySequence_Fast_GET_SIZE(names_fast);
+    loop_source * sources = calloc(num_sources ? num_sources : 1, sizeof(loop_source));
+    arrow_table * table = calloc(1, sizeof(arrow_table));
+    ArrowTable * result = NULL;
+    Py_ssize_t x, y;
+    if ((sources == NULL) || (table == NULL)){
+        PyErr_NoMemory();
+        goto done;
+    }
+    table->references = 1;
+    table->num_columns = num_columns;
+    table->columns = calloc(num_columns ? num_columns : 1, sizeof(arrow_column));
+    if (table->columns == NULL){
+        table->num_columns = 0;
+        PyErr_NoMemory();
+        goto done;
+    }
+    if (PySequence_Fast_GET_SIZE(kinds_fast) != num_columns){
+        PyErr_SetString(PyExc_ValueError, "There must be a kind for each name.");
+        goto done;
+    }
+    for (x = 0; x < num_columns; x++){
+        const char * name = PyUnicode_Check(PySequence_Fast_GET_ITEM(names_fast, x)) ?
+                            PyUnicode_AsUTF8(PySequence_Fast_GET_ITEM(names_fast, x)) : NULL;
+        long kind = PyLong_AsLong(PySequence_Fast_GET_ITEM(kinds_fast, x));
+        if ((name == NULL) || (kind < ARROW_STRING) || (kind > ARROW_DATE32)){
+            if (!PyErr_Occurred()){
+                PyErr_SetString(PyExc_ValueError, "Each name must be a str and each kind a valid kind.");
+            }
+            goto done;
+        }
+        table->columns[x].name = malloc(strlen(name) + 1);
+        if (table->columns[x].name == NULL){
+            PyErr_NoMemory();
+            goto done;
+        }
+        strcpy(table->columns[x].name, name);
+        table->columns[x].kind = (arrow_kind)kind;
+    }
+    if ((metadata_key != Py_None) && !arrow_encode_metadata(table, metadata_key, metadata_value)){
+        goto done;
+    }
+
+    // Each source is (data, positions), where data is LoopValues, an object of columns_type, or rows
+    for (x = 0; x < num_sources; x++){
+        loop_source * source = &sources[x];
+        PyObject * item = PySequence_Fast_GET_ITEM(sources_fast, x);
+        PyObject * data, * positions;
+        if (!PyTuple_Check(item) || !PyArg_ParseTuple(item, "OO", &data, &positions)){
+            if (!PyErr_Occurred()){
+                PyErr_SetString(PyExc_ValueError, "Each source must be a tuple of data and positions.");
+            }
+            goto done;
+        }
+        PyObject * positions_fast = PySequence_Fast(positions, "The positions must be a sequence.");
+        if (positions_fast == NULL){
+            goto done;
+        }
+        source->positions = malloc((num_columns ? num_columns : 1) * sizeof(Py_ssize_t));
+        bool valid = (source->positions != NULL) && (PySequence_Fast_GET_SIZE(positions_fast) == num_columns);
+        for (y = 0; valid && (y < num_columns); y++){
+            source->positions[y] = PyLong_AsSsize_t(PySequence_Fast_GET_ITEM(positions_fast, y));
+            valid = !PyErr_Occurred();
+        }
+        Py_DECREF(positions_fast);
+        if (!valid){
+            if (!PyErr_Occurred()){
+                PyErr_SetString(PyExc_ValueError, "There must be a position for each name.");
+            }
+            goto done;
+        }
+
+        Py_ssize_t width = load_loop_source(source, data, columns_type);
+        if (width < 0){
+            goto done;
+        }
+        for (y = 0; y < num_columns; y++){
+            if (source->positions[y] >= width){
+                PyErr_SetString(PyExc_ValueError, "A position is past the end of the rows.");
+                goto done;
+            }
+        }
+        table->num_rows += source->num_rows;
+    }
+
+    // Values which don't fit the kind of their column make it a column of strings instead
+    for (x = 0; x < num_columns; x++){
+        bool mismatch;
+        if (!arrow_build_column(sources, num_sources, x, table->num_rows, &table->columns[x], &mismatch)){
+            goto done;
+        }
+        if (mismatch){
+            arrow_column * column = &table->columns[x];
+            free(column->validity);
+            free(column->offsets);
+            free(column->values);
+            column->validity = column->offsets = column->values = NULL;
+            column->null_count = 0;
+            column->kind = ARROW_STRING;
+            if (!arrow_build_column(sources, num_sources, x, table->num_rows, column, &mismatch)){
+                goto done;
+            }
+        }
+    }
+
+    result = PyObject_New(ArrowTable, &ArrowTableType);
+    if (result != NULL){
+        result->table = table;
+        table = NULL;
+    }
+
+  done:
+    if (sources != NULL){
+        for (x = 0; x < num_sources; x++){
+            clear_loop_source(&sources[x]);
+        }
+        free(sources);
+    }
+    if (table != NULL){
+        arrow_table_release(table);
+    }
+    Py_DECREF(sources_fast);
+    Py_DECREF(names_fast);
+    Py_DECREF(kinds_fast);
+    return (PyObject *)result;
+}
+
+/* Imports the values of Arrow arrays as LoopValues, by writing the text of
+   each value into the data of a new TokenStream. */
+typedef struct {
+    TokenStream * stream;
+    json_buffer data;
+    Py_ssize_t tokens_allocated;
+    bool ascii;
+    char * error;
+} arrow_importer;
+
+static bool arrow_bit(const void * buffer, int64_t index){
+    return (((const uint8_t *)buffer)[index / 8] >> (index % 8)) & 1;
+}
+
+/* The date of a number of days since 1970-01-01, from Howard Hinnant's
+   civil_from_days(). */
+static void arrow_date(int64_t days, char * out, size_t size){
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    int64_t day_of_era = days - era * 146097;
+    int64_t year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    int64_t day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    int64_t month_part = (5 * day_of_year + 2) / 153;
+    int64_t day = day_of_year - (153 * month_part + 2) / 5 + 1;
+    int64_t month = month_part < 10 ? month_part + 3 : month_part - 9;
+    int64_t year = year_of_era + era * 400 + (month <= 2);
+    snprintf(out, size, "%04lld-%02lld-%02lld", (long long)year, (long long)month, (long long)day);
+}
+
+/* Writes a float32 with the fewest digits that read back as the same
+   float32, as str() would if Python had such a type. */
+static bool arrow_write_float(json_buffer * buffer, float value){
+    if (Py_IS_NAN(value) || Py_IS_INFINITY(value)){
+        const char * text = Py_IS_NAN(value) ? "nan" : (value > 0 ? "inf" : "-inf");
+        return json_write(buffer, text, strlen(text));
+    }
+    // Find the fewest significant digits that do, then write that number as repr() would
+    double shortest = value;
+    int precision;
+    for (precision = 1; precision <= 9; precision++){
+        char * digits = PyOS_double_to_string(value, 'e', precision - 1, 0, NULL);
+        if (digits == NULL){
+            return false;
+        }
+        double parsed = PyOS_string_to_double(digits, NULL, NULL);
+        PyMem_Free(digits);
+        if ((float)parsed == value){
+            shortest = parsed;
+            break;
+        }
+    }
+    char * text = PyOS_double_to_string(shortest, 'r', 0, Py_DTSF_ADD_DOT_0, NULL);
+    if (text == NULL){
+        return false;
+    }
+    bool result = json_write(buffer, text, strlen(text));
+    PyMem_Free(text);
+    return result;
+}
+
+/* Writes the text of the value at index of an array (not counting the
+   array's offset) with the given schema. Nulls are written as '.'. */
+static bool arrow_write_value(arrow_importer * importer, struct ArrowSchema * schema, struct ArrowArray * array,
+                              int64_t index){
+    json_buffer * buffer = &importer->data;
+    const char * format = schema->format;
+    int64_t position = array->offset + index;
+    char number[64];
+
+    if ((strcmp(format, "n") == 0) ||
+        ((array->null_count != 0) && (array->n_buffers > 0) && (array->buffers[0] != NULL) &&
+         !arrow_bit(array->buffers[0], position))){
+        return json_write(buffer, ".", 1);
+    }
+
+    if (schema->dictionary != NULL){
+        int64_t key;
+        switch (format[0]){
+            case 'c': key = ((const int8_t *)array->buffers[1])[position]; break;
+            case 'C': key = ((const uint8_t *)array->buffers[1])[position]; break;
+            case 's': key = ((const int16_t *)array->buffers[1])[position]; break;
+            case 'S': key = ((const uint16_t *)array->buffers[1])[position]; break;
+            case 'i': key = ((const int32_t *)array->buffers[1])[position]; break;
+            case 'I': key = ((const uint32_t *)array->buffers[1])[position]; break;
+            case 'l': key = ((const int64_t *)array->buffers[1])[position]; break;
+            case 'L': key = (int64_t)((const uint64_t *)array->buffers[1])[position]; break;
+            default: goto unsupported;
+        }
+        if ((array->dictionary == NULL) || (key < 0) || (key >= array->dictionary->length)){
+            importer->error = "A dictionary encoded value has an index with no value.";
+            return false;
+        }
+        return arrow_write_value(importer, schema->dictionary, array->dictionary, key);
+    }
+
+    if (format[1] == '\0'){
+        switch (format[0]){
+            case 'b':
+                return arrow_bit(array->buffers[1], position) ? json_write(buffer, "yes", 3) :
+                                                                json_write(buffer, "no", 2);
+            case 'c':
+                snprintf(number, sizeof(number), "%d", (int)((const int8_t *)array->buffers[1])[position]);
+                break;
+            case 'C':
+                snprintf(number, sizeof(number), "%u", (unsigned)((const uint8_t *)array->buffers[1])[position]);
+                break;
+            case 's':
+                snprintf(number, sizeof(number), "%d", (int)((const int16_t *)array->buffers[1])[position]);
+                break;
+            case 'S':
+                snprintf(number, sizeof(number), "%u", (unsigned)((const uint16_t *)array->buffers[1])[position]);
+                break;
+            case 'i':
+                snprintf(number, sizeof(number), "%ld", (long)((const int32_t *)array->buffers[1])[position]);
+                break;
+            case 'I':
+                snprintf(number, sizeof(number), "%lu", (unsigned long)((const uint32_t *)array->buffers[1])[position]);
+                break;
+            case 'l':
+                snprintf(number, sizeof(number), "%lld", (long long)((const int64_t *)array->buffers[1])[position]);
+                break;
+            case 'L':
+                snprintf(number, sizeof(number), "%llu",
+                         (unsigned long long)((const uint64_t *)array->buffers[1])[position]);
+                break;
+            case 'f':
+                return arrow_write_float(buffer, ((const float *)array->buffers[1])[position]);
+            case 'g': {
+                char * text = PyOS_double_to_string(((const double *)array->buffers[1])[position], 'r', 0,
+                                                    Py_DTSF_ADD_DOT_0, NULL);
+                if (text == NULL){
+                    return false;
+                }
+                bool result = json_write(buffer, text, strlen(text));
+                PyMem_Free(text);
+                return result;
+            }
+            case 'u': {
+                const int32_t * offsets = (const int32_t *)array->buffers[1];
+                const char * text = (const char *)array->buffers[2] + offsets[position];
+                Py_ssize_t length = offsets[position + 1] - offsets[position];
+                importer->ascii = importer->ascii && is_ascii(text, length);
+                return json_write(buffer, text, length);
+            }
+            case 'U': {
+                const int64_t * offsets = (const int64_t *)array->buffers[1];
+                const char * text = (const char *)array->buffers[2] + offsets[position];
+                Py_ssize_t length = (Py_ssize_t)(offsets[position + 1] - offsets[position]);
+                importer->ascii = importer->ascii && is_ascii(text, length);
+                return json_write(buffer, text, length);
+            }
+            default:
+                goto unsupported;
+        }
+        return json_write(buffer, number, strlen(number));
+    }
+
+    if (strcmp(format, "vu") == 0){
+        // Strings of up to 12 bytes are stored in the view itself, others in one of the data buffers
+        const char * view = (const char *)array->buffers[1] + position * 16;
+        int32_t length, buffer_index, offset;
+        memcpy(&length, view, 4);
+        const char * text = view + 4;
+        if (length > 12){
+            memcpy(&buffer_index, view + 8, 4);
+            memcpy(&offset, view + 12, 4);
+            if ((buffer_index < 0) || (buffer_index + 3 > array->n_buffers)){
+                importer->error = "A string view refers to a buffer that doesn't exist.";
+                return false;
+            }
+            text = (const char *)array->buffers[2 + buffer_index] + offset;
+        }
+        importer->ascii = importer->ascii && is_ascii(text, length);
+        return json_write(buffer, text, length);
+    }
+    if ((strcmp(format, "tdD") == 0) || (strcmp(format, "tdm") == 0)){
+        int64_t days;
+        if (format[2] == 'D'){
+            days = ((const int32_t *)array->buffers[1])[position];
+        } else {
+            int64_t milliseconds = ((const int64_t *)array->buffers[1])[position];
+            days = milliseconds / 86400000 - ((milliseconds % 86400000) < 0);
+        }
+        arrow_date(days, number, sizeof(number));
+        return json_write(buffer, number, strlen(number));
+    }
+
+  unsupported:
+    importer->error = "A column has a type which can't be imported. Only columns of booleans, integers, floats, "
+                      "strings, and dates (or dictionaries of them) can be, so cast it to one of those types first.";
+    return false;
+}
+
+/* Appends the rows of a struct array to the values. */
+static bool arrow_import_batch(arrow_importer * importer, struct ArrowSchema * schema, struct ArrowArray * array){
+    TokenStream * stream = importer->stream;
+    int64_t width = schema->n_children;
+    if ((strcmp(schema->format, "+s") != 0) || (array->n_children != width)){
+        importer->error = "Only a struct array, such as a record batch or a table, can be imported.";
+        return false;
+    }
+    if (array->length * width > importer->tokens_allocated - stream->num_tokens){
+        Py_ssize_t allocated = importer->tokens_allocated * 2;
+        if (allocated < stream->num_tokens + array->length * width){
+            allocated = stream->num_tokens + array->length * width;
+        }
+        token_span * tokens = realloc(stream->tokens, (allocated ? allocated : 1) * sizeof(token_span));
+        if (tokens == NULL){
+            PyErr_NoMemory();
+            return false;
+        }
+        stream->tokens = tokens;
+        importer->tokens_allocated = allocated;
+    }
+
+    int64_t column, row;
+    for (column = 0; column < width; column++){
+        struct ArrowSchema * child_schema = schema->children[column];
+        struct ArrowArray * child = array->children[column];
+        for (row = 0; row < array->length; row++){
+            int64_t position = array->offset + row;
+            Py_ssize_t start = importer->data.length;
+            bool written;
+            // A null row of the struct makes each of its values null
+            if ((array->null_count != 0) && (array->buffers[0] != NULL) && !arrow_bit(array->buffers[0], position)){
+                written = json_write(&importer->data, ".", 1);
+            } else {
+                written = arrow_write_value(importer, child_schema, child, position);
+            }
+            if (!written){
+                return false;
+            }
+            Py_ssize_t length = importer->data.length - start;
+            if ((length > UINT_MAX) || (importer->data.length > LONG_MAX)){
+                importer->error = "The values are too long to import.";
+                return false;
+            }
+            token_span * span = &stream->tokens[stream->num_tokens + row * width + column];
+            span->start = (long)start;
+            span->length = (unsigned int)length;
+            span->line_no = 0;
+            span->delimiter = ' ';
+            span->kind = KIND_VALUE;
+        }
+    }
+    stream->num_tokens += array->length * width;
+    return true;
+}
+
+/* Decodes the key value metadata of a schema to a dict. */
+static PyObject * arrow_metadata(const char * metadata){
+    PyObject * result = PyDict_New();
+    if ((result == NULL) || (metadata == NULL)){
+        return result;
+    }
+    int32_t count, length, x;
+    memcpy(&count, metadata, 4);
+    metadata += 4;
+    for (x = 0; x < count; x++){
+        PyObject * pair[2];
+        int y;
+        for (y = 0; y < 2; y++){
+            memcpy(&length, metadata, 4);
+            pair[y] = PyUnicode_DecodeUTF8(metadata + 4, length, "replace");
+            metadata += 4 + length;
+        }
+        int error = (pair[0] == NULL) || (pair[1] == NULL) ? -1 : PyDict_SetItem(result, pair[0], pair[1]);
+        Py_XDECREF(pair[0]);
+        Py_XDECREF(pair[1]);
+        if (error){
+            Py_DECREF(result);
+            return NULL;
+        }
+    }
+    return result;
+}
+
+static bool arrow_importer_start(arrow_importer * importer){
+    memset(importer, 0, sizeof(arrow_importer));
+    importer->ascii = true;
+    TokenStream * stream = new_token_stream(true);
+    if (stream == NULL){
+        return false;
+    }
+    importer->stream = stream;
+    return true;
+}
+
+/* Returns (names, values, metadata) for the imported rows, or NULL with an
+   exception set. Always frees what the importer holds. */
+static PyObject * arrow_importer_finish(arrow_importer * importer, struct ArrowSchema * schema, bool ok){
+    TokenStream * stream = importer->stream;
+    PyObject * result = NULL;
+
+    if (!ok){
+        if (importer->error != NULL){
+            PyErr_SetString(PyExc_ValueError, importer->error);
+        }
+        free(importer->data.data);
+        Py_DECREF(stream);
+        return NULL;
+    }
+
+    // The data is kept NUL terminated, as the parsed data is
+    if (json_write(&importer->data, "", 1)){
+        stream->data = realloc(importer->data.data, importer->data.length);
+        if (stream->data == NULL){
+            stream->data = importer->data.data;
+        }
+        importer->data.data = NULL;
+        stream->length = (long)(importer->data.length - 1);
+        stream->ascii = importer->ascii;
+        if ((stream->num_tokens > 0) && (stream->num_tokens < importer->tokens_allocated)){
+            token_span * tokens = realloc(stream->tokens, stream->num_tokens * sizeof(token_span));
+            if (tokens != NULL){
+                stream->tokens = tokens;
+            }
+        }
+
+        PyObject * names = PyList_New(schema->n_children);
+        int64_t x;
+        for (x = 0; (names != NULL) && (x < schema->n_children); x++){
+            const char * name = schema->children[x]->name;
+            PyObject * str = PyUnicode_DecodeUTF8(name != NULL ? name : "", name != NULL ? strlen(name) : 0, "replace");
+            if (str == NULL){
+                Py_CLEAR(names);
+                break;
+            }
+            PyList_SET_ITEM(names, x, str);
+        }
+        PyObject * metadata = names != NULL ? arrow_metadata(schema->metadata) : NULL;
+        LoopValues * values = metadata != NULL ? PyObject_New(LoopValues, &LoopValuesType) : NULL;
+        if (values != NULL){
+            Py_INCREF(stream);
+            values->stream = stream;
+            values->first = 0;
+            values->count = stream->num_tokens;
+            values->width = schema->n_children;
+            values->values = NULL;
+            result = Py_BuildValue("NNN", names, values, metadata);
+        } else {
+            Py_XDECREF(names);
+            Py_XDECREF(metadata);
+        }
+    }
+    free(importer->data.data);
+    Py_DECREF(stream);
+    return result;
+}
+
+static PyObject *
+arrow_import(PyObject *self, PyObject *args)
+{
+    PyObject * schema_capsule, * array_capsule;
+    if (!PyArg_ParseTuple(args, "OO", &schema_capsule, &array_capsule))
+        return NULL;
+
+    struct ArrowSchema * schema = PyCapsule_GetPointer(schema_capsule, "arrow_schema");
+    struct ArrowArray * array = schema != NULL ? PyCapsule_GetPointer(array_capsule, "arrow_array") : NULL;
+    if (array == NULL){
+        return NULL;
+    }
+    if ((schema->release == NULL) || (array->release == NULL)){
+        PyErr_SetString(PyExc_ValueError, "The Arrow data has already been released.");
+        return NULL;
+    }
+
+    arrow_importer importer;
+    if (!arrow_importer_start(&importer)){
+        return NULL;
+    }
+    // The capsules still own the schema and array, and release them
+    bool ok = arrow_import_batch(&importer, schema, array);
+    return arrow_importer_finish(&importer, schema, ok);
+}
+
+static PyObject *
+arrow_import_stream(PyObject *self, PyObject *args)
+{
+    PyObject * stream_capsule;
+    if (!PyArg_ParseTuple(args, "O", &stream_capsule))
+        return NULL;
+
+    struct ArrowArrayStream * stream = PyCapsule_GetPointer(stream_capsule, "arrow_array_stream");
+    if (stream == NULL){
+        return NULL;
+    }
+    if (stream->release == NULL){
+        PyErr_SetString(PyExc_ValueError, "The Arrow stream has already been released.");
+        return NULL;
+    }
+
+    struct ArrowSchema schema;
+    if (stream->get_schema(stream, &schema) != 0){
+        const char * error = stream->get_last_error(stream);
+        PyErr_Format(PyExc_ValueError, "Couldn't get the schema of the Arrow stream: %s",
+                     error != NULL ? error : "unknown error");
+        return NULL;
+    }
+
+    arrow_importer importer;
+    bool ok = arrow_importer_start(&importer);
+    if (ok){
+        while (true){
+            struct ArrowArray array;
+            if (stream->get_next(stream, &array) != 0){
+                const char * error = stream->get_last_error(stream);
+                PyErr_Format(PyExc_ValueError, "Couldn't read the Arrow stream: %s",
+                             error != NULL ? error : "unknown error");
+                ok = false;
+                break;
+            }
+            if (array.release == NULL){
+                break;
+            }
+            ok = arrow_import_batch(&importer, &schema, &array);
+            array.release(&array);
+            if (!ok){
+                break;
+            }
+        }
+    }
+    PyObject * result = ok || (importer.stream != NULL) ? arrow_importer_finish(&importer, &schema, ok) : NULL;
+    schema.release(&schema);
+    return result;
+}
+
+/* Numeric columns. The values of one column of a loop are parsed straight
+   into a buffer of numbers, such as an array.array, which NumPy can then
+   use without copying. */
+
+typedef union {
+    double float_value;
+    int64_t int_value;
+} column_number;
+
+/* Reads a value (text, or an object which isn't a str) as a number.
+   Returns 1 for a number, 0 for a null, and -1 if it isn't a number (or
+   a 32 bit number doesn't fit). */
+static int read_column_number(const char * text, Py_ssize_t length, PyObject * obj, char format,
+                              column_number * out){
+    if ((obj == Py_None) || ((text != NULL) && is_null_text(text, length))){
+        return 0;
+    }
+    bool is_float = (format == 'd') || (format == 'f');
+    arrow_kind kind = is_float ? ARROW_FLOAT64 : ARROW_INT64;
+    void * value = is_float ? (void *)&out->float_value : (void *)&out->int_value;
+    if (!((obj != NULL) ? arrow_parse_object(kind, obj, value) : arrow_parse(kind, text, length, value))){
+        return -1;
+    }
+    if ((format == 'i') && ((out->int_value < INT32_MIN) || (out->int_value > INT32_MAX))){
+        return -1;
+    }
+    return 1;
+}
+
+static void store_column_number(Py_buffer * buffer, char format, Py_ssize_t row, column_number value){
+    switch (format){
+        case 'd': ((double *)buffer->buf)[row] = value.float_value; break;
+        case 'f': ((float *)buffer->buf)[row] = (float)value.float_value; break;
+        case 'i': ((int32_t *)buffer->buf)[row] = (int32_t)value.int_value; break;
+        default: ((int64_t *)buffer->buf)[row] = value.int_value; break;
+    }
+}
+
+static void column_number_error(PyObject * value, Py_ssize_t row, char format){
+    PyErr_Format(PyExc_ValueError, "The value %R in row %zd isn't %s.", value, row,
+                 (format == 'd') || (format == 'f') ? "a number" :
+                 format == 'i' ? "an integer that fits in 32 bits" : "an integer that fits in 64 bits");
+}
+
+static PyObject *
+parse_column(PyObject *self, PyObject *args)
+{
+    PyObject * data, * columns_type, * out, * null_value;
+    Py_ssize_t position;
+    if (!PyArg_ParseTuple(args, "OnOOO", &data, &position, &columns_type, &out, &null_value))
+        return NULL;
+
+    loop_source source;
+    memset(&source, 0, sizeof(loop_source));
+    Py_buffer buffer;
+    buffer.obj = NULL;
+    int8_t * distinct_status = NULL;
+    column_number * distinct_numbers = NULL;
+    PyObject * result = NULL;
+    Py_ssize_t x;
+
+    Py_ssize_t width = load_loop_source(&source, data, columns_type);
+    if (width < 0){
+        goto done;
+    }
+    if ((position < 0) || (position >= width)){
+        PyErr_SetString(PyExc_ValueError, "The position is past the end of the rows.");
+        goto done;
+    }
+    if (PyObject_GetBuffer(out, &buffer, PyBUF_WRITABLE | PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) != 0){
+        buffer.obj = NULL;
+        goto done;
+    }
+
+    // Native doubles, floats, and 32 or 64 bit signed integers
+    const char * format_text = buffer.format != NULL ? buffer.format : "B";
+    if ((format_text[0] == '@') || (format_text[0] == '=')){
+        format_text++;
+    }
+    char format = format_text[0];
+    if ((format == 'l') || (format == 'q')){
+        format = buffer.itemsize == 8 ? 'q' : (buffer.itemsize == 4 ? 'i' : '\0');
+    }
+    if ((format_text[0] == '\0') || (format_text[1] != '\0') || (strchr("dfiq", format) == NULL) ||
+        (buffer.itemsize != ((format == 'd') || (format == 'q') ? 8 : 4))){
+        PyErr_SetString(PyExc_ValueError, "The buffer must be of doubles, floats, or 32 or 64 bit integers.");
+        goto done;
+    }
+    if (buffer.len / buffer.itemsize != source.num_rows){
+        PyErr_SetString(PyExc_ValueError, "The buffer must have one value for each row.");
+        goto done;
+    }
+
+    // Nulls are NaN in columns of floats unless another value is given, while columns of integers need one
+    bool is_float = (format == 'd') || (format == 'f');
+    bool has_null_number = is_float || (null_value != Py_None);
+    column_number null_number;
+    if (is_float){
+        null_number.float_value = null_value == Py_None ? Py_NAN : PyFloat_AsDouble(null_value);
+    } else if (null_value != Py_None){
+        if (read_column_number(NULL, 0, null_value, format, &null_number) != 1){
+            PyErr_Format(PyExc_ValueError, "The null value %R doesn't fit in the buffer.", null_value);
+            goto done;
+        }
+    }
+    if (PyErr_Occurred()){
+        goto done;
+    }
+
+    // The distinct values of a categorical column are each read once
+    loop_source_column * column = source.columns != NULL ? &source.columns[position] : NULL;
+    if ((column != NULL) && (column->distinct != NULL)){
+        Py_ssize_t num_distinct = PyTuple_GET_SIZE(column->distinct);
+        distinct_status = malloc(num_distinct ? num_distinct : 1);
+        distinct_numbers = malloc((num_distinct ? num_distinct : 1) * sizeof(column_number));
+        if ((distinct_status == NULL) || (distinct_numbers == NULL)){
+            PyErr_NoMemory();
+            goto done;
+        }
+        for (x = 0; x < num_distinct; x++){
+            PyObject * value = PyTuple_GET_ITEM(column->distinct, x);
+            Py_ssize_t length = 0;
+            const char * text = PyUnicode_Check(value) ? PyUnicode_AsUTF8AndSize(value, &length) : NULL;
+            if (PyUnicode_Check(value) && (text == NULL)){
+                goto done;
+            }
+            distinct_status[x] = (int8_t)read_column_number(text, length, text == NULL ? value : NULL, format,
+                                                            &distinct_numbers[x]);
+        }
+    }
+
+    for (x = 0; x < source.num_rows; x++){
+        column_number number;
+        int status;
+        if (distinct_status != NULL){
+            Py_ssize_t code = categorical_code(&column->codes, x);
+            if ((code < 0) || (code >= PyTuple_GET_SIZE(column->distinct))){
+                PyErr_SetString(PyExc_ValueError, "A categorical column has a code with no value.");
+                goto done;
+            }
+            status = distinct_status[code];
+            number = distinct_numbers[code];
+        } else {
+            const char * text;
+            Py_ssize_t length = 0;
+            PyObject * obj;
+            if (!loop_source_cell(&source, x, position, &text, &length, &obj)){
+                goto done;
+            }
+            status = read_column_number(text, length, obj, format, &number);
+        }
+
+        if ((status == 0) && has_null_number){
+            number = null_number;
+        } else if (status == 0){
+            PyErr_Format(PyExc_ValueError, "Row %zd has a null value, and integers can't be NaN. Give a null_value "
+                         "to use for nulls.", x);
+            goto done;
+        } else if (status < 0){
+            const char * text;
+            Py_ssize_t length = 0;
+            PyObject * obj;
+            if (loop_source_cell(&source, x, position, &text, &length, &obj)){
+                PyObject * value = obj != NULL ? obj : PyUnicode_DecodeUTF8(text, length, "replace");
+                if (value != NULL){
+                    column_number_error(value, x, format);
+                }
+                if (obj == NULL){
+                    Py_XDECREF(value);
+                }
+            }
+            goto done;
+        }
+        store_column_number(&buffer, format, x, number);
+    }
+    Py_INCREF(Py_None);
+    result = Py_None;
+
+  done:
+    if (buffer.obj != NULL){
+        PyBuffer_Release(&buffer);
+    }
+    clear_loop_source(&source);
+    free(distinct_status);
+    free(distinct_numbers);
+    return result;
+}
+
+/* CSV. encode_csv_rows() writes the rows of a loop as the csv module's
+   default dialect would, except that rows end with '\n' rather than '\r\n'.
+   Values with a comma, quote, or line break are quoted, with any quotes
+   doubled. decode_csv() reads CSV into LoopValues, with the text of each
+   value stored in the data of a new TokenStream, as if it had been parsed
+   lazily. */
+
+/* Writes a value, quoting it if it needs to be. As get_data_as_csv() has
+   always done, a "\r\n" within a value is written as "\n". */
+static bool csv_write_value(json_buffer * buffer, const char * text, Py_ssize_t length){
+    Py_ssize_t x, quotes = 0;
+    bool quote = false;
+    for (x = 0; x < length; x++){
+        char c = text[x];
+        if (c == '"'){
+            quotes++;
+            quote = true;
+        } else if ((c == ',') || (c == '\n') || (c == '\r')){
+            quote = true;
+        }
+    }
+    if (!quote){
+        return json_write(buffer, text, length);
+    }
+
+    if (!json_reserve(buffer, length + quotes + 2)){
+        return false;
+    }
+    char * out = &buffer->data[buffer->length];
+    *out++ = '"';
+    for (x = 0; x < length; x++){
+        char c = text[x];
+        if (c == '"'){
+            *out++ = '"';
+        } else if ((c == '\r') && (x + 1 < length) && (text[x + 1] == '\n')){
+            continue;
+        }
+        *out++ = c;
+    }
+    *out++ = '"';
+    buffer->length = out - buffer->data;
+    return true;
+}
+
+/* Writes a value which isn't a str as the csv module does: None as an empty
+   value, floats as their repr(), and anything else as its str(). */
+static bool csv_write_object(json_buffer * buffer, PyObject * obj){
+    if (obj == Py_None){
+        return true;
+    }
+    PyObject * str = PyFloat_Check(obj) ? PyObject_Repr(obj) : PyObject_Str(obj);
+    if (str == NULL){
+        return false;
+    }
+    Py_ssize_t length;
+    const char * text = PyUnicode_AsUTF8AndSize(str, &length);
+    bool ok = (text != NULL) && csv_write_value(buffer, text, length);
+    Py_DECREF(str);
+    return ok;
+}
+
+static bool csv_write_row(json_buffer * buffer, loop_source * source, int64_t row, Py_ssize_t width){
+    Py_ssize_t row_start = buffer->length;
+    Py_ssize_t x;
+    for (x = 0; x < width; x++){
+        const char * text;
+        Py_ssize_t length;
+        PyObject * obj;
+        if ((x > 0) && !json_write(buffer, ",", 1)){
+            return false;
+        }
+        if (!loop_source_cell(source, row, x, &text, &length, &obj)){
+            return false;
+        }
+        if (!(text != NULL ? csv_write_value(buffer, text, length) : csv_write_object(buffer, obj))){
+            return false;
+        }
+    }
+    // A row of one empty value is written as "", so that it isn't a blank line
+    if ((width == 1) && (buffer->length == row_start) && !json_write(buffer, "\"\"", 2)){
+        return false;
+    }
+    return json_write(buffer, "\n", 1);
+}
+
+static PyObject *
+encode_csv_rows(PyObject *self, PyObject *args)
+{
+    PyObject * data, * columns_type, * header = Py_None;
+    if (!PyArg_ParseTuple(args, "OO|O", &data, &columns_type, &header)){
+        return NULL;
+    }
+
+    json_buffer buffer = {NULL, 0, 0};
+    loop_source source, header_source;
+    memset(&source, 0, sizeof(loop_source));
+    memset(&header_source, 0, sizeof(loop_source));
+    PyObject * result = NULL;
+    int64_t x;
+
+    if (header != Py_None){
+        PyObject * header_row = PyTuple_Pack(1, header);
+        Py_ssize_t loaded = header_row != NULL ? load_loop_source(&header_source, header_row, NULL) : -1;
+        Py_XDECREF(header_row);
+        if ((loaded < 0) ||
+            !csv_write_row(&buffer, &header_source, 0, PySequence_Fast_GET_SIZE(PySequence_Fast_GET_ITEM(header_source.rows, 0)))){
+            goto done;
+        }
+    }
+
+    Py_ssize_t width = load_loop_source(&source, data, columns_type);
+    if (width < 0){
+        goto done;
+    }
+    for (x = 0; x < source.num_rows; x++){
+        // Rows are written with as many values as they have
+        Py_ssize_t row_width = source.rows != NULL ?
+                               PySequence_Fast_GET_SIZE(PySequence_Fast_GET_ITEM(source.rows, x)) : width;
+        if (!csv_write_row(&buffer, &source, x, row_width)){
+            goto done;
+        }
+    }
+    result = PyUnicode_DecodeUTF8(buffer.data != NULL ? buffer.data : "", buffer.length, NULL);
+
+  done:
+    clear_loop_source(&source);
+    clear_loop_source(&header_source);
+    free(buffer.data);
+    return result;
+}
+
+typedef enum {
+    CSV_START_RECORD,
+    CSV_START_FIELD,
+    CSV_IN_FIELD,
+    CSV_IN_QUOTED_FIELD,
+    CSV_QUOTE_IN_QUOTED_FIELD
+} csv_state;
+
+/* Reads CSV into the data and tokens of a stream, whose data must have
+   room for the text. Values are read as the csv module reads them, except
+   that blank lines are skipped and any of "\n", "\r\n" or "\r" end a row.
+   Returns the number of values in each row, 0 if there are no rows, or -1
+   with the error in the stream if a row has a different number of values
+   from the first, or the stream ran out of memory. */
+static Py_ssize_t csv_read(TokenStream * stream, const char * text, Py_ssize_t length){
+    const char * position = text;
+    const char * end = text + length;
+    char * out = stream->data;
+    char * field = out;
+    Py_ssize_t allocated = 0, record_start = 0, width = 0, num_rows = 0;
+    csv_state state = CSV_START_RECORD;
+
+    while (true){
+        switch (state){
+            case CSV_START_RECORD:
+                if (position == end){
+                    return width;
+                }
+                if ((*position == '\n') || (*position == '\r')){
+                    position++;
+                    continue;
+                }
+                state = CSV_START_FIELD;
+                // Fall through
+            case CSV_START_FIELD:
+                field = out;
+                if ((position < end) && (*position == '"')){
+                    position++;
+                    state = CSV_IN_QUOTED_FIELD;
+                    continue;
+                }
+                state = CSV_IN_FIELD;
+                // Fall through
+            case CSV_IN_FIELD:
+                // As in the csv module, a quote after the start of the value is kept
+                while ((position < end) && (*position != ',') && (*position != '\n') && (*position != '\r')){
+                    *out++ = *position++;
+                }
+                break;
+            case CSV_IN_QUOTED_FIELD:
+                while ((position < end) && (*position != '"')){
+                    *out++ = *position++;
+                }
+                // The csv module also keeps a value which is missing its closing quote
+                if (position == end){
+                    break;
+                }
+                position++;
+                state = CSV_QUOTE_IN_QUOTED_FIELD;
+                continue;
+            case CSV_QUOTE_IN_QUOTED_FIELD:
+                if ((position < end) && (*position == '"')){
+                    *out++ = *position++;
+                    state = CSV_IN_QUOTED_FIELD;
+                    continue;
+                }
+                if ((position < end) && (*position != ',') && (*position != '\n') && (*position != '\r')){
+                    // Text after the closing quote is kept, as the csv module does
+                    state = CSV_IN_FIELD;
+                    continue;
+                }
+                break;
+        }
+
+        // The end of a value
+        if (stream->num_tokens == allocated){
+            allocated = allocated ? allocated * 2 : 1024;
+            token_span * tokens = realloc(stream->tokens, allocated * sizeof(token_span));
+            if (tokens == NULL){
+                stream->out_of_memory = true;
+                return -1;
+            }
+            stream->tokens = tokens;
+        }
+        token_span * span = &stream->tokens[stream->num_tokens++];
+        span->start = (long)(field - stream->data);
+        span->length = (unsigned int)(out - field);
+        span->line_no = 0;
+        span->delimiter = ' ';
+        span->kind = KIND_VALUE;
+        if ((position < end) && (*position == ',')){
+            position++;
+            state = CSV_START_FIELD;
+            continue;
+        }
+
+        // The end of a row
+        if (position < end){
+            if ((*position == '\r') && (position + 1 < end) && (position[1] == '\n')){
+                position++;
+            }
+            position++;
+        }
+        Py_ssize_t row_width = stream->num_tokens - record_start;
+        if (num_rows == 0){
+            width = row_width;
+        } else if (row_width != width){
+            snprintf(stream->error, err_size, "Row %zd of the CSV data has %zd values, but the header has %zd.",
+                     num_rows, row_width, width);
+            return -1;
+        }
+        record_start = stream->num_tokens;
+        num_rows++;
+        state = CSV_START_RECORD;
+    }
+}
+
+static PyObject *
+decode_csv(PyObject *self, PyObject *args)
+{
+    PyObject * text;
+    if (!PyArg_ParseTuple(args, "U", &text)){
+        return NULL;
+    }
+
+    // Text which can't be read here is left to the csv module, which gives the same values or error
+    Py_ssize_t length;
+    const char * utf8 = PyUnicode_AsUTF8AndSize(text, &length);
+    if (utf8 == NULL){
+        if (!PyErr_ExceptionMatches(PyExc_UnicodeEncodeError)){
+            return NULL;
+        }
+        PyErr_Clear();
+        Py_RETURN_NONE;
+    }
+    if ((length > UINT_MAX) || (memchr(utf8, '\0', length) != NULL)){
+        Py_RETURN_NONE;
+    }
+
+    TokenStream * stream = new_token_stream(PyUnicode_IS_ASCII(text));
+    if (stream == NULL){
+        return NULL;
+    }
+    // No value is longer unquoted than it was in the CSV
+    stream->data = malloc(length + 1);
+    if (stream->data == NULL){
+        Py_DECREF(stream);
+        return PyErr_NoMemory();
+    }
+
+    Py_ssize_t width;
+    Py_BEGIN_ALLOW_THREADS
+    width = csv_read(stream, utf8, length);
+    Py_END_ALLOW_THREADS
+
+    if (width < 0){
+        if (stream->out_of_memory){
+            PyErr_NoMemory();
+        } else {
+            PyErr_SetString(PyExc_ValueError, stream->error);
+        }
+        Py_DECREF(stream);
+        return NULL;
+    }
+    if (width == 0){
+        PyErr_SetString(PyExc_ValueError, "The CSV data has no header.");
+        Py_DECREF(stream);
+        return NULL;
+    }
+
+    PyObject * header = PyList_New(width);
+    Py_ssize_t x;
+    for (x = 0; (header != NULL) && (x < width); x++){
+        token_span * span = &stream->tokens[x];
+        PyObject * name = make_string(&stream->data[span->start], span->length, stream->ascii);
+        if (name == NULL){
+            Py_CLEAR(header);
+            break;
+        }
+        PyList_SET_ITEM(header, x, name);
+    }
+    LoopValues * values = header != NULL ? PyObject_New(LoopValues, &LoopValuesType) : NULL;
+    if (values == NULL){
+        Py_XDECREF(header);
+        Py_DECREF(stream);
+        return NULL;
+    }
+    values->stream = stream;
+    values->first = width;
+    values->count = stream->num_tokens - width;
+    values->width = width;
+    values->values = NULL;
+    return Py_BuildValue("NN", header, values);
+}
+
+static PyObject *
 version(PyObject *self)
 {
     return PyUnicode_FromString(module_version);
@@ -815,9 +5052,65 @@ static PyMethodDef cnmrstar_methods[] = {
      {"get_token_full",  (PyCFunction)PARSE_get_token_full, METH_NOARGS,
      "Get one token from the file as well as the line number and delimiter."},
 
+     {"get_token_typed",  (PyCFunction)PARSE_get_token_typed, METH_NOARGS,
+     "Get one token from the file as well as the line number, delimiter, and kind of token."},
+
      {"reset",  (PyCFunction)PARSE_reset, METH_NOARGS,
      "Reset the tokenizer state."},
 
+     {"tokenize",  (PyCFunction)PARSE_tokenize, METH_VARARGS,
+     "Tokenize a string without holding the GIL. Returns a TokenStream. Optionally\n"
+     "provide the number of threads to use and the minimum characters per thread."},
+
+     {"string_stats",  (PyCFunction)(void(*)(void))string_stats, METH_VARARGS | METH_KEYWORDS,
+     "Returns how many strings were created using the ASCII fast path and how many needed\n"
+     "UTF-8 decoding, both for tokens and for quote_value(). Pass reset=True to reset the counts."},
+
+     {"encode_json",  (PyCFunction)encode_json, METH_VARARGS,
+     "Returns an object as JSON, exactly as json.dumps(obj, default=default) would. LoopValues\n"
+     "are written as their rows, as are objects of the optional columns_type, from the columns\n"
+     "in their _columns attribute."},
+
+     {"encode_json_rows",  (PyCFunction)encode_json_rows, METH_VARARGS,
+     "Returns the rows of a loop (LoopValues, an object of columns_type, or a list of rows) as JSON,\n"
+     "as encode_json() would write each value. Each row is written as row_start, then each value\n"
+     "after its prefix (or separated by ', ' if prefixes is None), then row_end, with separator\n"
+     "between rows. Arguments: rows, default, columns_type, row_start, prefixes, row_end, separator."},
+
+     {"decode_json",  (PyCFunction)decode_json, METH_VARARGS,
+     "Reads JSON as json.loads() would, except that arrays of arrays of strings under a \"data\"\n"
+     "key are returned as LoopValues. Raises ValueError if the JSON isn't valid."},
+
+     {"arrow_export",  (PyCFunction)arrow_export, METH_VARARGS,
+     "Returns the values of loops as an ArrowTable. Arguments: sources, a list of (data, positions)\n"
+     "for each loop, where data is LoopValues, an object of columns_type, or a list of rows, and\n"
+     "positions has the position of each column within the data (or -1 if it is missing); names;\n"
+     "kinds (0 for strings, 1 for integers, 2 for floats, 3 for dates); columns_type; and an\n"
+     "optional metadata key and value. Null values are exported as nulls, and a column with a\n"
+     "value that isn't of its kind as strings."},
+
+     {"arrow_import",  (PyCFunction)arrow_import, METH_VARARGS,
+     "Returns (names, values, metadata) for an Arrow struct array, given its arrow_schema and\n"
+     "arrow_array PyCapsules. values is a LoopValues with the text of each value, and '.' for nulls."},
+
+     {"arrow_import_stream",  (PyCFunction)arrow_import_stream, METH_VARARGS,
+     "As arrow_import(), but for all of the batches of an arrow_array_stream PyCapsule."},
+
+     {"parse_column",  (PyCFunction)parse_column, METH_VARARGS,
+     "Reads the values of one column of a loop as numbers into a writable buffer of doubles, floats,\n"
+     "or 32 or 64 bit integers, with one value for each row. Arguments: data (LoopValues, an object\n"
+     "of columns_type, or a list of rows), position, columns_type, out, and null_value, which nulls\n"
+     "are stored as (NaN for floats if it is None). Raises ValueError for a value that isn't a number."},
+
+     {"encode_csv_rows",  (PyCFunction)encode_csv_rows, METH_VARARGS,
+     "Returns the rows of a loop (LoopValues, an object of columns_type, or a list of rows) as CSV,\n"
+     "as the csv module writes them but with each row ending in '\\n', after the optional header row."},
+
+     {"decode_csv",  (PyCFunction)decode_csv, METH_VARARGS,
+     "Returns (header, values) for CSV data, where values is a LoopValues with the rest of the rows.\n"
+     "Blank lines are skipped. Raises ValueError if a row has a different number of values from the\n"
+     "header. Returns None for text the csv module should read instead."},
+
      {"version",  (PyCFunction)version, METH_NOARGS,
      "Returns the version of the module."},
 
@@ -850,6 +5143,13 @@ static struct PyModuleDef moduledef = {
 
 PyMODINIT_FUNC
 PyInit_cnmrstar(void){
+    if (PyType_Ready(&TokenStreamType) < 0)
+        INITERROR;
+    if (PyType_Ready(&LoopValuesType) < 0)
+        INITERROR;
+    if (PyType_Ready(&ArrowTableType) < 0)
+        INITERROR;
+
     PyObject *module = PyModule_Create(&moduledef);
 
     if (module == NULL)
@@ -862,5 +5162,39 @@ PyInit_cnmrstar(void){
         INITERROR;
     }
 
+    if (PyModule_AddIntConstant(module, "DATA", KIND_DATA) ||
+        PyModule_AddIntConstant(module, "SAVE_START", KIND_SAVE_START) ||
+        PyModule_AddIntConstant(module, "SAVE_END", KIND_SAVE_END) ||
+        PyModule_AddIntConstant(module, "LOOP", KIND_LOOP) ||
+        PyModule_AddIntConstant(module, "STOP", KIND_STOP) ||
+        PyModule_AddIntConstant(module, "TAG", KIND_TAG) ||
+        PyModule_AddIntConstant(module, "VALUE", KIND_VALUE) ||
+        PyModule_AddIntConstant(module, "GLOBAL", KIND_GLOBAL) ||
+        PyModule_AddIntConstant(module, "REF", KIND_REF)) {
+        Py_DECREF(module);
+        INITERROR;
+    }
+
+    Py_INCREF(&TokenStreamType);
+    if (PyModule_AddObject(module, "TokenStream", (PyObject *)&TokenStreamType) < 0) {
+        Py_DECREF(&TokenStreamType);
+        Py_DECREF(module);
+        INITERROR;
+    }
+
+    Py_INCREF(&LoopValuesType);
+    if (PyModule_AddObject(module, "LoopValues", (PyObject *)&LoopValuesType) < 0) {
+        Py_DECREF(&LoopValuesType);
+        Py_DECREF(module);
+        INITERROR;
+    }
+
+    Py_INCREF(&ArrowTableType);
+    if (PyModule_AddObject(module, "ArrowTable", (PyObject *)&ArrowTableType) < 0) {
+        Py_DECREF(&ArrowTableType);
+        Py_DECREF(module);
+        INITERROR;
+    }
+
     return module;
 }
@@ -5,6 +5,6 @@ cnmrstar = Extension('cnmrstar',
                      extra_compile_args=["-funroll-loops", "-O3"])
 
 setup(name='cnmrstar',
-      version='3.2.0',
+      version='3.8.0',
       description='This contains a really fast NMR-STAR tokenizer and value sanitizer.',
       ext_modules=[cnmrstar])
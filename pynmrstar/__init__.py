@@ -23,12 +23,16 @@ except ImportError:
             raise ImportError('Could not import cnmrstar sub-module! Your installation appears to be broken.')
 
 from pynmrstar import utils
+from pynmrstar.utils import parse_many
 from pynmrstar._internal import __version__, min_cnmrstar_version
 from pynmrstar.entry import Entry
 from pynmrstar.loop import Loop
+from pynmrstar.paths import compile_path
 from pynmrstar.parser import Parser as _Parser
 from pynmrstar.saveframe import Saveframe
 from pynmrstar.schema import Schema
+from pynmrstar.shared import SharedEntryStore
+from pynmrstar.sqlite import export_sqlite
 import pynmrstar.definitions as definitions
 
 if cnmrstar:
@@ -52,4 +56,5 @@ del saveframe
 del schema
 del parser
 
-__all__ = ['Loop', 'Saveframe', 'Entry', 'Schema', 'definitions', 'utils', '__version__', 'exceptions', 'cnmrstar']
+__all__ = ['Loop', 'Saveframe', 'Entry', 'Schema', 'definitions', 'utils', '__version__', 'exceptions', 'cnmrstar',
+           'parse_many', 'export_sqlite']
@@ -1,4 +1,6 @@
+import csv
 import decimal
+import hashlib
 import json
 import logging
 import os
@@ -7,14 +9,16 @@ import zlib
 from datetime import date
 from gzip import GzipFile
 from io import StringIO, BytesIO
-from typing import Dict, Union, IO, List, Tuple
+from typing import Any, Dict, Iterable, Optional, Union, IO, List, Tuple
 from urllib.error import HTTPError, URLError
 from urllib.request import urlopen, Request
 
 import pynmrstar
+from pynmrstar.columns import ColumnRows
+from pynmrstar.exceptions import InvalidStateError
 
-__version__: str = "3.3.4"
-min_cnmrstar_version: str = "3.2.0"
+__version__: str = "3.4.0"
+min_cnmrstar_version: str = "3.8.0"
 
 # If we have requests, open a session to reuse for the duration of the program run
 try:
@@ -72,9 +76,133 @@ def _json_serialize(obj: object) -> str:
     # Serialize datetime.date objects by calling str() on them
     if isinstance(obj, (date, decimal.Decimal)):
         return str(obj)
+    # The data of loops stored as columns
+    if isinstance(obj, ColumnRows):
+        return list(obj)
     raise TypeError("Type not serializable: %s" % type(obj))
 
 
+def dump_json(contents: Any) -> str:
+    """ Returns contents as JSON, exactly as json.dumps(contents,
+    default=_json_serialize) would. The C module writes the JSON directly,
+    including the data of loops stored lazily (left in contents as the
+    cnmrstar.LoopValues) or as columns (left as a ColumnRows), without
+    creating a str or a row for each value. """
+
+    if pynmrstar.cnmrstar is not None:
+        return pynmrstar.cnmrstar.encode_json(contents, _json_serialize, ColumnRows)
+    return json.dumps(contents, default=_json_serialize)
+
+
+def dump_json_rows(rows: Any, row_start: str, prefixes: Optional[List[str]], row_end: str, separator: str) -> str:
+    """ Returns rows of loop data (in any form Loop._data_slice() returns)
+    as JSON, writing each value as dump_json() would. Each row is written
+    as row_start, then each value after its prefix (or separated by ', ' if
+    prefixes is None), then row_end, with separator between the rows. """
+
+    if pynmrstar.cnmrstar is not None:
+        return pynmrstar.cnmrstar.encode_json_rows(rows, _json_serialize, ColumnRows, row_start, prefixes, row_end,
+                                                   separator)
+
+    written = []
+    for row in rows:
+        values = [json.dumps(_, default=_json_serialize) for _ in row]
+        if prefixes is None:
+            written.append(row_start + ", ".join(values) + row_end)
+        elif len(values) != len(prefixes):
+            raise ValueError(f"The rows have {len(values)} values, but {len(prefixes)} were expected.")
+        else:
+            written.append(row_start + "".join(_ + value for _, value in zip(prefixes, values)) + row_end)
+    return separator.join(written)
+
+
+def dump_csv_rows(rows: Any, header: Optional[List[str]] = None) -> str:
+    """ Returns rows of loop data (in any form Loop._data_slice() returns)
+    as CSV, after the header row if one is given. The rows are written as
+    the csv module writes them, except that each ends in '\\n' rather than
+    '\\r\\n'. """
+
+    if pynmrstar.cnmrstar is not None:
+        try:
+            return pynmrstar.cnmrstar.encode_csv_rows(rows, ColumnRows, header)
+        except UnicodeEncodeError:
+            # Strings which can't be encoded as UTF-8 (lone surrogates) are written by the csv module instead
+            pass
+
+    csv_buffer = StringIO()
+    csv_writer = csv.writer(csv_buffer)
+    if header is not None:
+        csv_writer.writerow(header)
+    csv_writer.writerows(rows)
+    return csv_buffer.getvalue().replace('\r\n', '\n')
+
+
+def load_csv(text: str) -> Tuple[List[str], Any]:
+    """ Returns the header and the rest of the rows of CSV data, skipping
+    blank lines. The rows may be returned as cnmrstar.LoopValues, which
+    hold the values without creating them until they are needed. Raises
+    ValueError if a row doesn't have a value for each column of the
+    header. """
+
+    if pynmrstar.cnmrstar is not None:
+        loaded = pynmrstar.cnmrstar.decode_csv(text)
+        if loaded is not None:
+            return loaded
+
+    rows = [row for row in csv.reader(StringIO(text, newline='')) if row]
+    if not rows:
+        raise ValueError("The CSV data has no header.")
+    for row_num, row in enumerate(rows[1:], start=1):
+        if len(row) != len(rows[0]):
+            raise ValueError(f"Row {row_num} of the CSV data has {len(row)} values, but the header has "
+                             f"{len(rows[0])}.")
+    return rows[0], rows[1:]
+
+
+def load_json(text: Union[str, bytes]) -> Any:
+    """ Reads JSON as json.loads() would, except that the data of loops may
+    be returned as cnmrstar.LoopValues, which hold the values without
+    creating them until they are needed. If the C module rejects the JSON,
+    it is read with json.loads() instead, so that the error is the same. """
+
+    if pynmrstar.cnmrstar is not None and isinstance(text, str):
+        try:
+            return pynmrstar.cnmrstar.decode_json(text)
+        except ValueError:
+            pass
+    return json.loads(text)
+
+
+def _canonical_value(obj: object) -> List[str]:
+    """ Stands in for values JSON can't represent when calculating content
+    hashes. Includes the type, so that values which print the same but
+    aren't equal (such as the str '1.0' and Decimal('1.0')) differ. """
+
+    return [f"{type(obj).__module__}.{type(obj).__qualname__}", repr(obj)]
+
+
+def content_digest(contents: Any, digests: Iterable[bytes] = ()) -> bytes:
+    """ Returns a digest of some contents (anything made up of lists and
+    values), followed by the digests of other contents. The digest is the
+    same in every process, unlike hash(). Used for the content hashes of
+    entries, saveframes and loops. """
+
+    digest = hashlib.blake2b(digest_size=16)
+    digest.update(json.dumps(contents, ensure_ascii=False, check_circular=False,
+                             default=_canonical_value).encode('utf-8', 'surrogatepass'))
+    for each_digest in digests:
+        digest.update(each_digest)
+    return digest.digest()
+
+
+def same_objects(first: Tuple[Any, ...], second: Tuple[Any, ...]) -> bool:
+    """ Returns whether two tuples hold the very same objects. Used to tell
+    whether a remembered content digest is still up to date, as comparing
+    the objects by identity costs nothing compared to working it out. """
+
+    return len(first) == len(second) and all(x is y for x, y in zip(first, second))
+
+
 def _get_url_reliably(url: str, wait_time: float = 10, raw: bool = False, timeout: int = 10, retries: int = 2):
     """ Attempts to load data from a URL, retrying the specified number of times with an exponential
     backoff if rate limited. Fails immediately on 4xx errors that are not 403."""
@@ -242,6 +370,15 @@ def _interpret_file(the_file: Union[str, IO]) -> StringIO:
     return StringIO(buffer.read().decode().replace("\r\n", "\n").replace("\r", "\n"))
 
 
+def check_not_frozen(nmrstar_object: Union['pynmrstar.Entry', 'pynmrstar.Saveframe', 'pynmrstar.Loop']) -> None:
+    """ Raises an InvalidStateError if the object has been frozen, and
+    therefore can't be modified. """
+
+    if nmrstar_object._frozen:
+        raise InvalidStateError(f"{nmrstar_object!r} is frozen (read-only), so it can't be modified. Use clone() to "
+                                f"get a copy which can be.")
+
+
 def get_clean_tag_list(item: Union[str, List[str], Tuple[str]]) -> List[Dict[str, str]]:
     """ Converts the provided item to a list of dictionaries of
     {
@@ -276,16 +413,25 @@ def write_to_file(nmrstar_object: Union['pynmrstar.Entry', 'pynmrstar.Saveframe'
                   skip_empty_tags: bool = False):
     """ Writes the object to the specified file in NMR-STAR format. """
 
-    if format_ not in ["nmrstar", "json"]:
+    if format_ not in ["nmrstar", "json", "binary"]:
         raise ValueError("Invalid output format.")
 
-    data_to_write = ''
-    if format_ == "nmrstar":
-        data_to_write = nmrstar_object.format(show_comments=show_comments,
-                                              skip_empty_loops=skip_empty_loops,
-                                              skip_empty_tags=skip_empty_tags)
-    elif format_ == "json":
-        data_to_write = nmrstar_object.get_json()
+    if format_ == "binary":
+        if not isinstance(nmrstar_object, pynmrstar.Entry):
+            raise ValueError("Only entries can be written in the binary format.")
+        with open(file_name, "wb") as out_file:
+            out_file.write(pynmrstar.shared.encode_entries([nmrstar_object]))
+        return
+
+    if format_ == "json":
+        # Written in pieces, so that the JSON of the whole object is never in memory at once
+        with open(file_name, "w") as out_file:
+            out_file.writelines(nmrstar_object.iter_json())
+        return
+
+    data_to_write = nmrstar_object.format(show_comments=show_comments,
+                                          skip_empty_loops=skip_empty_loops,
+                                          skip_empty_tags=skip_empty_tags)
 
     out_file = open(file_name, "w")
     out_file.write(data_to_write)
@@ -0,0 +1,146 @@
+""" Loops as Apache Arrow tables, exchanged through the Arrow C data
+interface so that neither pyarrow nor any other Arrow library is needed.
+See :py:meth:`pynmrstar.Loop.to_arrow`, :py:meth:`pynmrstar.Loop.from_arrow`
+and :py:meth:`pynmrstar.Entry.to_arrow_tables`. """
+
+import decimal
+from datetime import date
+from typing import Any, Dict, List, Optional, Sequence, Tuple
+
+from pynmrstar import cnmrstar, loop as loop_mod, utils
+from pynmrstar.columns import ColumnRows
+from pynmrstar.schema import Schema
+
+# The kind of column cnmrstar.arrow_export() makes for each type the schema converts values to
+_KINDS: Dict[type, int] = {str: 0, int: 1, decimal.Decimal: 2, date: 3}
+# The key of the table metadata which has the category
+CATEGORY_KEY: str = 'pynmrstar.category'
+
+
+class ArrowTable(object):
+    """ The values of one or more loops of a category, as an Arrow table.
+    The values are copied into Arrow's column layout once, and then handed
+    to any library which supports the Arrow PyCapsule interface without
+    being copied again::
+
+        pyarrow.table(table)
+        polars.DataFrame(table)
+
+    Null values ('.', '?', '' and None) are nulls in the table. Tags the
+    schema defines as integers, floats, or dates are columns of those
+    types, unless one of their values can't be read as one, in which case
+    the column has the values as strings. """
+
+    __slots__ = ('category', '_table')
+
+    def __init__(self, category: Optional[str], table: 'cnmrstar.ArrowTable') -> None:
+        """ You should normally use :py:meth:`pynmrstar.Loop.to_arrow` instead. """
+
+        self.category: Optional[str] = category
+        self._table: 'cnmrstar.ArrowTable' = table
+
+    def __arrow_c_schema__(self) -> Any:
+        return self._table.__arrow_c_schema__()
+
+    def __arrow_c_array__(self, requested_schema: Any = None) -> Tuple[Any, Any]:
+        return self._table.__arrow_c_array__(requested_schema)
+
+    def __arrow_c_stream__(self, requested_schema: Any = None) -> Any:
+        return self._table.__arrow_c_stream__(requested_schema)
+
+    def __len__(self) -> int:
+        return self._table.num_rows
+
+    def __repr__(self) -> str:
+        return f"<pynmrstar.arrow.ArrowTable '{self.category}': {self._table.num_rows} rows, " \
+               f"{len(self._table.column_names)} columns>"
+
+    @property
+    def column_names(self) -> List[str]:
+        """ The names of the columns, which are the tag names without the
+        category. """
+
+        return self._table.column_names
+
+    @property
+    def num_rows(self) -> int:
+        return self._table.num_rows
+
+    def to_pandas(self) -> Any:
+        """ Returns the table as a pandas DataFrame. Requires pyarrow. """
+
+        return self.to_pyarrow().to_pandas()
+
+    def to_polars(self) -> Any:
+        """ Returns the table as a polars DataFrame. """
+
+        import polars
+
+        return polars.DataFrame(self)
+
+    def to_pyarrow(self) -> Any:
+        """ Returns the table as a pyarrow Table. """
+
+        import pyarrow
+
+        return pyarrow.table(self)
+
+
+def _kind(schema: Optional[Schema], tag: str) -> int:
+    """ Returns the kind of column for a full tag name. Tags which aren't
+    in the schema are strings. """
+
+    if schema is None:
+        return _KINDS[str]
+    try:
+        return _KINDS.get(schema._python_type(tag), _KINDS[str])
+    except KeyError:
+        return _KINDS[str]
+
+
+def export_loops(loops: Sequence['loop_mod.Loop'], schema: Schema = None, convert_data_types: bool = True) -> ArrowTable:
+    """ Returns the values of loops of the same category as one table, with
+    the rows of each loop in turn. The table has a column for each tag in
+    any of the loops, in the order they first appear, and the rows of a
+    loop without one of the tags have nulls for it. """
+
+    tags: List[str] = []
+    positions: Dict[str, int] = {}
+    for loop in loops:
+        loop._check_tags_match_data()
+        for tag in loop._tags:
+            if tag.lower() not in positions:
+                positions[tag.lower()] = len(tags)
+                tags.append(tag)
+
+    sources = []
+    for loop in loops:
+        loop_positions = [-1] * len(tags)
+        for position, tag in enumerate(loop._tags):
+            loop_positions[positions[tag.lower()]] = position
+        sources.append((loop._stored_data(), loop_positions))
+
+    category = loops[0].category if loops else None
+    if convert_data_types:
+        schema = utils.get_schema(schema)
+    kinds = [_kind(schema if convert_data_types else None, f"{category}.{tag}") for tag in tags]
+    if category is None:
+        table = cnmrstar.arrow_export(sources, tags, kinds, ColumnRows)
+    else:
+        table = cnmrstar.arrow_export(sources, tags, kinds, ColumnRows, CATEGORY_KEY, category)
+    return ArrowTable(category, table)
+
+
+def import_table(data: Any) -> Tuple[List[str], 'cnmrstar.LoopValues', Optional[str]]:
+    """ Returns the column names, the values, and the category (if the
+    table has one in its metadata) of any object which supports the Arrow
+    PyCapsule interface. """
+
+    if hasattr(data, '__arrow_c_stream__'):
+        names, values, metadata = cnmrstar.arrow_import_stream(data.__arrow_c_stream__())
+    elif hasattr(data, '__arrow_c_array__'):
+        names, values, metadata = cnmrstar.arrow_import(*data.__arrow_c_array__())
+    else:
+        raise ValueError(f"The data must support the Arrow PyCapsule interface, such as a pyarrow Table or "
+                         f"RecordBatch, or a polars DataFrame. Invalid data: {data.__class__.__name__}")
+    return names, values, metadata.get(CATEGORY_KEY)
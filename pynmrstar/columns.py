@@ -0,0 +1,266 @@
+""" Compact column storage for loops. See :py:meth:`pynmrstar.Loop.make_categorical`. """
+
+import sys
+from array import array
+from itertools import compress, repeat
+from operator import eq, itemgetter
+from collections.abc import Sequence as SequenceABC
+from typing import Any, Dict, Iterable, Iterator, List, Optional, Sequence, Tuple, Union
+
+from pynmrstar import definitions
+
+try:
+    from pickle import PickleBuffer
+except ImportError:
+    # Python 3.7
+    PickleBuffer = None
+
+# The settings which column statistics depend on, as of when they last changed, and how many times they have changed
+_stats_settings: List[Any] = [None, None]
+_stats_generation: int = 0
+
+
+class CategoricalColumn(object):
+    """ An immutable column of values, stored as small integer codes into a
+    table of the distinct values in the column. Columns such as Comp_ID or
+    Atom_ID only have a few dozen distinct values, so this takes a fraction
+    of the memory of a list, and operations that compare values (sorting,
+    filtering, grouping) only need to look at each distinct value once. """
+
+    __slots__ = ('values', 'codes', '_index')
+
+    def __init__(self, values: Tuple[Any, ...], codes: array) -> None:
+        """ You should normally use :py:meth:`CategoricalColumn.from_values`
+        instead. values is the table of distinct values, and codes the
+        position in that table of each value in the column. """
+
+        self.values: Tuple[Any, ...] = values
+        self.codes: array = codes
+        self._index: Optional[Dict[Any, int]] = None
+
+    def __eq__(self, other) -> bool:
+        if not isinstance(other, CategoricalColumn):
+            return NotImplemented
+        if self.values == other.values:
+            return self.codes == other.codes
+        return list(self) == list(other)
+
+    def __getitem__(self, item: Union[int, slice]) -> Any:
+        if isinstance(item, slice):
+            return [self.values[_] for _ in self.codes[item]]
+        return self.values[self.codes[item]]
+
+    def __iter__(self) -> Iterator[Any]:
+        return map(self.values.__getitem__, self.codes)
+
+    def __len__(self) -> int:
+        return len(self.codes)
+
+    def __repr__(self) -> str:
+        return f"<pynmrstar.columns.CategoricalColumn of {len(self.codes)} values, {len(self.values)} distinct>"
+
+    def __reduce_ex__(self, protocol: int) -> tuple:
+        """ The codes are pickled as a raw buffer. With pickle protocol 5,
+        they can be passed out-of-band (see pickle.PickleBuffer) rather than
+        copied into the pickle. """
+
+        if protocol >= 5 and PickleBuffer is not None:
+            codes = PickleBuffer(self.codes)
+        else:
+            codes = self.codes.tobytes()
+        return _restore_categorical, (self.values, self.codes.typecode, codes)
+
+    @classmethod
+    def from_values(cls, column: Iterable[Any], max_distinct: int = None) -> Optional['CategoricalColumn']:
+        """ Encodes a column of values. Returns None if the column has more
+        than max_distinct distinct values, or contains values other than
+        strings and None. (Other types, such as Decimal, can compare equal
+        while printing differently, so they can't share a table entry.) """
+
+        index: Dict[Any, int] = {}
+        codes: List[int] = []
+        for value in column:
+            if value is not None and value.__class__ is not str:
+                return None
+            code = index.get(value)
+            if code is None:
+                code = index[value] = len(index)
+                if max_distinct is not None and code >= max_distinct:
+                    return None
+            codes.append(code)
+
+        return cls(tuple(index), array(cls._typecode(len(index)), codes))
+
+    @staticmethod
+    def _typecode(num_values: int) -> str:
+        """ Returns the smallest array type which can hold the codes. """
+
+        if num_values <= 1 << 8:
+            return 'B'
+        if num_values <= 1 << 16:
+            return 'H'
+        return 'L'
+
+    def code_of(self, value: Any) -> Optional[int]:
+        """ Returns the code of a value, or None if the column doesn't
+        contain the value. """
+
+        if self._index is None:
+            self._index = {value: code for code, value in enumerate(self.values)}
+        try:
+            return self._index.get(value)
+        except TypeError:
+            # Not hashable, so not in the column
+            return None
+
+    def nbytes(self) -> int:
+        """ Returns the memory used by the column, not counting the memory
+        used by the distinct values themselves. """
+
+        return sys.getsizeof(self) + sys.getsizeof(self.values) + sys.getsizeof(self.codes)
+
+    def take(self, positions: Sequence[int]) -> 'CategoricalColumn':
+        """ Returns a new column of the values at the given positions. The
+        table of values is shared with this column. """
+
+        codes = _gather(self.codes, positions)
+        if self.codes.typecode == 'B':
+            # Much faster than adding the codes to the array one at a time
+            codes = bytes(codes)
+        result = CategoricalColumn(self.values, array(self.codes.typecode, codes))
+        result._index = self._index
+        return result
+
+    def used_codes(self) -> List[int]:
+        """ Returns the codes which appear in the column. (A column made by
+        take() shares the table of values, so some might not.) """
+
+        if len(self.codes) == 0:
+            return []
+        if len(self.values) == 1:
+            return [0]
+        return list(set(self.codes))
+
+
+def _restore_categorical(values: Tuple[Any, ...], typecode: str, codes: Any) -> CategoricalColumn:
+    """ Unpickles a categorical column. codes is any buffer of the raw codes. """
+
+    restored = array(typecode)
+    restored.frombytes(codes)
+    return CategoricalColumn(values, restored)
+
+
+class ColumnStats(object):
+    """ What is known about the values of one column of a loop: how many of
+    them are null, and the width of the column when printed (the widest
+    quoted value which fits on one line, plus padding). Either is None when
+    it isn't known. The methods which modify a loop keep these up to date,
+    so checking whether a loop is empty, or printing it, doesn't have to
+    look at every value again. """
+
+    __slots__ = ('nulls', 'width')
+
+    def __init__(self, nulls: Optional[int] = None, width: Optional[int] = None) -> None:
+        self.nulls: Optional[int] = nulls
+        self.width: Optional[int] = width
+
+    def __repr__(self) -> str:
+        return f"<pynmrstar.columns.ColumnStats nulls={self.nulls} width={self.width}>"
+
+    def copy(self) -> 'ColumnStats':
+        return ColumnStats(self.nulls, self.width)
+
+
+def stats_generation() -> int:
+    """ Returns a number which changes whenever definitions.NULL_VALUES or
+    definitions.STR_CONVERSION_DICT are changed, as the column statistics
+    depend on them. Statistics from an earlier generation are discarded. """
+
+    global _stats_generation
+
+    if _stats_settings[0] != definitions.NULL_VALUES or _stats_settings[1] != definitions.STR_CONVERSION_DICT:
+        _stats_settings[0] = list(definitions.NULL_VALUES)
+        _stats_settings[1] = dict(definitions.STR_CONVERSION_DICT)
+        _stats_generation += 1
+    return _stats_generation
+
+
+def count_nulls(column: Iterable[Any]) -> int:
+    """ Returns how many of the values of any column are null. For a
+    categorical column, only the codes of the null values are counted. """
+
+    null_values = []
+    for value in definitions.NULL_VALUES:
+        if value not in null_values:
+            null_values.append(value)
+
+    if isinstance(column, CategoricalColumn):
+        codes = column.codes
+        return sum(codes.count(code) for code, value in enumerate(column.values) if value in null_values)
+
+    # list.count() compares the values the same way "in" does, but without going through Python for each one
+    if not isinstance(column, (list, tuple)):
+        column = list(column)
+    return sum(column.count(_) for _ in null_values)
+
+
+class ColumnRows(SequenceABC):
+    """ A read-only sequence of the rows of a list of columns. Each row is
+    created as a tuple when it is accessed. This is what Loop.data returns
+    for a frozen loop. """
+
+    __slots__ = ('_columns',)
+
+    def __init__(self, columns: Sequence[Sequence[Any]]) -> None:
+        self._columns: Sequence[Sequence[Any]] = columns
+
+    def __eq__(self, other) -> bool:
+        if not isinstance(other, (ColumnRows, list, tuple)):
+            return NotImplemented
+        return len(self) == len(other) and all(list(a) == list(b) for a, b in zip(self, other))
+
+    def __getitem__(self, item: Union[int, slice]) -> Union[Tuple[Any, ...], List[Tuple[Any, ...]]]:
+        if isinstance(item, slice):
+            return list(zip(*[column[item] for column in self._columns]))
+        return tuple([column[item] for column in self._columns])
+
+    def __iter__(self) -> Iterator[Tuple[Any, ...]]:
+        return zip(*self._columns)
+
+    def __len__(self) -> int:
+        return len(self._columns[0]) if self._columns else 0
+
+    def __repr__(self) -> str:
+        return repr(list(self))
+
+
+def _gather(sequence: Sequence[Any], positions: Sequence[int]) -> Tuple[Any, ...]:
+    """ Returns a tuple of the items at the given positions of a sequence. """
+
+    if len(positions) > 1:
+        return itemgetter(*positions)(sequence)
+    return tuple([sequence[_] for _ in positions])
+
+
+def positions_of(column: Sequence[Any], value: Any) -> List[int]:
+    """ Returns the positions in any column which are equal to the value.
+    For a categorical column, only the codes are compared. """
+
+    if isinstance(column, CategoricalColumn):
+        code = column.code_of(value)
+        if code is None:
+            # The value may still be equal to one of the values without being the same type
+            codes = [code for code, _ in enumerate(column.values) if _ == value]
+            if len(codes) != 1:
+                return list(compress(range(len(column)), map(set(codes).__contains__, column.codes)))
+            code = codes[0]
+        return list(compress(range(len(column)), map(code.__eq__, column.codes)))
+    return list(compress(range(len(column)), map(eq, column, repeat(value))))
+
+
+def take(column: Sequence[Any], positions: Sequence[int]) -> Sequence[Any]:
+    """ Returns the values at the given positions of any column. """
+
+    if isinstance(column, CategoricalColumn):
+        return column.take(positions)
+    return _gather(column, positions)
@@ -18,12 +18,19 @@ WARNINGS:
    The only exception is if you set STR_CONVERSION_DICT before performing any
    actions which would call quote_value() - which include calling __str__ or
    format() on Entry, Saveframe, and Loop objects.
+
+Files are tokenized using up to PARSE_THREADS threads, but each thread is only
+used if it would have at least PARSE_CHUNK_SIZE characters to tokenize.
 """
 
+import os
+
 NULL_VALUES = ['', ".", "?", None]
 WHITESPACE: str = " \t\n\v"
 RESERVED_KEYWORDS = ["data_", "save_", "loop_", "stop_", "global_"]
 STR_CONVERSION_DICT: dict = {None: "."}
+PARSE_THREADS: int = os.cpu_count() or 1
+PARSE_CHUNK_SIZE: int = 4 * 1024 * 1024
 
 API_URL: str = "https://api.bmrb.io/v2"
 SCHEMA_URL: str = 'https://raw.githubusercontent.com/uwbmrb/nmr-star-dictionary/master/xlschem_ann.csv'
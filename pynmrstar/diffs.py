@@ -0,0 +1,153 @@
+""" Row level differences between two loops. See :py:meth:`pynmrstar.Loop.diff`. """
+
+from operator import itemgetter
+from typing import Any, Callable, Dict, List, NamedTuple, Optional, Sequence, Tuple
+
+
+class ModifiedRow(NamedTuple):
+    """ A row with the same key in both loops, but different values. old is
+    the row in the first loop and new the row in the second loop, key the
+    values of the key tags, and changes the (tag, old value, new value) of
+    each tag whose value differs. """
+
+    old: List[Any]
+    new: List[Any]
+    key: Tuple[Any, ...]
+    changes: List[Tuple[str, Any, Any]]
+
+
+class LoopDiff(object):
+    """ The differences between the rows of two loops, as returned by
+    :py:meth:`pynmrstar.Loop.diff`. True if there are any differences.
+
+    deleted has the rows only in the first loop (with the tags of the
+    first loop), inserted the rows only in the second loop (with the tags
+    of the second loop), and modified a :py:class:`ModifiedRow` for each
+    row whose key is in both loops but whose other values differ. Only the
+    tags in both loops (tags) are compared; the others are listed in
+    removed_tags and added_tags. """
+
+    __slots__ = ('category', 'key', 'tags', 'removed_tags', 'added_tags', 'deleted', 'inserted', 'modified')
+
+    def __init__(self, category: Optional[str], key: List[str], tags: List[str], removed_tags: List[str],
+                 added_tags: List[str]) -> None:
+        self.category: Optional[str] = category
+        self.key: List[str] = key
+        self.tags: List[str] = tags
+        self.removed_tags: List[str] = removed_tags
+        self.added_tags: List[str] = added_tags
+        self.deleted: List[List[Any]] = []
+        self.inserted: List[List[Any]] = []
+        self.modified: List[ModifiedRow] = []
+
+    def __bool__(self) -> bool:
+        return bool(self.removed_tags or self.added_tags or self.deleted or self.inserted or self.modified)
+
+    def __repr__(self) -> str:
+        return f"<pynmrstar.diffs.LoopDiff '{self.category}': {len(self.inserted)} inserted, {len(self.deleted)} " \
+               f"deleted, {len(self.modified)} modified rows>"
+
+    def __str__(self) -> str:
+        """ Returns a readable report of the differences, one per line. """
+
+        return "\n".join(self.lines())
+
+    def lines(self, indent: str = "") -> List[str]:
+        """ Returns a readable report of the differences as a list of
+        lines, each starting with indent. Deleted rows are marked with -,
+        inserted rows with +, and modified rows with ~ (followed by the
+        values of the key tags, and the changed values). """
+
+        lines = [f"{indent}Rows of loop '{self.category}' inserted: {len(self.inserted)}, deleted: "
+                 f"{len(self.deleted)}, modified: {len(self.modified)}."]
+        if self.removed_tags:
+            lines.append(f"{indent}\tTags only in the first loop: {', '.join(self.removed_tags)}")
+        if self.added_tags:
+            lines.append(f"{indent}\tTags only in the second loop: {', '.join(self.added_tags)}")
+        for row in self.deleted:
+            lines.append(f"{indent}\t- {row}")
+        for row in self.inserted:
+            lines.append(f"{indent}\t+ {row}")
+
+        for modified in self.modified:
+            key = ', '.join(f"{tag}={value!r}" for tag, value in zip(self.key, modified.key))
+            changes = ', '.join(f"{tag} {old!r} -> {new!r}" for tag, old, new in modified.changes)
+            lines.append(f"{indent}\t~ {key}: {changes}")
+        return lines
+
+
+def _positions(tags: Sequence[str], wanted: Sequence[str]) -> List[int]:
+    """ Returns the position of each of the wanted tags among the tags,
+    ignoring case. """
+
+    positions = {}
+    for position, tag in enumerate(tags):
+        positions.setdefault(tag.lower(), position)
+    return [positions[_.lower()] for _ in wanted]
+
+
+def _projector(positions: List[int]) -> Callable[[Sequence[Any]], Tuple[Any, ...]]:
+    """ Returns a function which returns the values at the given positions
+    of a row as a tuple. """
+
+    if len(positions) == 1:
+        position = positions[0]
+        return lambda row: (row[position],)
+    if not positions:
+        return lambda row: ()
+    return itemgetter(*positions)
+
+
+def diff_rows(category: Optional[str], old_tags: Sequence[str], old_rows: Sequence[Sequence[Any]],
+              new_tags: Sequence[str], new_rows: Sequence[Sequence[Any]], key: Optional[List[str]] = None) -> LoopDiff:
+    """ Compares the rows of two loops in linear time. Each row is reduced
+    to a tuple of its values for the tags in both loops, and looked up by
+    its values for the key tags (or all of them, if no key is given) in a
+    dictionary. Rows with the same key are paired in the order they
+    appear. """
+
+    new_tags_lc = {_.lower() for _ in new_tags}
+    old_tags_lc = {_.lower() for _ in old_tags}
+    tags = [_ for _ in old_tags if _.lower() in new_tags_lc]
+    result = LoopDiff(category, [], tags, [_ for _ in old_tags if _.lower() not in new_tags_lc],
+                      [_ for _ in new_tags if _.lower() not in old_tags_lc])
+
+    if key is None:
+        key = tags
+    else:
+        key_lc = [_.lower() for _ in key]
+        missing = [tag for tag, tag_lc in zip(key, key_lc) if tag_lc not in old_tags_lc or tag_lc not in new_tags_lc]
+        if missing:
+            raise ValueError(f"The key tags must be in both loops. Missing: {', '.join(missing)}")
+        # Use the capitalization of the tags in the first loop
+        key = result.key = [tags[_] for _ in _positions(tags, key_lc)]
+
+    old_values = _projector(_positions(old_tags, tags))
+    new_values = _projector(_positions(new_tags, tags))
+    old_key = _projector(_positions(old_tags, key))
+    new_key = _projector(_positions(new_tags, key))
+
+    # The positions of the old rows with each key, in the order they appear
+    old_by_key: Dict[Tuple[Any, ...], List[int]] = {}
+    for position, row in enumerate(old_rows):
+        old_by_key.setdefault(old_key(row), []).append(position)
+
+    matched = [False] * len(old_rows)
+    used: Dict[Tuple[Any, ...], int] = {}
+    for row in new_rows:
+        row_key = new_key(row)
+        positions = old_by_key.get(row_key)
+        count = used.get(row_key, 0)
+        if positions is None or count == len(positions):
+            result.inserted.append(list(row))
+            continue
+        used[row_key] = count + 1
+        position = positions[count]
+        matched[position] = True
+        old_row, new_row = old_values(old_rows[position]), new_values(row)
+        if old_row != new_row:
+            result.modified.append(ModifiedRow(list(old_rows[position]), list(row), row_key,
+                                               [(tag, a, b) for tag, a, b in zip(tags, old_row, new_row) if a != b]))
+
+    result.deleted = [list(row) for row, was_matched in zip(old_rows, matched) if not was_matched]
+    return result
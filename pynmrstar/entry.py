@@ -1,18 +1,36 @@
+import asyncio
+import functools
 import hashlib
-import json
 import logging
+import os
 import warnings
 from io import StringIO
-from typing import TextIO, BinaryIO, Union, List, Optional, Dict, Any, Tuple
+from typing import TextIO, BinaryIO, Union, List, Optional, Dict, Any, Iterator, Tuple
 
-from pynmrstar import definitions, utils, loop as loop_mod, parser as parser_mod, saveframe as saveframe_mod
-from pynmrstar._internal import _json_serialize, _interpret_file, _get_entry_from_database, write_to_file
+from pynmrstar import arrow, cnmrstar, definitions, utils, loop as loop_mod, parser as parser_mod, saveframe as saveframe_mod, \
+    shared
+from pynmrstar._internal import _interpret_file, _get_entry_from_database, check_not_frozen, content_digest, \
+    dump_json, load_json, same_objects, write_to_file
 from pynmrstar.exceptions import InvalidStateError
 from pynmrstar.schema import Schema
 
 logger = logging.getLogger('pynmrstar')
 
 
+def _restore_entry(entry_id: Union[str, int], frame_list: List['saveframe_mod.Saveframe'], frozen: bool,
+                   source: Optional[str]) -> 'Entry':
+    """ Unpickles an entry pickled by Entry.__reduce_ex__(). """
+
+    entry = Entry.__new__(Entry)
+    entry._entry_id = entry_id
+    entry._frame_list = tuple(frame_list) if frozen else frame_list
+    entry.source = source
+    entry._frozen = frozen
+    entry._hash = None
+    entry._digest = None
+    return entry
+
+
 class Entry(object):
     """An object oriented representation of a BMRB entry. You can initialize this
     object several ways; (e.g. from a file, from the official database,
@@ -48,6 +66,8 @@ class Entry(object):
     def __delitem__(self, item: Union['saveframe_mod.Saveframe', int, str]) -> None:
         """Remove the indicated saveframe."""
 
+        check_not_frozen(self)
+
         if isinstance(item, int):
             try:
                 del self._frame_list[item]
@@ -63,7 +83,12 @@ class Entry(object):
         if not isinstance(other, Entry):
             return False
 
-        return (self.entry_id, self._frame_list) == (other.entry_id, other._frame_list)
+        # Only use the digests if both were worked out before, as working them out takes longer than comparing
+        if self._digest is not None and other._digest is not None and \
+                self._content_digest() == other._content_digest():
+            return True
+
+        return (self.entry_id, list(self._frame_list)) == (other.entry_id, list(other._frame_list))
 
     def __getitem__(self, item: Union[int, str]) -> 'saveframe_mod.Saveframe':
         """Get the indicated saveframe."""
@@ -73,6 +98,15 @@ class Entry(object):
         except TypeError:
             return self.get_saveframe_by_name(item)
 
+    def __hash__(self) -> int:
+        """ Only frozen entries are hashable. See :py:meth:`Entry.freeze`. """
+
+        if not self._frozen:
+            raise TypeError(f"{self!r} isn't frozen, so it isn't hashable. See Entry.freeze().")
+        if self._hash is None:
+            self._hash = hash((self.entry_id, self._frame_list))
+        return self._hash
+
     def __init__(self, **kwargs) -> None:
         """ You should not directly instantiate an Entry using this method.
             Instead use the class methods:
@@ -85,6 +119,11 @@ class Entry(object):
         self._entry_id: Union[str, int] = 0
         self._frame_list: List[saveframe_mod.Saveframe] = []
         self.source: Optional[str] = None
+        # See Entry.freeze()
+        self._frozen: bool = False
+        self._hash: Optional[int] = None
+        # What the content digest was worked out from, and the digest, see Entry._content_digest()
+        self._digest: Optional[Tuple[tuple, bytes]] = None
 
         # They initialized us wrong
         if len(kwargs) == 0:
@@ -129,7 +168,10 @@ class Entry(object):
         # Load the BMRB entry from the file
         parser: parser_mod.Parser = parser_mod.Parser(entry_to_parse_into=self)
         parser.parse(star_buffer.read(), source=self.source, convert_data_types=kwargs.get('convert_data_types', False),
-                     raise_parse_warnings=kwargs.get('raise_parse_warnings', False))
+                     raise_parse_warnings=kwargs.get('raise_parse_warnings', False),
+                     lazy=kwargs.get('lazy', False) or kwargs.get('readonly', False))
+        if kwargs.get('readonly', False):
+            self.freeze()
 
     def __iter__(self) -> saveframe_mod.Saveframe:
         """ Yields each of the saveframes contained within the entry. """
@@ -147,9 +189,26 @@ class Entry(object):
 
         return f"<pynmrstar.Entry '{self._entry_id}' {self.source}>"
 
+    def __reduce_ex__(self, protocol: int) -> tuple:
+        """ Pickles (and copies) the entry. The hash isn't kept, as str
+        hashes differ between processes. """
+
+        return _restore_entry, (self._entry_id, list(self._frame_list), self._frozen, self.source)
+
+    def __setstate__(self, state: dict) -> None:
+        """ Restores entries pickled by older versions, which pickled the
+        attributes of the entry. """
+
+        state.setdefault('_frozen', False)
+        state.setdefault('_hash', None)
+        state.setdefault('_digest', None)
+        self.__dict__.update(state)
+
     def __setitem__(self, key: Union[int, str], item: 'saveframe_mod.Saveframe') -> None:
         """Set the indicated saveframe."""
 
+        check_not_frozen(self)
+
         # It is a saveframe
         if isinstance(item, saveframe_mod.Saveframe):
             # Add by ordinal
@@ -228,6 +287,7 @@ class Entry(object):
 
     @entry_id.setter
     def entry_id(self, value: Union[str, int]) -> None:
+        check_not_frozen(self)
         self._entry_id = value
 
         schema = utils.get_schema()
@@ -307,7 +367,9 @@ class Entry(object):
                   the_file: Union[str, TextIO, BinaryIO],
                   convert_data_types: bool = False,
                   raise_parse_warnings: bool = False,
-                  schema: Schema = None):
+                  schema: Schema = None,
+                  lazy: bool = False,
+                  readonly: bool = False):
         """Create an entry by loading in a file. If the_file starts with
         http://, https://, or ftp:// then we will use those protocols to
         attempt to open the file.
@@ -325,12 +387,33 @@ class Entry(object):
 
         Setting raise_parse_warnings to True will result in the raising of a
         ParsingError rather than logging a warning when non-valid (but
-        ignorable) issues are found. """
+        ignorable) issues are found.
+
+        Setting lazy to True keeps the values of loops as positions within
+        the parsed data, and only creates the values when they are accessed.
+        This saves a lot of memory when only part of a large entry is looked
+        at, and writing unmodified loops back out quotes the values straight
+        from the parsed data. Accessing Loop.data creates all of the values
+        of that loop. Ignored if convert_data_types is set.
+
+        Setting readonly to True returns a frozen entry, see
+        :py:meth:`Entry.freeze`. The loop values go straight from the parsed
+        data into columns, without ever being stored as rows.
+
+        Files written in the binary format (see :py:meth:`Entry.write_to_file`)
+        aren't parsed. They are memory-mapped, and the values of each loop are
+        only decoded when they are accessed."""
+
+        if shared.is_binary_file(the_file):
+            return shared.read_binary_file(the_file, convert_data_types=convert_data_types, schema=schema,
+                                           readonly=readonly)
 
         return cls(file_name=the_file,
                    convert_data_types=convert_data_types,
                    raise_parse_warnings=raise_parse_warnings,
-                   schema=schema)
+                   schema=schema,
+                   lazy=lazy,
+                   readonly=readonly)
 
     @classmethod
     def from_json(cls, json_dict: Union[dict, str]):
@@ -339,7 +422,7 @@ class Entry(object):
         # If they provided a string, try to load it using JSON
         if not isinstance(json_dict, dict):
             try:
-                json_dict = json.loads(json_dict)
+                json_dict = load_json(json_dict)
             except (TypeError, ValueError):
                 raise ValueError("The JSON you provided was neither a Python dictionary nor a JSON string.")
 
@@ -368,7 +451,9 @@ class Entry(object):
                     the_string: str,
                     convert_data_types: bool = False,
                     raise_parse_warnings: bool = False,
-                    schema: Schema = None):
+                    schema: Schema = None,
+                    lazy: bool = False,
+                    readonly: bool = False):
         """Create an entry by parsing a string.
 
 
@@ -385,12 +470,74 @@ class Entry(object):
 
         Setting raise_parse_warnings to True will result in the raising of a
         ParsingError rather than logging a warning when non-valid (but
-        ignorable) issues are found."""
+        ignorable) issues are found.
+
+        See :py:meth:`Entry.from_file` for the meaning of lazy and readonly."""
 
         return cls(the_string=the_string,
                    convert_data_types=convert_data_types,
                    raise_parse_warnings=raise_parse_warnings,
-                   schema=schema)
+                   schema=schema,
+                   lazy=lazy,
+                   readonly=readonly)
+
+    @classmethod
+    async def from_file_async(cls,
+                              the_file: Union[str, TextIO, BinaryIO],
+                              convert_data_types: bool = False,
+                              raise_parse_warnings: bool = False,
+                              schema: Schema = None,
+                              yield_control: bool = True):
+        """The same as :py:meth:`Entry.from_file`, but as a coroutine for
+        use with asyncio. The file is read and tokenized in the event loop's
+        default executor with the GIL released, so other tasks keep running
+        in the meantime.
+
+        The entry is then built in the event loop's thread. Unless
+        yield_control is set to False, control is returned to the event loop
+        after each saveframe is built so that large entries don't block
+        other tasks."""
+
+        read_file = functools.partial(utils._read_file, the_file, definitions.PARSE_THREADS)
+        token_stream = await asyncio.get_running_loop().run_in_executor(None, read_file)
+        if token_stream is None:
+            return shared.read_binary_file(the_file, convert_data_types=convert_data_types, schema=schema)
+        return await cls._from_tokens_async(token_stream, f"from_file('{the_file}')", yield_control,
+                                            convert_data_types=convert_data_types,
+                                            raise_parse_warnings=raise_parse_warnings,
+                                            schema=schema)
+
+    @classmethod
+    async def from_string_async(cls,
+                                the_string: str,
+                                convert_data_types: bool = False,
+                                raise_parse_warnings: bool = False,
+                                schema: Schema = None,
+                                yield_control: bool = True):
+        """The same as :py:meth:`Entry.from_string`, but as a coroutine for
+        use with asyncio. See :py:meth:`Entry.from_file_async` for details."""
+
+        tokenize = functools.partial(cnmrstar.tokenize, the_string, definitions.PARSE_THREADS,
+                                     definitions.PARSE_CHUNK_SIZE)
+        token_stream = await asyncio.get_running_loop().run_in_executor(None, tokenize)
+        return await cls._from_tokens_async(token_stream, "from_string()", yield_control,
+                                            convert_data_types=convert_data_types,
+                                            raise_parse_warnings=raise_parse_warnings,
+                                            schema=schema)
+
+    @classmethod
+    async def _from_tokens_async(cls, token_stream: 'cnmrstar.TokenStream', source: str, yield_control: bool,
+                                 **kwargs):
+        """ Builds an entry from already tokenized data, optionally letting
+        other tasks run after each saveframe."""
+
+        entry = cls.from_scratch(0)
+        entry.source = source
+        parser = parser_mod.Parser(entry_to_parse_into=entry)
+        for _ in parser.iter_parse_tokens(token_stream, source=source, **kwargs):
+            if yield_control:
+                await asyncio.sleep(0)
+        return entry
 
     @classmethod
     def from_scratch(cls, entry_id: Union[str, int]):
@@ -426,6 +573,8 @@ class Entry(object):
     def add_saveframe(self, frame) -> None:
         """Add a saveframe to the entry."""
 
+        check_not_frozen(self)
+
         if not isinstance(frame, saveframe_mod.Saveframe):
             raise ValueError("You can only add instances of saveframes using this method. You attempted to add "
                              f"the object: '{repr(frame)}'.")
@@ -438,6 +587,21 @@ class Entry(object):
 
         self._frame_list.append(frame)
 
+    def clone(self) -> 'Entry':
+        """ Returns a copy of the entry, much faster than copy.deepcopy().
+        The saveframe tags are copied, but the loops share their data with
+        the loops of this entry until either is modified, so the cost of
+        making a modified copy of an entry depends on what is modified
+        rather than on the size of the entry. See :py:meth:`Loop.clone`.
+
+        The clone of a frozen entry is not frozen, so this is also how to
+        get a modifiable copy of a frozen entry. """
+
+        result = Entry.from_scratch(self._entry_id)
+        result.source = self.source
+        result._frame_list = [_.clone() for _ in self._frame_list]
+        return result
+
     def compare(self, other) -> List[str]:
         """Returns the differences between two entries as a list.
         Non-equal entries will always be detected, but specific differences
@@ -453,14 +617,17 @@ class Entry(object):
                 return ['String was not exactly equal to entry.']
         elif not isinstance(other, Entry):
             return ['Other object is not of class Entry.']
+        # Saveframes (and loops) with the same content hash are skipped without looking at their values
+        if self._content_digest() == other._content_digest():
+            return []
         try:
             if str(self.entry_id) != str(other.entry_id):
                 diffs.append(f"Entry ID does not match between entries: '{self.entry_id}' vs '{other.entry_id}'.")
             if len(self._frame_list) != len(other.frame_list):
                 diffs.append(f"The number of saveframes in the entries are not equal: '{len(self._frame_list)}' vs "
                              f"'{len(other.frame_list)}'.")
+            other_frame_dict = other.frame_dict
             for frame in self._frame_list:
-                other_frame_dict = other.frame_dict
                 if frame.name not in other_frame_dict:
                     diffs.append(f"No saveframe with name '{frame.name}' in other entry.")
                 else:
@@ -474,10 +641,34 @@ class Entry(object):
 
         return diffs
 
+    def content_hash(self) -> str:
+        """ Returns a hash of the contents of the entry as a hex string,
+        which is the same in every process, so it can be stored to tell
+        later whether an entry changed. Entries with the same content hash
+        are equal. It is worked out from the content hashes of the
+        saveframes (see :py:meth:`pynmrstar.Saveframe.content_hash`), and
+        the hashes of the values in each loop are remembered until the loop
+        is modified, so only the first call looks at every value. """
+
+        return self._content_digest().hex()
+
+    def _content_digest(self) -> bytes:
+        """ Returns the digest for Entry.content_hash(). Like the digest of a
+        saveframe, it is remembered until the entry ID or the digest of one
+        of the saveframes changes. """
+
+        frame_digests = [_._content_digest() for _ in self._frame_list]
+        key = (self._entry_id, *frame_digests)
+        if self._digest is None or not same_objects(self._digest[0], key):
+            self._digest = (key, content_digest([self.entry_id, len(self._frame_list)], frame_digests))
+        return self._digest[1]
+
     def add_missing_tags(self, schema: Schema = None, all_tags: bool = False) -> None:
         """ Automatically adds any missing tags (according to the schema)
         to all saveframes and loops and sorts the tags. """
 
+        check_not_frozen(self)
+
         for saveframe in self._frame_list:
             saveframe.add_missing_tags(schema=schema, all_tags=all_tags)
 
@@ -498,23 +689,39 @@ class Entry(object):
         return self.__str__(skip_empty_loops=skip_empty_loops, skip_empty_tags=skip_empty_tags,
                             show_comments=show_comments)
 
+    def freeze(self) -> None:
+        """ Makes the entry immutable, for entries which are only read, such
+        as ones kept in a cache. Each loop's data is stored as columns, with
+        repetitive columns dictionary-encoded, so a frozen entry takes
+        several times less memory. Methods which would modify the entry (or
+        its saveframes and loops) raise an InvalidStateError instead, and
+        Loop.data is a read-only sequence of tuples.
+
+        A frozen entry is hashable and is safe to share between threads.
+        Copies of a frozen entry are also frozen. See :py:meth:`Loop.freeze`
+        and :py:meth:`Saveframe.freeze`."""
+
+        if self._frozen:
+            return
+
+        for saveframe in self._frame_list:
+            saveframe.freeze()
+        self._frame_list = tuple(self._frame_list)
+        self._frozen = True
+
     def get_json(self, serialize: bool = True) -> Union[dict, str]:
         """ Returns the entry in JSON format. If serialize is set to
         False a dictionary representation of the entry that is
         serializeable is returned instead."""
 
-        frames = [x.get_json(serialize=False) for x in self._frame_list]
+        if serialize:
+            return dump_json({"entry_id": self.entry_id, "saveframes": [x._json_dict() for x in self._frame_list]})
 
-        entry_dict = {
+        return {
             "entry_id": self.entry_id,
-            "saveframes": frames
+            "saveframes": [x.get_json(serialize=False) for x in self._frame_list]
         }
 
-        if serialize:
-            return json.dumps(entry_dict, default=_json_serialize)
-        else:
-            return entry_dict
-
     def get_loops_by_category(self, value: str) -> List['loop_mod.Loop']:
         """Allows fetching loops by category."""
 
@@ -583,12 +790,33 @@ class Entry(object):
 
         return results
 
+    def iter_json(self, rows_per_chunk: int = 10000) -> Iterator[str]:
+        """ Yields the entry in JSON format in pieces, which joined together
+        are the same as get_json(). The data of each loop is written
+        rows_per_chunk rows at a time, without turning a lazy or column
+        representation into rows, so that the memory used depends on the
+        chunk size rather than the size of the entry. Use this to write
+        the JSON of large entries to a file or socket::
+
+            with open('entry.json', 'w') as json_file:
+                json_file.writelines(entry.iter_json())
+        """
+
+        yield dump_json({"entry_id": self.entry_id})[:-1] + ', "saveframes": ['
+        for position, saveframe in enumerate(self._frame_list):
+            if position:
+                yield ", "
+            yield from saveframe.iter_json(rows_per_chunk)
+        yield "]}"
+
     def normalize(self, schema: Optional[Schema] = None) -> None:
         """ Sorts saveframes, loops, and tags according to the schema
         provided (or BMRB default if none provided).
 
         Also re-assigns ID tag values and updates tag links to ID values."""
 
+        check_not_frozen(self)
+
         # Assign all the ID tags, and update all links to ID tags
         my_schema = utils.get_schema(schema)
 
@@ -827,6 +1055,8 @@ class Entry(object):
         (the loops in the saveframe must also be empty for the saveframe
         to be deleted). "Empty" means no values in tags, not no tags present."""
 
+        check_not_frozen(self)
+
         self._frame_list = [_ for _ in self._frame_list if not _.empty]
 
     def remove_saveframe(self, item: Union[str, List[str], Tuple[str], 'saveframe_mod.Saveframe',
@@ -834,6 +1064,8 @@ class Entry(object):
         """ Removes one or more saveframes from the entry. You can remove saveframes either by passing the saveframe
         object itself, the saveframe name (as a string), or a list or tuple of either."""
 
+        check_not_frozen(self)
+
         parsed_list: list
         if isinstance(item, tuple):
             parsed_list = list(item)
@@ -868,6 +1100,8 @@ class Entry(object):
         """ Renames a saveframe and updates all pointers to that
         saveframe in the entry with the new name."""
 
+        check_not_frozen(self)
+
         # Strip off the starting $ in the names
         if original_name.startswith("$"):
             original_name = original_name[1:]
@@ -903,6 +1137,27 @@ class Entry(object):
                         if val == old_reference:
                             each_row[pos] = new_reference
 
+    def to_arrow_tables(self, schema: Schema = None, convert_data_types: bool = True) -> Dict[str, 'arrow.ArrowTable']:
+        """ Returns the loops of the entry as Arrow tables, one per loop
+        category, so that each category can be loaded into pyarrow, polars
+        or pandas in one step. The loops of a category are combined into
+        one table, with a column for each tag in any of them (and nulls
+        where a loop doesn't have the tag). See
+        :py:meth:`pynmrstar.Loop.to_arrow`. """
+
+        loops_by_category: Dict[str, List['loop_mod.Loop']] = {}
+        for saveframe in self._frame_list:
+            for each_loop in saveframe.loops:
+                if not each_loop.category:
+                    raise ValueError(f"Only loops with a category can be converted to Arrow tables. Saveframe: "
+                                     f"'{saveframe.name}'")
+                loops_by_category.setdefault(each_loop.category, []).append(each_loop)
+
+        if convert_data_types:
+            schema = utils.get_schema(schema)
+        return {category: arrow.export_loops(loops, schema, convert_data_types)
+                for category, loops in loops_by_category.items()}
+
     def validate(self, validate_schema: bool = True, schema: Schema = None,
                  validate_star: bool = True) -> List[str]:
         """Validate an entry in a variety of ways. Returns a list of
@@ -964,7 +1219,39 @@ class Entry(object):
         show_comments=False to disable the comments that are by default inserted. Ignored when writing json.
         skip_empty_loops=False to force printing loops with no tags at all (loops with null tags are still printed)
         skip_empty_tags=True will omit tags in the saveframes and loops which have no non-null values.
-        format_=json to write to the file in JSON format."""
+        format_=json to write to the file in JSON format.
+        format_=binary to write to the file in a binary format (usually given the extension .nmrb), which
+        :py:meth:`Entry.from_file` loads many times faster than NMR-STAR or JSON. The values are stored as the
+        strings they print as."""
 
         write_to_file(self, file_name=file_name, format_=format_, show_comments=show_comments,
                       skip_empty_loops=skip_empty_loops, skip_empty_tags=skip_empty_tags)
+
+    def write_ndjson(self, directory: str, rows_per_chunk: int = 10000) -> Dict[str, str]:
+        """ Writes the loops of the entry as newline delimited JSON, one
+        file per loop category in the given directory (which is created if
+        it doesn't exist). Each file is named after the category, so the
+        _Atom_chem_shift loops are written to Atom_chem_shift.ndjson, and
+        has one JSON object per row with the entry ID, the name of the
+        saveframe and the category of the loop, followed by the values. See
+        :py:meth:`pynmrstar.Loop.write_ndjson`.
+
+        Returns the path of the file written for each category. """
+
+        loops_by_category: Dict[str, List[Tuple[str, 'loop_mod.Loop']]] = {}
+        for saveframe in self._frame_list:
+            for each_loop in saveframe.loops:
+                if not each_loop.category:
+                    raise ValueError(f"Only loops with a category can be written as NDJSON. Saveframe: "
+                                     f"'{saveframe.name}'")
+                loops_by_category.setdefault(each_loop.category, []).append((saveframe.name, each_loop))
+
+        os.makedirs(directory, exist_ok=True)
+        paths = {}
+        for category, loops in loops_by_category.items():
+            paths[category] = os.path.join(directory, f"{category.lstrip('_')}.ndjson")
+            with open(paths[category], "w") as ndjson_file:
+                for saveframe_name, each_loop in loops:
+                    each_loop.write_ndjson(ndjson_file, entry_id=self.entry_id, saveframe=saveframe_name,
+                                           rows_per_chunk=rows_per_chunk)
+        return paths
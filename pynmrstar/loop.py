@@ -1,17 +1,62 @@
-import json
+import sys
 import warnings
+from array import array
+from collections import Counter
 from copy import deepcopy
-from csv import reader as csv_reader, writer as csv_writer
 from io import StringIO
 from itertools import chain
-from typing import TextIO, BinaryIO, Union, List, Optional, Any, Dict, Callable, Tuple
-
-from pynmrstar import definitions, utils, entry as entry_mod
-from pynmrstar._internal import _json_serialize, _interpret_file
+from typing import TextIO, BinaryIO, Union, List, Optional, Any, Dict, Callable, Tuple, Sequence, Iterator, Type, \
+    Iterable
+
+from pynmrstar import arrow, cnmrstar, definitions, diffs, rows, utils, entry as entry_mod, views
+from pynmrstar._internal import _interpret_file, check_not_frozen, content_digest, dump_csv_rows, dump_json, \
+    dump_json_rows, load_csv, load_json, same_objects
+from pynmrstar.columns import CategoricalColumn, ColumnRows, ColumnStats, count_nulls, positions_of, stats_generation, \
+    take
 from pynmrstar.exceptions import InvalidStateError
 from pynmrstar.parser import Parser
 from pynmrstar.schema import Schema
 
+# Frozen loops of the same category share one tuple of tag names
+_shared_tags: Dict[Tuple[str, ...], Tuple[str, ...]] = {}
+# The array typecode for each dtype Loop.as_array() accepts, by NumPy name, NumPy short name, or Python type name
+_ARRAY_TYPECODES: Dict[str, str] = {'float64': 'd', 'f8': 'd', 'float': 'd', 'float32': 'f', 'f4': 'f',
+                                    'int64': 'q', 'i8': 'q', 'int': 'q', 'int32': 'i', 'i4': 'i'}
+
+
+def _printed_width(quoted_values: Iterable[str]) -> int:
+    """ Returns the width of a column of quoted values when printed. Values
+    which span more than one line are printed on their own, so don't count. """
+
+    return max((len(_) for _ in quoted_values if "\n" not in _), default=1) + 3
+
+
+def _restore_loop(category: Optional[str], tags: Sequence[str], data: Optional[List[List[Any]]],
+                  columns: Optional[List[Sequence[Any]]], frozen: bool, shared_data: bool,
+                  data_digest: Optional[bytes], source: str) -> 'Loop':
+    """ Unpickles a loop pickled by Loop.__reduce_ex__(). """
+
+    loop = Loop.__new__(Loop)
+    if frozen:
+        tags = tuple(tags)
+        if len(_shared_tags) < 4096:
+            tags = _shared_tags.setdefault(tags, tags)
+        columns = tuple(columns)
+    loop._tags = tags
+    loop._data = [] if data is None else data
+    loop._shared_data = shared_data
+    loop._rows_handed_out = False
+    loop._lazy_values = None
+    loop._columns = columns
+    loop._frozen = frozen
+    loop._hash = None
+    loop._stats = None
+    loop._data_digest = data_digest
+    loop._digest = None
+    loop.category = category
+    loop.source = source
+    return loop
+
 
 class Loop(object):
     """A BMRB loop object. Create using the class methods, see below."""
@@ -40,18 +85,25 @@ class Loop(object):
         if not isinstance(other, Loop):
             return False
 
-        return (self.category, self._tags, self.data) == \
-               (other.category, other._tags, other.data)
+        # Only use the digests if both are already known, as working them out takes longer than comparing the values
+        if self._data_digest is not None and self._data_digest == other._data_digest:
+            return (self.category, list(self._tags)) == (other.category, list(other._tags))
+
+        return (self.category, list(self._tags), self._peek_data()) == \
+               (other.category, list(other._tags), other._peek_data())
 
     def __getitem__(self, item: Union[int, str, List[str], Tuple[str]]) -> list:
         """Get the indicated row from the data array."""
 
-        try:
-            return self.data[item]
-        except TypeError:
-            if isinstance(item, tuple):
-                item = list(item)
-            return self.get_tag(tags=item)
+        # Check for tag names first, so that fetching a tag doesn't create all the values of a lazy loop
+        if not isinstance(item, (str, list, tuple)):
+            try:
+                return self.data[item]
+            except TypeError:
+                pass
+        if isinstance(item, tuple):
+            item = list(item)
+        return self.get_tag(tags=item)
 
     def __init__(self, **kwargs) -> None:
         """ You should not directly instantiate a Loop using this method.
@@ -63,7 +115,24 @@ class Loop(object):
 
         # Initialize our local variables
         self._tags: List[str] = []
-        self.data: List[List[Any]] = []
+        self._data: List[List[Any]] = []
+        # Whether the rows are shared with a clone, and must be copied before being modified, see Loop.clone()
+        self._shared_data: bool = False
+        # Whether the lists of the rows have been handed out (see Loop._rows_may_change())
+        self._rows_handed_out: bool = False
+        # Values which haven't been turned into rows yet, see Entry.from_file(lazy=True)
+        self._lazy_values: Optional['cnmrstar.LoopValues'] = None
+        # The data stored as immutable columns rather than rows, see Loop.make_categorical()
+        self._columns: Optional[List[Sequence[Any]]] = None
+        # See Loop.freeze()
+        self._frozen: bool = False
+        self._hash: Optional[int] = None
+        # The generation and statistics of each column, see Loop._column_stats()
+        self._stats: Optional[Tuple[int, List[ColumnStats]]] = None
+        # The digest of the values, see Loop.content_hash()
+        self._data_digest: Optional[bytes] = None
+        # What the digest of the whole loop was worked out from, and the digest
+        self._digest: Optional[Tuple[tuple, bytes]] = None
         self.category: Optional[str] = None
         self.source: str = "unknown"
 
@@ -105,12 +174,17 @@ class Loop(object):
 
         # If we are reading from a CSV file, go ahead and parse it
         if 'csv' in kwargs and kwargs['csv']:
-            csv_file = csv_reader(star_buffer)
-            self.add_tag(next(csv_file))
-            for row in csv_file:
-                self.add_data(row,
-                              convert_data_types=kwargs.get('convert_data_types', False),
-                              schema=kwargs.get('schema', None))
+            tags, values = load_csv(star_buffer.read())
+            self.add_tag(tags)
+            lazy = cnmrstar is not None and isinstance(values, cnmrstar.LoopValues)
+            if kwargs.get('convert_data_types', False):
+                self._data = self._convert_csv_rows(values.rows() if lazy else values, kwargs.get('schema', None))
+            elif lazy:
+                # Kept as read, as when parsing with lazy=True
+                if len(values) > 0:
+                    self._lazy_values = values
+            else:
+                self._data = values
             self.source = f"from_csv('{kwargs['csv']}')"
             return
 
@@ -134,7 +208,7 @@ class Loop(object):
 
         # Copy the first parsed saveframe into ourself
         self._tags = tmp_entry[0][0].tags
-        self.data = tmp_entry[0][0].data
+        self._data = tmp_entry[0][0]._data
         self.category = tmp_entry[0][0].category
 
     def __iter__(self) -> list:
@@ -143,10 +217,60 @@ class Loop(object):
         for row in self.data:
             yield row
 
+    def __reduce_ex__(self, protocol: int) -> tuple:
+        """ Pickles (and copies) the loop in whichever form it is stored.
+        Rows are pickled as they are, which lets pickle store each repeated
+        value once. Loops stored as columns are pickled a column at a time,
+        and the codes of categorical columns as raw buffers, which can be
+        passed out-of-band with pickle protocol 5. Lazy values can't be
+        pickled, so they are pickled as rows. The hash and the column
+        statistics aren't kept, as str hashes differ between processes, and
+        the statistics are cheap to work out again. """
+
+        data = columns = None
+        if self._columns is not None:
+            columns = list(self._columns)
+        elif self._lazy_values is not None:
+            data = self._lazy_values.rows()
+        else:
+            data = self._data
+        return _restore_loop, (self.category, self._tags, data, columns, self._frozen, self._shared_data,
+                               self._data_digest, self.source)
+
+    def __setstate__(self, state: dict) -> None:
+        """ Restores loops pickled by older versions, which pickled the
+        attributes of the loop. """
+
+        if 'data' in state:
+            state['_data'] = state.pop('data')
+        state.setdefault('_lazy_values', None)
+        state.setdefault('_columns', None)
+        state.setdefault('_frozen', False)
+        state.setdefault('_hash', None)
+        state.setdefault('_shared_data', False)
+        state.setdefault('_rows_handed_out', False)
+        state.setdefault('_stats', None)
+        state.setdefault('_data_digest', None)
+        state.setdefault('_digest', None)
+        self.__dict__.update(state)
+
+    def __hash__(self) -> int:
+        """ Only frozen loops are hashable. See :py:meth:`Loop.freeze`. """
+
+        if not self._frozen:
+            raise TypeError(f"{self!r} isn't frozen, so it isn't hashable. See Loop.freeze().")
+        if self._hash is None:
+            self._hash = hash((self.category, self._tags, tuple(tuple(_) for _ in self._columns)))
+        return self._hash
+
     def __len__(self) -> int:
         """Return the number of rows of data."""
 
-        return len(self.data)
+        if self._lazy_values is not None:
+            return len(self._lazy_values) // self._lazy_values.width
+        if self._columns is not None:
+            return len(self._columns[0]) if self._columns else 0
+        return len(self._data)
 
     def __lt__(self, other) -> bool:
         """Returns True if this loop sorts lower than the compared
@@ -167,6 +291,8 @@ class Loop(object):
         If there are 5 rows of data in the loop, you will need to
         assign a list with 5 elements."""
 
+        check_not_frozen(self)
+
         tag = utils.format_tag_lc(key)
 
         # Check that their tag is in the loop
@@ -190,7 +316,7 @@ class Loop(object):
         """Returns the loop in STAR format as a string."""
 
         # Check if there is any data in this loop
-        if len(self.data) == 0:
+        if len(self) == 0:
             # They do not want us to print empty loops
             if skip_empty_loops:
                 return ""
@@ -208,7 +334,15 @@ class Loop(object):
 
         # If skipping null tags, it's easier to filter out a loop with only real tags and then print
         if skip_empty_tags:
-            has_data = [not all([_ in definitions.NULL_VALUES for _ in column]) for column in zip(*self.data)]
+            null_counts = self._null_counts()
+            if null_counts is None:
+                has_data = [not all([_ in definitions.NULL_VALUES for _ in column])
+                            for column in zip(*self._peek_data())]
+            else:
+                has_data = [_ != len(self) for _ in null_counts]
+            # Every tag would be skipped
+            if not any(has_data):
+                return ""
             return self.filter([tag for x, tag in enumerate(self._tags) if has_data[x]]).format()
 
         # Start the loop
@@ -231,23 +365,19 @@ class Loop(object):
 
         return_chunks.append("\n")
 
-        if len(self.data) != 0:
+        if len(self) != 0:
 
             # Make a copy of the data
-            working_data = []
-            title_widths = [4]*len(self.data[0])
+            working_data = self._quote_stored_values()
+            # Unless that wasn't possible, in which case quote one row at a time
+            row_source = self._peek_data() if not working_data else []
 
             # Put quotes as needed on the data
-            for row_pos, row in enumerate(self.data):
+            for row_pos, row in enumerate(row_source):
                 clean_row = []
                 for col_pos, x in enumerate(row):
                     try:
-                        clean_val = utils.quote_value(x)
-                        clean_row.append(clean_val)
-                        length = len(clean_val) + 3
-                        if length > title_widths[col_pos] and "\n" not in clean_val:
-                            title_widths[col_pos] = length
-
+                        clean_row.append(utils.quote_value(x))
                     except ValueError:
                         raise InvalidStateError('Cannot generate NMR-STAR for entry, as empty strings are not valid '
                                                 'tag values in NMR-STAR. Please either replace the empty strings with'
@@ -257,6 +387,8 @@ class Loop(object):
 
                 working_data.append(clean_row)
 
+            title_widths = self._printed_widths(working_data)
+
             # Generate the format string
             format_string = "     " + "%-*s" * len(self._tags) + " \n"
 
@@ -278,10 +410,47 @@ class Loop(object):
         return {_[1].lower(): _[0] for _ in enumerate(self._tags)}
 
     @property
-    def empty(self) -> bool:
-        """ Check if the loop has no data. """
+    def data(self) -> List[List[Any]]:
+        """ The data in the loop, as a list of rows. If the loop was parsed
+        with lazy=True, or stores its data as columns, accessing this turns
+        the data back into rows. If the rows are shared with a clone, this
+        copies them first. For a frozen loop, this is a read-only sequence of
+        tuples instead. """
+
+        if self._frozen:
+            return ColumnRows(self._columns)
+        # The rows can be modified through the list, so what was known about the columns no longer is
+        self._stats = None
+        rows = self._rows()
+        self._rows_handed_out = True
+        return rows
+
+    @data.setter
+    def data(self, data: List[List[Any]]) -> None:
+        check_not_frozen(self)
+        self._data = data
+        self._shared_data = False
+        # The caller still has the list, and can modify it
+        self._rows_handed_out = True
+        self._lazy_values = None
+        self._columns = None
+        self._stats = None
+        self._data_digest = None
 
-        for row in self.data:
+    @property
+    def empty(self) -> bool:
+        """ Check if the loop has no data. The number of null values in
+        each column is remembered, so this only looks at every value the
+        first time. Once the rows have been handed out through Loop.data the
+        counts can't be remembered, so the values are checked only until the
+        first one which isn't null. """
+
+        if not self._rows_may_change():
+            null_counts = self._null_counts()
+            if null_counts is not None:
+                return all(_ == len(self) for _ in null_counts)
+
+        for row in self._peek_data():
             for col in row:
                 if col not in definitions.NULL_VALUES:
                     return False
@@ -292,6 +461,27 @@ class Loop(object):
     def tags(self) -> List[str]:
         return self._tags
 
+    @classmethod
+    def from_arrow(cls, data: Any, category: str = None) -> 'Loop':
+        """Create a loop from an Arrow table, such as a pyarrow Table or
+        RecordBatch, a polars DataFrame, or the result of to_arrow(). Any
+        object which supports the Arrow PyCapsule interface can be used,
+        and the Arrow library it comes from isn't needed by PyNMRSTAR.
+
+        Each column becomes a tag (column names may be either tag names or
+        full tag names), and the values are read into the same compact form
+        as a parsed loop, without creating a Python object per value. Null
+        values become '.', and numbers and dates are written as str() would
+        write them. If category isn't given, the category stored by
+        to_arrow() is used if there is one."""
+
+        names, values, table_category = arrow.import_table(data)
+        ret = cls.from_scratch(category or table_category, source="from_arrow()")
+        ret.add_tag(names)
+        if len(values) > 0:
+            ret._lazy_values = values
+        return ret
+
     @classmethod
     def from_file(cls,
                   the_file: Union[str, TextIO, BinaryIO],
@@ -332,7 +522,7 @@ class Loop(object):
         # If they provided a string, try to load it using JSON
         if not isinstance(json_dict, dict):
             try:
-                json_dict = json.loads(json_dict)
+                json_dict = load_json(json_dict)
             except (TypeError, ValueError):
                 raise ValueError("The JSON you provided was neither a Python dictionary nor a JSON string.")
 
@@ -346,7 +536,15 @@ class Loop(object):
         ret = Loop.from_scratch()
         ret._tags = json_dict['tags']
         ret.category = json_dict['category']
-        ret.data = json_dict['data']
+        data = json_dict['data']
+        # Values read by load_json() are left as they are, as when parsing with lazy=True
+        if cnmrstar is not None and isinstance(data, cnmrstar.LoopValues):
+            if data.width == len(ret._tags):
+                ret._lazy_values = data
+            else:
+                ret._data = data.rows()
+        else:
+            ret.data = data
         ret.source = "from_json()"
 
         # Return the new loop
@@ -441,16 +639,234 @@ class Loop(object):
 
         return tags
 
+    def _peek_data(self) -> List[List[Any]]:
+        """ Returns the rows of data without giving up a lazy or column
+        representation of them. Don't modify the result. """
+
+        if self._lazy_values is not None:
+            return self._lazy_values.rows()
+        if self._columns is not None:
+            return [list(_) for _ in zip(*self._columns)]
+        return self._data
+
+    def _stored_data(self) -> Any:
+        """ Returns the data as it is stored (lazy values, columns wrapped
+        in a ColumnRows, or rows), which is how the C module reads it. """
+
+        if self._lazy_values is not None:
+            return self._lazy_values
+        if self._columns is not None:
+            return ColumnRows(self._columns)
+        return self._data
+
+    def _convert_csv_rows(self, data: List[List[str]], schema: Optional[Schema]) -> List[List[Any]]:
+        """ Converts the values of rows read from CSV to the types the schema
+        defines, in place, converting each distinct value of a column once. """
+
+        schema = utils.get_schema(schema)
+        for position, tag in enumerate(self._tags):
+            full_tag = f"{self.category}.{tag}"
+            converted: Dict[str, Any] = {}
+            for row in data:
+                value = row[position]
+                if value not in converted:
+                    converted[value] = schema.convert_tag(full_tag, value)
+                row[position] = converted[value]
+        return data
+
+    def _csv_header(self, header: bool, show_category: bool) -> Optional[List[str]]:
+        """ Returns the header row for get_data_as_csv() and write_csv(). """
+
+        if not header:
+            return None
+        if show_category:
+            return [str(self.category) + "." + str(x) for x in self._tags]
+        return [str(x) for x in self._tags]
+
+    def _data_slice(self, start: int, stop: int) -> Any:
+        """ Returns the rows from start up to stop, for dump_json_rows(),
+        without turning a lazy or column representation into rows. """
+
+        if self._lazy_values is not None:
+            return self._lazy_values.slice(start, stop)
+        if self._columns is not None:
+            return ColumnRows([CategoricalColumn(_.values, _.codes[start:stop]) if isinstance(_, CategoricalColumn)
+                               else _[start:stop] for _ in self._columns])
+        return self._data[start:stop]
+
+    def _peek_column(self, position: int) -> Sequence[Any]:
+        """ Returns the values of one column, without turning a lazy or
+        column representation into rows. Don't modify the result. """
+
+        if self._lazy_values is not None:
+            return self._lazy_values.column(position)
+        if self._columns is not None:
+            return self._columns[position]
+        return [row[position] for row in self._data]
+
+    def _rows(self) -> List[List[Any]]:
+        """ Returns the rows of data, so that they can be modified, turning
+        a lazy or column representation into rows, and copying rows shared
+        with a clone. Unlike Loop.data, this keeps the column statistics, so
+        the caller must update them. """
+
+        self._data_digest = None
+
+        if self._lazy_values is not None or self._columns is not None:
+            self._data = self._peek_data()
+            self._lazy_values = None
+            self._columns = None
+            self._rows_handed_out = False
+        elif self._shared_data:
+            self._data = [list(_) for _ in self._data]
+            self._shared_data = False
+            self._rows_handed_out = False
+        return self._data
+
+    def _rows_may_change(self) -> bool:
+        """ Returns whether the rows can be modified without the loop
+        knowing, because the lists of the rows have been handed out (through
+        Loop.data, or by being set as Loop.data).
+        Nothing about the values (the column statistics or the digest) is
+        remembered while they can be. """
+
+        return self._rows_handed_out and self._lazy_values is None and self._columns is None
+
+    def _content_digest(self) -> bytes:
+        """ Returns the digest for Loop.content_hash(). """
+
+        if self._data_digest is not None:
+            data_digest = self._data_digest
+        else:
+            data_digest = content_digest(self._peek_data())
+            if not self._rows_may_change():
+                self._data_digest = data_digest
+
+        # The same digest object is returned while nothing changed, so that saveframes can tell by its identity
+        key = (self.category, data_digest, *self._tags)
+        if self._digest is None or not same_objects(self._digest[0], key):
+            self._digest = (key, content_digest([self.category, list(self._tags)], [data_digest]))
+        return self._digest[1]
+
+    def _column_stats(self) -> List[ColumnStats]:
+        """ Returns what is known about each column (see
+        :py:class:`pynmrstar.columns.ColumnStats`). The methods which modify
+        the loop keep this up to date. Once the rows have been handed out
+        through Loop.data, they can be modified directly, so the statistics
+        are worked out again each time rather than remembered. """
+
+        if self._rows_may_change():
+            self._stats = None
+            return [ColumnStats() for _ in self._tags]
+        generation = stats_generation()
+        if self._stats is None or self._stats[0] != generation or len(self._stats[1]) != len(self._tags):
+            self._stats = (generation, [ColumnStats() for _ in self._tags])
+        return self._stats[1]
+
+    def _null_counts(self) -> Optional[List[int]]:
+        """ Returns the number of null values in each column, counting them
+        only for the columns where the count isn't already known. Returns
+        None if the rows don't match the tags. """
+
+        stats = self._column_stats()
+        if any(_.nulls is None for _ in stats):
+            try:
+                self._check_tags_match_data()
+            except InvalidStateError:
+                return None
+            for position, column_stats in enumerate(stats):
+                if column_stats.nulls is None:
+                    column_stats.nulls = count_nulls(self._peek_column(position))
+        return [_.nulls for _ in stats]
+
+    def _printed_widths(self, working_data: List[List[str]]) -> List[int]:
+        """ Returns the width of each column when printed, measuring the
+        quoted values only for the columns where it isn't already known. """
+
+        stats = self._column_stats()
+        for position, column_stats in enumerate(stats):
+            if column_stats.width is None:
+                column_stats.width = _printed_width(row[position] for row in working_data)
+        return [_.width for _ in stats]
+
+    def _update_stats(self, added: List[List[Any]] = (), removed: List[List[Any]] = ()) -> None:
+        """ Updates what is known about the columns for rows which were
+        added to or removed from the loop. Removing values can make a
+        column narrower, so the width is only known again once measured. """
+
+        if self._stats is None:
+            return
+        for position, column_stats in enumerate(self._column_stats()):
+            if column_stats.nulls is not None:
+                column_stats.nulls += count_nulls([row[position] for row in added])
+                column_stats.nulls -= count_nulls([row[position] for row in removed])
+            if removed:
+                column_stats.width = None
+            elif column_stats.width is not None and added:
+                try:
+                    width = _printed_width(utils.quote_value(row[position]) for row in added)
+                except ValueError:
+                    width = None
+                column_stats.width = None if width is None else max(width, column_stats.width)
+
+    def _quote_stored_values(self) -> List[List[str]]:
+        """ Quotes the values of a lazy loop straight from the tokenized
+        data, or the values of a loop stored as columns one column at a time
+        (quoting, and measuring, each distinct value of a categorical column
+        only once). Returns the quoted rows. Returns no rows if the values
+        must be quoted one row at a time instead, which is also how the
+        position of an invalid value gets reported. """
+
+        if self._lazy_values is not None:
+            # Conversions of str values only happen in utils.quote_value()
+            if any(isinstance(_, str) for _ in definitions.STR_CONVERSION_DICT):
+                return []
+            try:
+                return self._lazy_values.quoted()
+            except ValueError:
+                return []
+
+        if self._columns is not None:
+            stats = self._column_stats()
+            quoted_columns = []
+            try:
+                for col_pos, column in enumerate(self._columns):
+                    if isinstance(column, CategoricalColumn):
+                        quoted_values = [utils.quote_value(_) for _ in column.values]
+                        if stats[col_pos].width is None:
+                            stats[col_pos].width = _printed_width(quoted_values[_] for _ in column.used_codes())
+                        quoted_columns.append(list(map(quoted_values.__getitem__, column.codes)))
+                    else:
+                        quoted_columns.append([utils.quote_value(_) for _ in column])
+            except ValueError:
+                return []
+            return [list(_) for _ in zip(*quoted_columns)]
+
+        return []
+
     def _check_tags_match_data(self) -> bool:
         """ Ensures that each row of the data has the same number of
         elements as there are tags for the loop. This is necessary to
         print or do some other operations on loops that count on the values
         matching. """
 
+        # Lazy values and columns always make rows of the same width
+        width = None
+        if self._lazy_values is not None:
+            width = self._lazy_values.width
+        elif self._columns is not None:
+            width = len(self._columns)
+        if width is not None:
+            if width != len(self._tags) and len(self) > 0:
+                raise InvalidStateError(f"The number of tags must match the width of the data. Error in loop "
+                                        f"'{self.category}'. In this case, there are {len(self._tags)} tags, and "
+                                        f"each row has {width} tags.")
+            return True
+
         # Make sure that if there is data, it is the same width as the
         #  tag names
-        if len(self.data) > 0:
-            for x, row in enumerate(self.data):
+        if len(self._data) > 0:
+            for x, row in enumerate(self._data):
                 if len(self._tags) != len(row):
                     raise InvalidStateError(f"The number of tags must match the width of the data. Error in loop "
                                             f"'{self.category}'. In this case, there are {len(self._tags)} tags, and "
@@ -503,6 +919,8 @@ class Loop(object):
         :type schema: pynmrstar.Schema
         """
 
+        check_not_frozen(self)
+
         if not data:
             raise ValueError('No valid data provided.')
 
@@ -545,7 +963,8 @@ class Loop(object):
                 if len(row) != len(self.tags):
                     raise ValueError('One of the lists you provided is not the correct length to match the number '
                                      f'of tags present in the loop. Error on row {pos} with values: {row}')
-            pending_data = data
+            # Copied, so that changing the caller's lists later doesn't change the loop without it knowing
+            pending_data = [list(row) for row in data]
         # Type 3 - a list of values
         elif isinstance(data, list):
             if rearrange:
@@ -562,7 +981,7 @@ class Loop(object):
                     raise ValueError("The list must have the same number of elements as the number of tags when adding "
                                      "a single row of values! Insert tag names first by calling Loop.add_tag().")
                 # Add the user data
-                pending_data.append(data)
+                pending_data.append(list(data))
         else:
             raise ValueError("Your data did not match one of the supported types.")
 
@@ -574,7 +993,8 @@ class Loop(object):
                     row[tag_id] = schema.convert_tag(f"{self.category}.{self._tags[tag_id]}", datum)
 
         # Add the data at the very end to ensure that errors are caught before we mutate the data
-        self.data.extend(pending_data)
+        self._rows().extend(pending_data)
+        self._update_stats(added=pending_data)
 
     def add_data_by_tag(self, tag_name: str, value) -> None:
         """Deprecated: It is recommended to use add_data() instead for most use
@@ -583,6 +1003,8 @@ class Loop(object):
         Add data to the loop one element at a time, based on tag.
         Useful when adding data from SANS parsers."""
 
+        check_not_frozen(self)
+
         warnings.warn("Deprecated: It is recommended to use Loop.add_data() instead for most use cases.",
                       DeprecationWarning)
 
@@ -609,6 +1031,8 @@ class Loop(object):
         """ Automatically adds any missing tags (according to the schema),
         sorts the tags, and renumbers the tags by ordinal. """
 
+        check_not_frozen(self)
+
         self.add_tag(Loop._get_tags_from_schema(self.category, schema=schema, all_tags=all_tags),
                      ignore_duplicates=True, update_data=True)
         self.sort_tags()
@@ -637,6 +1061,8 @@ class Loop(object):
         Adding a tag will update the data array to match by adding
         None values to the rows if you specify update_data=True."""
 
+        check_not_frozen(self)
+
         # If they have passed multiple tags to add, call ourself
         #  on each of them in succession
         if isinstance(name, (list, tuple)):
@@ -653,7 +1079,7 @@ class Loop(object):
                     category = "_" + category
 
                 if self.category is None:
-                    self.category = category
+                    self.category = sys.intern(category)
                 elif self.category.lower() != category.lower():
                     raise ValueError("One loop cannot have tags with different categories (or tags that don't "
                                      f"match the loop category)! The loop category is '{self.category}' while "
@@ -676,20 +1102,97 @@ class Loop(object):
             if char in utils.definitions.WHITESPACE:
                 raise ValueError(f"Tag names can not contain whitespace characters. Invalid tag name: '{name}")
 
-        # Add the tag
-        self._tags.append(name)
+        # Fetch the column statistics while they still match the tags
+        stats = self._column_stats() if update_data and self._stats is not None else None
+
+        # Add the tag. Tag names repeat in every loop of the category, so only keep one copy of each
+        self._tags.append(sys.intern(name))
 
         # Add None's to the rows of data
         if update_data:
 
-            for row in self.data:
+            for row in self._rows():
                 row.append(None)
+            if stats is not None:
+                stats.append(ColumnStats(count_nulls([None]) * len(self)))
+
+    def as_array(self, tag: str, dtype: Any = 'f8', null_value: Union[int, float] = None) -> array:
+        """ Returns the values of a numeric tag as an array.array, which
+        NumPy (or anything else that supports the buffer protocol) can use
+        without copying it::
+
+            shifts = numpy.frombuffer(loop.as_array('Val'))
+
+        dtype may be 'f8' (the default), 'f4', 'i8' or 'i4', or the
+        equivalent NumPy dtype or Python type. The values are parsed by the
+        C module straight from how the loop is stored, without creating a
+        Python object for each value, and the distinct values of a
+        categorical column are only parsed once.
+
+        Null values are stored as null_value, which defaults to NaN for
+        floats. Reading a null into integers without a null_value, or a
+        value which isn't a number, raises a ValueError."""
+
+        name = dtype if isinstance(dtype, str) else getattr(dtype, 'name', getattr(dtype, '__name__', None))
+        typecode = _ARRAY_TYPECODES.get(name)
+        if typecode is None:
+            raise ValueError(f"The dtype must be one of 'f8', 'f4', 'i8' or 'i4'. Invalid dtype: {dtype!r}")
+
+        position = self._find_tag_position(tag)
+        self._check_tags_match_data()
+        result = array(typecode, bytes(array(typecode).itemsize * len(self)))
+        try:
+            cnmrstar.parse_column(self._stored_data(), position, ColumnRows, result, null_value)
+        except ValueError as err:
+            raise ValueError(f"The tag '{tag}' can't be read as numbers. {err}") from None
+        return result
 
     def clear_data(self) -> None:
         """Erases all data in this loop. Does not erase the tag names
         or loop category."""
 
         self.data = []
+        # No one else has the new list
+        self._rows_handed_out = False
+
+    def clone(self) -> 'Loop':
+        """ Returns a copy of the loop which shares its data with this loop
+        until either of them is modified. Loops stored as columns (or parsed
+        lazily) share the immutable columns (or parsed values) for good,
+        while loops stored as rows copy the rows the first time Loop.data
+        is accessed. This makes cloning cost the same no matter how much
+        data the loop has, unless the rows have already been handed out
+        through Loop.data, in which case the clone gets a copy of them
+        straight away.
+
+        The clone of a frozen loop is not frozen. """
+
+        result = Loop.from_scratch(source=self.source)
+        result.category = self.category
+        result._tags = list(self._tags)
+        result._lazy_values = self._lazy_values
+        if self._columns is not None:
+            result._columns = list(self._columns)
+        elif self._rows_may_change():
+            # Rows the caller already has mustn't change the clone, and nothing about them is remembered
+            result._data = [list(_) for _ in self._data]
+            return result
+        elif self._data:
+            result._data = self._data
+            self._shared_data = result._shared_data = True
+        if self._stats is not None:
+            result._stats = (self._stats[0], [_.copy() for _ in self._stats[1]])
+        result._data_digest = self._data_digest
+        return result
+
+    def column(self, tag: str) -> 'views.ColumnView':
+        """ Returns a read-only view of the values of one tag, which reads
+        the values straight from the loop's storage (whether rows, columns,
+        or lazily parsed values) rather than copying them. Use this rather
+        than get_tag() to read a column without allocating a copy of it.
+        The view always reflects the current data in the loop."""
+
+        return views.ColumnView(self, self._find_tag_position(tag))
 
     def compare(self, other) -> List[str]:
         """Returns the differences between two loops as a list. Order of
@@ -710,6 +1213,9 @@ class Loop(object):
         elif not isinstance(other, Loop):
             return ['Other object is not of class Loop.']
 
+        if self._content_digest() == other._content_digest():
+            return []
+
         # We need to do this in case of an extra "\n" on the end of one tag
         if str(other) == str(self):
             return []
@@ -728,11 +1234,12 @@ class Loop(object):
             # No point checking if data is the same if the tag names aren't
             else:
                 # Only sort the data if it is not already equal
-                if self.data != other.data:
+                self_data, other_data = self._peek_data(), other._peek_data()
+                if self_data != other_data:
 
                     # Check data of loops
-                    self_data = sorted(deepcopy(self.data))
-                    other_data = sorted(deepcopy(other.data))
+                    self_data = sorted(deepcopy(self_data))
+                    other_data = sorted(deepcopy(other_data))
 
                     if self_data != other_data:
                         diffs.append(f"\t\tLoop data does not match for loop with category '{self.category}'.")
@@ -742,6 +1249,19 @@ class Loop(object):
 
         return diffs
 
+    def content_hash(self) -> str:
+        """ Returns a hash of the contents of the loop (its category, tags,
+        and values) as a hex string. Unlike hash(), it is the same in every
+        process, so it can be stored to tell later whether a loop changed.
+        Loops with the same content hash are equal.
+
+        The hash of the values is remembered until the loop is modified, so
+        only the first call looks at every value. Once the rows have been
+        handed out through Loop.data, they can be modified directly, so the
+        hash is worked out again on every call. """
+
+        return self._content_digest().hex()
+
     def delete_tag(self, tag: Union[str, List[str]]) -> None:
         """ Deprecated. Please use `py:meth:pynmrstar.Loop.remove_tag` instead. """
 
@@ -754,6 +1274,29 @@ class Loop(object):
         warnings.warn('Please use remove_data_by_tag_value() instead.', DeprecationWarning)
         return self.remove_data_by_tag_value(tag, value, index_tag)
 
+    def diff(self, other: 'Loop', key: Optional[Union[str, List[str]]] = None) -> 'diffs.LoopDiff':
+        """ Returns the differences between the rows of this loop and
+        another loop (such as the same loop in a newer version of an entry)
+        as a :py:class:`pynmrstar.diffs.LoopDiff`, which lists the rows
+        which were inserted, deleted, or modified. Unlike compare(), this
+        takes time proportional to the number of rows, and reports which
+        rows differ rather than only that the loops do.
+
+        Rows are matched by their values for the key tags, such as
+        ``key=['ID']``, so a row whose other values changed is reported as
+        modified. Without a key, rows are matched by all of their values,
+        so a changed row is reported as deleted and inserted. Only the tags
+        in both loops are compared. """
+
+        if not isinstance(other, Loop):
+            raise ValueError('You can only diff a loop against another loop.')
+        if isinstance(key, str):
+            key = [key]
+        if key is not None:
+            key = [utils.format_tag(_) if "." in _ else _ for _ in key]
+
+        return diffs.diff_rows(self.category, self._tags, self._peek_data(), other._tags, other._peek_data(), key)
+
     def filter(self, tag_list: Union[str, List[str], Tuple[str]], ignore_missing_tags: bool = False):
         """ Returns a new loop containing only the specified tags.
         Specify ignore_missing_tags=True to bypass missing tags rather
@@ -779,6 +1322,19 @@ class Loop(object):
             valid_tags.append(tag)
             result.add_tag(self._tags[tag_match_index])
 
+        # What is known about the columns still holds for the new loop
+        stats = None
+        if self._stats is not None and len(self._stats[1]) == len(self._tags):
+            stats = (self._stats[0], [self._stats[1][self.tag_index(tag)].copy() for tag in valid_tags])
+
+        # Columns are immutable, so they can be shared with the new loop
+        if self._columns is not None and valid_tags:
+            result._columns = [self._columns[self.tag_index(tag)] for tag in valid_tags]
+            result._stats = stats
+            if result.category is None:
+                result.category = self.category
+            return result
+
         # Add the data for the tags to the new loop
         results = self.get_tag(valid_tags)
 
@@ -791,6 +1347,7 @@ class Loop(object):
                 # We know it's a row because we didn't specify dict_result=True to get_tag()
                 assert isinstance(row, list)
                 result.add_data(row)
+        result._stats = stats
 
         # Assign the category of the new loop
         if result.category is None:
@@ -798,6 +1355,44 @@ class Loop(object):
 
         return result
 
+    def freeze(self) -> None:
+        """ Makes the loop immutable. The data is stored as columns, with
+        repetitive columns dictionary-encoded (see
+        :py:meth:`Loop.make_categorical`), so it takes much less memory.
+        Loop.data becomes a read-only sequence of tuples, and methods which
+        would modify the loop raise an InvalidStateError instead. A frozen
+        loop is hashable and is safe to share between threads.
+
+        Copies of a frozen loop (and unpickled frozen loops) are also
+        frozen. """
+
+        if self._frozen:
+            return
+
+        self.make_categorical()
+        # Columns with few rows, or with mostly distinct values, are smaller as tuples
+        columns = []
+        for column in self._columns:
+            if isinstance(column, CategoricalColumn):
+                values = tuple(column)
+                if sys.getsizeof(values) <= column.nbytes():
+                    column = values
+            columns.append(column)
+        self._columns = tuple(columns)
+        tags = tuple(self._tags)
+        if len(_shared_tags) < 4096:
+            tags = _shared_tags.setdefault(tags, tags)
+        self._tags = tags
+        self._frozen = True
+
+    def filter_rows(self, tag: str, value: Any) -> 'Loop':
+        """ Returns a new loop containing only the rows in which the given
+        tag has the given value. For a categorical column (see
+        :py:meth:`Loop.make_categorical`) the value is only compared once."""
+
+        position = self._find_tag_position(tag)
+        return self._take_rows(self._rows_with_value(position, value))
+
     def format(self, skip_empty_loops: bool = True, skip_empty_tags: bool = False) -> str:
         """ The same as calling str(Loop), except that you can pass options
         to customize how the loop is printed.
@@ -813,42 +1408,27 @@ class Loop(object):
         show_category to false to omit the loop category from the
         headers."""
 
-        csv_buffer = StringIO()
-        csv_writer_object = csv_writer(csv_buffer)
-
-        if header:
-            if show_category:
-                csv_writer_object.writerow(
-                    [str(self.category) + "." + str(x) for x in self._tags])
-            else:
-                csv_writer_object.writerow([str(x) for x in self._tags])
-
-        for row in self.data:
-
-            data = []
-            for piece in row:
-                data.append(piece)
-
-            csv_writer_object.writerow(data)
-
-        csv_buffer.seek(0)
-        return csv_buffer.read().replace('\r\n', '\n')
+        return dump_csv_rows(self._stored_data(), self._csv_header(header, show_category))
 
     def get_json(self, serialize: bool = True) -> Union[dict, str]:
         """ Returns the loop in JSON format. If serialize is set to
         False a dictionary representation of the loop that is
         serializeable is returned."""
 
-        loop_dict = {
+        if serialize:
+            return dump_json(self._json_dict())
+
+        return {
             "category": self.category,
-            "tags": self._tags,
-            "data": self.data
+            "tags": list(self._tags),
+            "data": self._peek_data() if self._frozen else self.data
         }
 
-        if serialize:
-            return json.dumps(loop_dict, default=_json_serialize)
-        else:
-            return loop_dict
+    def _json_dict(self) -> dict:
+        """ Returns what get_json(serialize=False) would, but without
+        turning a lazy or column representation into rows, for dump_json(). """
+
+        return {"category": self.category, "tags": self._tags, "data": self._stored_data()}
 
     def get_tag_names(self) -> List[str]:
         """ Return the tag names for this entry with the category
@@ -895,7 +1475,7 @@ class Loop(object):
 
         # Make a copy of the tags to fetch - don't modify the
         # list that was passed
-        lower_tags = deepcopy(tags)
+        lower_tags = list(tags)
 
         # Strip the category if they provide it (also validate
         #  it during the process)
@@ -921,15 +1501,21 @@ class Loop(object):
             else:
                 raise KeyError(f"Could not locate the tag with name or ID: '{tags[pos]}' in loop '{self.category}'.")
 
+        # A single column of a lazy or column stored loop only needs the values of that column
+        if (self._lazy_values is not None or self._columns is not None) and len(tag_ids) == 1 and \
+                not whole_tag and not dict_result and 0 <= tag_ids[0] < len(self._tags):
+            return list(self._peek_column(tag_ids[0]))
+        data = self._peek_data()
+
         # First build the tags as a list
         if not dict_result:
 
             # Use a list comprehension to pull the correct tags out of the rows
             if whole_tag:
                 result = [[[self.category + "." + self._tags[col_id], row[col_id]]
-                           for col_id in tag_ids] for row in self.data]
+                           for col_id in tag_ids] for row in data]
             else:
-                result = [[row[col_id] for col_id in tag_ids] for row in self.data]
+                result = [[row[col_id] for col_id in tag_ids] for row in data]
 
             # Strip the extra list if only one tag
             if len(lower_tags) == 1:
@@ -940,12 +1526,107 @@ class Loop(object):
         else:
             if whole_tag:
                 result = [dict((self.category + "." + self._tags[col_id], row[col_id]) for col_id in tag_ids) for
-                          row in self.data]
+                          row in data]
             else:
-                result = [dict((tags[pos], row[col_id]) for pos, col_id in enumerate(tag_ids)) for row in self.data]
+                result = [dict((tags[pos], row[col_id]) for pos, col_id in enumerate(tag_ids)) for row in data]
 
         return result
 
+    def group_by(self, tag: str) -> Dict[Any, 'Loop']:
+        """ Splits the rows of the loop by their value of the given tag.
+        Returns a dictionary from each distinct value (in the order they
+        first appear) to a new loop containing the rows with that value. For
+        a categorical column (see :py:meth:`Loop.make_categorical`) the rows
+        are grouped by their codes."""
+
+        position = self._find_tag_position(tag)
+        column = self._peek_column(position)
+
+        groups: Dict[Any, List[int]] = {}
+        if isinstance(column, CategoricalColumn):
+            # Sort the row positions by code, then cut them into a group per code
+            codes = column.codes
+            order = sorted(range(len(codes)), key=codes.__getitem__)
+            counts = Counter(codes)
+            starts = {}
+            start = 0
+            for code in sorted(counts):
+                starts[code] = start
+                start += counts[code]
+            for code in dict.fromkeys(codes):
+                groups[column.values[code]] = order[starts[code]:starts[code] + counts[code]]
+        else:
+            for row_pos, value in enumerate(column):
+                rows = groups.get(value)
+                if rows is None:
+                    rows = groups[value] = []
+                rows.append(row_pos)
+
+        return {value: self._take_rows(rows) for value, rows in groups.items()}
+
+    def iter_json(self, rows_per_chunk: int = 10000) -> Iterator[str]:
+        """ Yields the loop in JSON format in pieces, which joined together
+        are the same as get_json(). The data is written rows_per_chunk rows
+        at a time, without turning a lazy or column representation into
+        rows, so that the memory used doesn't depend on the size of the
+        loop. """
+
+        yield dump_json({"category": self.category, "tags": self._tags})[:-1] + ', "data": ['
+        for start in range(0, len(self), rows_per_chunk):
+            if start:
+                yield ", "
+            yield dump_json_rows(self._data_slice(start, start + rows_per_chunk), "[", None, "]", ", ")
+        yield "]}"
+
+    def make_categorical(self, tags: Optional[Union[str, List[str]]] = None, max_distinct: int = 256) -> None:
+        """ Stores the data in the loop as columns, with the columns of the
+        given tags dictionary-encoded: each value is stored as a small code
+        into a table of the distinct values in the column. This makes loops
+        with repetitive columns (such as Comp_ID or Atom_ID) much smaller,
+        and allows filter_rows(), group_by(), sort_rows(),
+        remove_data_by_tag_value() and printing to work with each distinct
+        value once rather than once per row.
+
+        If no tags are given, every column with no more than max_distinct
+        distinct values is encoded. Only columns of strings (and None) can be
+        encoded.
+
+        Columns are immutable. Accessing Loop.data, or modifying the loop,
+        turns the data back into rows (and the columns back into lists).
+
+        A frozen loop is already stored this way, and can't be modified, so
+        this raises an InvalidStateError for a frozen loop."""
+
+        check_not_frozen(self)
+
+        if tags is None:
+            positions = range(len(self._tags))
+            limit = max_distinct
+        else:
+            positions = [self._find_tag_position(_) for _ in (tags if isinstance(tags, list) else [tags])]
+            limit = None
+
+        self._check_tags_match_data()
+        if self._columns is not None:
+            columns = list(self._columns)
+        else:
+            columns = [tuple(self._peek_column(_)) for _ in range(len(self._tags))]
+
+        for position in positions:
+            if isinstance(columns[position], CategoricalColumn):
+                continue
+            encoded = CategoricalColumn.from_values(columns[position], limit)
+            if encoded is not None:
+                columns[position] = encoded
+            elif tags is not None:
+                raise ValueError(f"The tag '{self._tags[position]}' can't be stored as a categorical column, as it has "
+                                 f"values which aren't strings or None.")
+
+        self._columns = columns
+        self._lazy_values = None
+        self._data = []
+        self._shared_data = False
+
     def print_tree(self) -> None:
         """Prints a summary, tree style, of the loop."""
 
@@ -956,6 +1637,8 @@ class Loop(object):
         provided tag name. If index_tag is provided, that tag is
         renumbered starting with 1. Returns the deleted rows."""
 
+        check_not_frozen(self)
+
         # Make sure the category matches - if provided
         if "." in tag:
             supplied_category = utils.format_category(str(tag))
@@ -969,13 +1652,30 @@ class Loop(object):
 
         deleted = []
 
+        # Only compare the codes of a categorical column, keeping the columns
+        if self._columns is not None:
+            matches = self._rows_with_value(search_tag, value)
+            if matches:
+                deleted = [list(row) for row in zip(*[take(_, matches) for _ in self._columns])]
+                matched = set(matches)
+                keep = [_ for _ in range(len(self)) if _ not in matched]
+                self._columns = [take(_, keep) for _ in self._columns]
+                self._update_stats(removed=deleted)
+                self._data_digest = None
+            if index_tag is not None:
+                self.renumber_rows(index_tag)
+            return deleted
+
         # Delete all rows in which the user-provided tag matched
-        cur_row = 0
-        while cur_row < len(self.data):
-            if self.data[cur_row][search_tag] == value:
-                deleted.append(self.data.pop(cur_row))
-                continue
-            cur_row += 1
+        rows = self._rows()
+        kept = []
+        for row in rows:
+            if row[search_tag] == value:
+                deleted.append(row)
+            else:
+                kept.append(row)
+        rows[:] = kept
+        self._update_stats(removed=deleted)
 
         # Re-number if they so desire
         if index_tag is not None:
@@ -987,6 +1687,8 @@ class Loop(object):
         """Removes one or more tags from the loop based on tag name. Also removes any data for the given tag.
         Provide either a tag or list of tags."""
 
+        check_not_frozen(self)
+
         if not isinstance(tag, list):
             tag = [tag]
 
@@ -998,8 +1700,10 @@ class Loop(object):
         # Calculate the tag position each time, because it will change as the previous tag is deleted
         for each_tag in tag:
             tag_position: int = self.tag_index(each_tag)
+            if self._stats is not None:
+                del self._column_stats()[tag_position]
             del self._tags[tag_position]
-            for row in self.data:
+            for row in self._rows():
                 del row[tag_position]
 
     def renumber_rows(self, index_tag: str, start_value: int = 1, maintain_ordering: bool = False):
@@ -1009,6 +1713,8 @@ class Loop(object):
 
         E.g. 2,3,3,5 would become 1,2,2,4."""
 
+        check_not_frozen(self)
+
         # Make sure the category matches
         if "." in str(index_tag):
             supplied_category = utils.format_category(str(index_tag))
@@ -1063,16 +1769,62 @@ class Loop(object):
                 else:
                     self.data[pos][renumber_tag] = pos + start_value
 
+    def rows_as(self, row_class: Type['rows.Row'] = None, convert_data_types: bool = False,
+                schema: Schema = None) -> Iterator['rows.Row']:
+        """ Returns an iterator of the rows of the loop as objects of a
+        row class generated from the schema (see
+        :py:meth:`pynmrstar.Schema.row_class`), which has an attribute for
+        each tag. If no row class is given, the one for the category of the
+        loop is generated from the schema. For example::
+
+            for row in loop.rows_as():
+                print(row.Comp_ID, row.Atom_ID, row.Val)
+
+        Tags in the loop which aren't in the row class are left out, and
+        tags in the row class which aren't in the loop are None. Set
+        convert_data_types to True to convert the values to the types
+        defined in the schema (as with Entry.from_file()). The rows are
+        created one at a time, and the loop isn't modified."""
+
+        if row_class is None or convert_data_types:
+            schema = utils.get_schema(schema)
+        if row_class is None:
+            row_class = schema.row_class(self.category)
+        elif str(self.category).lower() != row_class.category.lower():
+            raise ValueError(f"The row class is for the category '{row_class.category}' while this loop's category "
+                             f"is '{self.category}'.")
+
+        self._check_tags_match_data()
+        load = rows.row_loader(row_class, tuple(self._tags), schema.convert_tag if convert_data_types else None)
+        if self._lazy_values is None and self._columns is None:
+            return map(load, self._data)
+        return map(load, zip(*[views.ColumnView(self, _) for _ in range(len(self._tags))]))
+
+    def select(self, tags: List[str]) -> 'views.SelectView':
+        """ Returns a read-only view of the rows of the given tags, which
+        reads the values straight from the loop's storage rather than
+        copying them. Use this rather than get_tag() or filter() to read
+        some of the tags without allocating a copy of them. The view always
+        reflects the current data in the loop."""
+
+        if isinstance(tags, str):
+            tags = [tags]
+        return views.SelectView(self, [self._find_tag_position(_) for _ in tags])
+
     def set_category(self, category: str) -> None:
         """ Set the category of the loop. Useful if you didn't know the
         category at loop creation time."""
 
+        check_not_frozen(self)
+
         self.category = utils.format_category(category)
 
     def sort_tags(self, schema: Schema = None) -> None:
         """ Rearranges the tag names and data in the loop to match the order
         from the schema. Uses the BMRB schema unless one is provided."""
 
+        check_not_frozen(self)
+
         schema = utils.get_schema(schema)
         current_order = self.get_tag_names()
 
@@ -1099,8 +1851,10 @@ class Loop(object):
         you provide multiple tags to sort by, they are interpreted as
         increasing order of sort priority."""
 
+        check_not_frozen(self)
+
         # Do nothing if we have no data
-        if len(self.data) == 0:
+        if len(self) == 0:
             return
 
         # This will determine how we sort
@@ -1133,21 +1887,86 @@ class Loop(object):
 
             sort_ordinals.append(renumber_tag)
 
-        # Do the sort(s)
+        # Sort categorical columns by sorting the distinct values, and the rows by their codes
+        if self._columns is not None and key is None:
+            for tag in sort_ordinals:
+                self._sort_columns(tag)
+            return
+
+        # Do the sort(s). Reordering the rows doesn't change what is known about the columns
         for tag in sort_ordinals:
             # Going through each tag, first attempt to sort as integer.
             #  Then fallback to string sort.
             try:
                 if key is None:
-                    tmp_data = sorted(self.data, key=lambda _, pos=tag: float(_[pos]))
+                    tmp_data = sorted(self._rows(), key=lambda _, pos=tag: float(_[pos]))
                 else:
-                    tmp_data = sorted(self.data, key=key)
+                    tmp_data = sorted(self._rows(), key=key)
             except ValueError:
                 if key is None:
-                    tmp_data = sorted(self.data, key=lambda _, pos=tag: _[pos])
+                    tmp_data = sorted(self._rows(), key=lambda _, pos=tag: _[pos])
                 else:
-                    tmp_data = sorted(self.data, key=key)
-            self.data = tmp_data
+                    tmp_data = sorted(self._rows(), key=key)
+            self._data = tmp_data
+
+    def _find_tag_position(self, tag: str) -> int:
+        """ Returns the position of a tag, or raises a ValueError. """
+
+        if "." in tag:
+            supplied_category = utils.format_category(str(tag))
+            if supplied_category.lower() != self.category.lower():
+                raise ValueError(f"The category provided in your tag '{supplied_category}' does not match this loop's "
+                                 f"category '{self.category}'.")
+
+        position = self.tag_index(tag)
+        if position is None:
+            raise ValueError(f"The tag you provided '{tag}' isn't in this loop!")
+        return position
+
+    def _rows_with_value(self, position: int, value: Any) -> List[int]:
+        """ Returns the positions of the rows with the given value in the
+        column at the given position. """
+
+        return positions_of(self._peek_column(position), value)
+
+    def _sort_columns(self, position: int) -> None:
+        """ Sorts the rows of a loop stored as columns by one column, in the
+        same way as sort_rows(). """
+
+        column = self._columns[position]
+        if isinstance(column, CategoricalColumn):
+            # Work out the sort key of each distinct value only once
+            used_codes = column.used_codes()
+            value_keys: List[Any] = [None] * len(column.values)
+            try:
+                for code in used_codes:
+                    value_keys[code] = float(column.values[code])
+            except ValueError:
+                for code in used_codes:
+                    value_keys[code] = column.values[code]
+            keys = list(map(value_keys.__getitem__, column.codes))
+        else:
+            try:
+                keys = [float(_) for _ in column]
+            except ValueError:
+                keys = list(column)
+
+        order = sorted(range(len(keys)), key=keys.__getitem__)
+        self._columns = [take(_, order) for _ in self._columns]
+        self._data_digest = None
+
+    def _take_rows(self, positions: List[int]) -> 'Loop':
+        """ Returns a new loop with the same tags and only the rows at the
+        given positions. Categorical columns stay categorical. """
+
+        result = Loop.from_scratch(self.category, source=self.source)
+        result._tags = list(self._tags)
+        if self._columns is not None:
+            result._columns = [take(_, positions) for _ in self._columns]
+        else:
+            data = self._peek_data()
+            result._data = [list(data[_]) for _ in positions]
+        return result
 
     def tag_index(self, tag_name: str) -> Optional[int]:
         """ Helper method to do a case-insensitive check for the presence
@@ -1162,6 +1981,25 @@ class Loop(object):
         except KeyError:
             return None
 
+    def to_arrow(self, schema: Schema = None, convert_data_types: bool = True) -> 'arrow.ArrowTable':
+        """ Returns the values of the loop as an Arrow table (see
+        :py:class:`pynmrstar.arrow.ArrowTable`), with a column for each tag.
+        The table can be passed to pyarrow, polars, pandas or any other
+        library which supports the Arrow PyCapsule interface, none of which
+        PyNMRSTAR needs::
+
+            frame = polars.DataFrame(loop.to_arrow())
+            frame = loop.to_arrow().to_pandas()
+
+        The columns are written straight from how the loop is stored,
+        without creating a Python object per value. Null values are nulls,
+        and tags the schema defines as integers, floats or dates are
+        columns of that type, unless convert_data_types is False, in which
+        case every column has strings. Specify a custom schema object to
+        use using the schema parameter."""
+
+        return arrow.export_loops([self], schema, convert_data_types)
+
     def validate(self, validate_schema: bool = True, schema: 'Schema' = None,
                  validate_star: bool = True, category: str = None) -> List[str]:
         """Validate a loop in a variety of ways. Returns a list of
@@ -1181,17 +2019,64 @@ class Loop(object):
             my_schema = utils.get_schema(schema)
 
             # Check the data
-            for row_num, row in enumerate(self.data):
+            for row_num, row in enumerate(self._peek_data()):
                 for pos, datum in enumerate(row):
                     errors.extend(my_schema.val_type(f"{self.category}.{self._tags[pos]}", datum, category=category))
 
         if validate_star:
             # Check for wrong data size
             num_cols = len(self._tags)
-            for row_num, row in enumerate(self.data):
+            for row_num, row in enumerate(self._peek_data()):
                 # Make sure the width matches
                 if len(row) != num_cols:
                     errors.append(f"Loop '{self.category}' data width does not match it's tag width on "
                                   f"row '{row_num}'.")
 
         return errors
+
+    def write_csv(self, the_file: TextIO, header: bool = True, show_category: bool = True,
+                  rows_per_chunk: int = 10000) -> int:
+        """ Writes the data of the loop to an open text file as CSV, the same
+        as get_data_as_csv() returns it. The rows are written rows_per_chunk
+        at a time, without turning a lazy or column representation into
+        rows, so the memory used doesn't depend on the size of the loop.
+        Returns the number of rows written (not counting the header). """
+
+        csv_header = self._csv_header(header, show_category)
+        num_rows = len(self)
+        if csv_header is not None:
+            the_file.write(dump_csv_rows([], csv_header))
+        for start in range(0, num_rows, rows_per_chunk):
+            the_file.write(dump_csv_rows(self._data_slice(start, start + rows_per_chunk)))
+        return num_rows
+
+    def write_ndjson(self, the_file: TextIO, entry_id: Optional[str] = None, saveframe: Optional[str] = None,
+                     rows_per_chunk: int = 10000) -> int:
+        """ Writes the loop to an open text file as newline delimited JSON,
+        with one JSON object per row. Each object has the category of the
+        loop under "category" (after the entry ID under "entry_id" and the
+        saveframe name under "saveframe", if provided), and then the value
+        of each tag under the tag name. The values are written as in
+        get_json().
+
+        As with iter_json(), the rows are written rows_per_chunk at a time,
+        so the memory used doesn't depend on the size of the loop. Returns
+        the number of rows written. """
+
+        metadata = {}
+        if entry_id is not None:
+            metadata["entry_id"] = entry_id
+        if saveframe is not None:
+            metadata["saveframe"] = saveframe
+        metadata["category"] = self.category
+        for tag in self._tags:
+            if tag in metadata:
+                raise ValueError(f"The loop has a tag named '{tag}', which is also used for the {tag} of each row.")
+
+        row_start = dump_json(metadata)[:-1]
+        prefixes = [f", {dump_json(tag)}: " for tag in self._tags]
+        num_rows = len(self)
+        for start in range(0, num_rows, rows_per_chunk):
+            the_file.write(dump_json_rows(self._data_slice(start, start + rows_per_chunk), row_start, prefixes, "}\n",
+                                          ""))
+        return num_rows
@@ -1,6 +1,6 @@
 import logging
 import re
-from typing import Optional
+from typing import Optional, Iterable, Dict
 
 from pynmrstar import definitions, cnmrstar, entry as entry_mod, loop as loop_mod, saveframe as saveframe_mod, schema as schema_mod
 from pynmrstar.exceptions import ParsingError
@@ -22,13 +22,22 @@ class Parser(object):
         self.token: str = ""
         self.source: str = "unknown"
         self.delimiter: str = " "
+        self.kind: Optional[int] = None
         self.line_number: int = 0
+        self._token_stream = None
+        # How many values were interned during the last parse, see cnmrstar.TokenStream.intern_stats()
+        self.intern_stats: Optional[Dict[str, int]] = None
 
     def get_token(self) -> str:
-        """ Returns the next token in the parsing process."""
+        """ Returns the next token in the parsing process. The kind of token
+        (cnmrstar.DATA, cnmrstar.TAG, cnmrstar.VALUE, etc.) is stored in
+        self.kind."""
 
         try:
-            self.token, self.line_number, self.delimiter = cnmrstar.get_token_full()
+            if self._token_stream is not None:
+                self.token, self.line_number, self.delimiter, self.kind = self._token_stream.get_token_typed()
+            else:
+                self.token, self.line_number, self.delimiter, self.kind = cnmrstar.get_token_typed()
         except ValueError as err:
             raise ParsingError(str(err))
 
@@ -53,7 +62,8 @@ class Parser(object):
               source: str = "unknown",
               raise_parse_warnings: bool = False,
               convert_data_types: bool = False,
-              schema: 'schema_mod.Schema' = None) -> 'entry_mod.Entry':
+              schema: 'schema_mod.Schema' = None,
+              lazy: bool = False) -> 'entry_mod.Entry':
         """ Parses the string provided as data as an NMR-STAR entry
         and returns the parsed entry. Raises ParsingError on exceptions.
 
@@ -69,13 +79,88 @@ class Parser(object):
         Multi-line values should look like this:
         \n;\nThe multi-line\nvalue here.\n;\n
         but the tag looked like this:
-        \n; The multi-line\nvalue here.\n;\n"""
+        \n; The multi-line\nvalue here.\n;\n
+
+        Set lazy to keep the values of loops as positions within the
+        tokenized data, only creating the values once they are accessed.
+        This is ignored if convert_data_types is set."""
+
+        # The tokenizer does the same clean up of the data as load_data()
+        token_stream = cnmrstar.tokenize(data, definitions.PARSE_THREADS, definitions.PARSE_CHUNK_SIZE)
+        return self.parse_tokens(token_stream,
+                                 source=source,
+                                 raise_parse_warnings=raise_parse_warnings,
+                                 convert_data_types=convert_data_types,
+                                 schema=schema,
+                                 lazy=lazy)
+
+    def parse_tokens(self,
+                     token_stream: 'cnmrstar.TokenStream',
+                     source: str = "unknown",
+                     raise_parse_warnings: bool = False,
+                     convert_data_types: bool = False,
+                     schema: 'schema_mod.Schema' = None,
+                     lazy: bool = False) -> 'entry_mod.Entry':
+        """ Parses an entry from tokens that were already generated by
+        cnmrstar.tokenize(). Tokenizing does not need the GIL, so this allows
+        the tokenizing to happen in another thread. See parse() for the
+        meaning of the arguments."""
+
+        for _ in self.iter_parse_tokens(token_stream,
+                                        source=source,
+                                        raise_parse_warnings=raise_parse_warnings,
+                                        convert_data_types=convert_data_types,
+                                        schema=schema,
+                                        lazy=lazy):
+            pass
+
+        return self.ent
+
+    def iter_parse_tokens(self,
+                          token_stream: 'cnmrstar.TokenStream',
+                          source: str = "unknown",
+                          raise_parse_warnings: bool = False,
+                          convert_data_types: bool = False,
+                          schema: 'schema_mod.Schema' = None,
+                          lazy: bool = False) -> Iterable['saveframe_mod.Saveframe']:
+        """ The same as parse_tokens(), but returns a generator that yields
+        each saveframe as soon as it has been parsed. This allows the caller
+        to do other work in between saveframes."""
+
+        self._token_stream = token_stream
+        try:
+            yield from self._parse(source, raise_parse_warnings, convert_data_types, schema, lazy)
+        finally:
+            self.intern_stats = token_stream.intern_stats()
+            self._token_stream = None
+
+    def _parse(self,
+               source: str,
+               raise_parse_warnings: bool,
+               convert_data_types: bool,
+               schema: 'schema_mod.Schema',
+               lazy: bool = False) -> Iterable['saveframe_mod.Saveframe']:
+        """ Does the actual parsing once the tokens are available."""
+
+        # Converting data types needs every value anyway
+        lazy = lazy and not convert_data_types and self._token_stream is not None
+
+        # The kinds of tokens, looked up once since they are checked for every token
+        data_kind, save_start_kind, save_end_kind = cnmrstar.DATA, cnmrstar.SAVE_START, cnmrstar.SAVE_END
+        loop_kind, stop_kind, tag_kind = cnmrstar.LOOP, cnmrstar.STOP, cnmrstar.TAG
+        keyword_kinds = (save_end_kind, loop_kind, stop_kind)
+        keyword_prefix_kinds = (data_kind, cnmrstar.GLOBAL)
+
+        def is_reserved_keyword() -> bool:
+            """ Checks if the current token is one of the RESERVED_KEYWORDS."""
+            if self.kind in keyword_kinds:
+                return True
+            return self.kind in keyword_prefix_kinds and self.token.lower() in definitions.RESERVED_KEYWORDS
 
-        self.load_data(data)
         self.get_token()
 
         # Make sure this is actually a STAR file
-        if not self.token.lower().startswith("data_"):
+        if self.kind != data_kind:
             raise ParsingError("Invalid file. NMR-STAR files must start with 'data_' followed by the data name. "
                                f"Did you accidentally select the wrong file? Your file started with '{self.token}'.",
                                self.line_number)
@@ -96,11 +181,11 @@ class Parser(object):
         # We are expecting to get saveframes
         while self.get_token() is not None:
 
-            if not self.token.lower().startswith("save_"):
+            if self.kind != save_start_kind and self.kind != save_end_kind:
                 raise ParsingError(f"Only 'save_NAME' is valid in the body of a NMR-STAR file. Found '{self.token}'.",
                                    self.line_number)
 
-            if len(self.token) < 6:
+            if self.kind == save_end_kind:
                 raise ParsingError("'save_' must be followed by saveframe name. You have a 'save_' tag which is "
                                    "illegal without a specified saveframe name.", self.line_number)
 
@@ -116,7 +201,7 @@ class Parser(object):
             # We are in a saveframe
             while self.get_token() is not None:
 
-                if self.token.lower() == "loop_":
+                if self.kind == loop_kind:
                     if self.delimiter != " ":
                         raise ParsingError("The loop_ keyword may not be quoted or semicolon-delimited.",
                                            self.line_number)
@@ -130,7 +215,7 @@ class Parser(object):
                     while in_loop and self.get_token() is not None:
 
                         # Add a tag if it isn't quoted - if quoted, it should be treated as a data value
-                        if self.token.startswith("_") and self.delimiter == " ":
+                        if self.kind == tag_kind and self.delimiter == " ":
                             try:
                                 cur_loop.add_tag(self.token)
                             except ValueError as err:
@@ -148,7 +233,7 @@ class Parser(object):
 
                             # We are in the data block of a loop
                             while self.token is not None:
-                                if self.token.lower() == "stop_":
+                                if self.kind == stop_kind:
                                     if self.delimiter != " ":
                                         raise ParsingError(
                                             "The stop_ keyword may not be quoted or semicolon-delimited.",
@@ -173,22 +258,25 @@ class Parser(object):
                                                                f"indicates that either one or more tag values are "
                                                                f"either missing from or duplicated in this loop.",
                                                                self.line_number)
-                                        try:
-                                            cur_loop.add_data(cur_data,
-                                                              rearrange=True,
-                                                              convert_data_types=convert_data_types,
-                                                              schema=schema)
-                                        # If there is an issue with the loops during parsing, raise a parse error
-                                        #  rather than the ValueError that would be raised if they made the mistake
-                                        #   directly
-                                        except ValueError as e:
-                                            raise ParsingError(str(e))
+                                        if lazy:
+                                            cur_loop._lazy_values = cur_data
+                                        else:
+                                            try:
+                                                cur_loop.add_data(cur_data,
+                                                                  rearrange=True,
+                                                                  convert_data_types=convert_data_types,
+                                                                  schema=schema)
+                                            # If there is an issue with the loops during parsing, raise a parse
+                                            #  error rather than the ValueError that would be raised if they made
+                                            #   the mistake directly
+                                            except ValueError as e:
+                                                raise ParsingError(str(e))
                                     cur_data = []
 
                                     cur_loop = None
                                     in_loop = False
                                     break
-                                elif self.token.startswith("_") and self.delimiter == " ":
+                                elif self.kind == tag_kind and self.delimiter == " ":
                                     raise ParsingError("Cannot have more loop tags after loop data. Or perhaps this "
                                                        f"was a data value which was not quoted (but must be, "
                                                        f"if it starts with '_')? Value: '{self.token}'.",
@@ -199,7 +287,7 @@ class Parser(object):
                                                            "defined. Value: '{self.token}'",
                                                            self.line_number)
 
-                                    if self.token.lower() in definitions.RESERVED_KEYWORDS and self.delimiter == " ":
+                                    if self.delimiter == " " and is_reserved_keyword():
                                         error = "Cannot use keywords as data values unless quoted or semi-colon " \
                                                 "delimited. Perhaps this is a loop that wasn't properly terminated " \
                                                 "with a 'stop_' keyword before the saveframe ended or another loop " \
@@ -208,7 +296,12 @@ class Parser(object):
                                         if len(cur_data) > 0:
                                             error += f" Last loop data element parsed: '{cur_data[-1]}'."
                                         raise ParsingError(error, self.line_number)
-                                    cur_data.append(self.token)
+                                    if lazy:
+                                        # Read this and the rest of the values at once, stopping before
+                                        #  the token that ends the loop (or is an error)
+                                        cur_data = self._token_stream.read_loop_values(len(cur_loop.tags))
+                                    else:
+                                        cur_data.append(self.token)
                                     seen_data = True
 
                                 # Get the next token
@@ -218,13 +311,13 @@ class Parser(object):
                         raise ParsingError(f"Loop improperly terminated at end of file. Loops must end with the "
                                            f"'stop_' token, but the file ended without the stop token.",
                                            self.line_number)
-                    if self.token.lower() != 'stop_':
+                    if self.kind != stop_kind:
                         raise ParsingError(f"Loop improperly terminated at end of file. Loops must end with the "
                                            f"'stop_' token, but the token '{self.token}' was found instead.",
                                            self.line_number)
 
                 # Close saveframe
-                elif self.token.lower() == "save_":
+                elif self.kind == save_end_kind:
                     if self.delimiter not in " ;":
                         raise ParsingError("The save_ keyword may not be quoted or semicolon-delimited.",
                                            self.line_number)
@@ -237,7 +330,7 @@ class Parser(object):
                     break
 
                 # Invalid content in saveframe
-                elif not self.token.startswith("_"):
+                elif self.kind != tag_kind:
                     if cur_frame.name == 'internaluseyoushouldntseethis_frame':
                         raise ParsingError(f"Invalid token found in loop contents. Expecting 'loop_' "
                                            f"but found: '{self.token}'", line_number=self.line_number)
@@ -257,10 +350,10 @@ class Parser(object):
                     # We are in a saveframe and waiting for the saveframe tag
                     self.get_token()
                     if self.delimiter == " ":
-                        if self.token.lower() in definitions.RESERVED_KEYWORDS:
+                        if is_reserved_keyword():
                             raise ParsingError("Cannot use keywords as data values unless quoted or semi-colon "
                                                f"delimited. Illegal value: '{self.token}'", self.line_number)
-                        if self.token.startswith("_"):
+                        if self.kind == tag_kind:
                             raise ParsingError(
                                 "Cannot have a tag value start with an underscore unless the entire value "
                                 "is quoted. You may be missing a data value on the previous line. "
@@ -273,15 +366,12 @@ class Parser(object):
                     except ValueError as err:
                         raise ParsingError(str(err), line_number=self.line_number)
 
-            if not self.token or self.token.lower() != "save_":
+            if self.kind != save_end_kind:
                 raise ParsingError("Saveframe improperly terminated at end of file. Saveframes must be terminated "
                                    "with the 'save_' token.",
                                    self.line_number)
 
+            yield cur_frame
+
         # Free the memory of the original copy of the data we parsed
         self.full_data = None
-
-        # Reset the parser
-        cnmrstar.reset()
-
-        return self.ent
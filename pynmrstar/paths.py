@@ -0,0 +1,149 @@
+""" Tag names which are parsed once, and then used to fetch values from
+many entries, saveframes and loops. See :py:func:`pynmrstar.compile_path`. """
+
+import functools
+from operator import itemgetter
+from typing import Any, Callable, Dict, List, Optional, Sequence, Tuple, Union
+
+from pynmrstar import entry as entry_mod, loop as loop_mod, saveframe as saveframe_mod, utils, views
+
+# How many category names, and tag positions, each path remembers
+_MAX_CATEGORIES: int = 1024
+_MAX_POSITIONS: int = 8
+
+
+class TagPath(object):
+    """ A full tag name (such as ``_Atom_chem_shift.Val``) which has already
+    been parsed. Calling it on an entry, saveframe or loop returns the same
+    values as get_tag() would, but without parsing or lower-casing the tag
+    name each time.
+
+    Where the tag was found is remembered, and checked first the next time,
+    so the same path can be used on any number of entries (which nearly
+    always have their tags in the same order) with no string work. """
+
+    __slots__ = ('category', 'tag', '_category_lc', '_tag_lc', '_positions', '_categories')
+
+    def __init__(self, path: str) -> None:
+        """ You should normally use :py:func:`pynmrstar.compile_path` instead. """
+
+        if not isinstance(path, str) or "." not in path:
+            raise ValueError(f"A tag path must be the full name of a tag, including the category. For example, "
+                             f"'_Atom_chem_shift.Val'. Invalid path: {path!r}")
+
+        self.category: str = utils.format_category(path)
+        self.tag: str = utils.format_tag(path)
+        self._category_lc: str = self.category.lower()
+        self._tag_lc: str = self.tag.lower()
+        self._positions: List[Tuple[int, str]] = []
+        self._categories: Dict[Optional[str], bool] = {}
+
+    def __call__(self, item: Union['entry_mod.Entry', 'saveframe_mod.Saveframe', 'loop_mod.Loop']) -> List[Any]:
+        """ Returns all of the values of the tag in the entry, saveframe or
+        loop, the same as item.get_tag(path) would. (Except that a loop
+        without the tag gives no values rather than raising an error.) """
+
+        if isinstance(item, loop_mod.Loop):
+            position = self._loop_position(item)
+            return [] if position is None else list(item._peek_column(position))
+
+        if isinstance(item, saveframe_mod.Saveframe):
+            return self._saveframe_values(item)
+
+        if isinstance(item, entry_mod.Entry):
+            results = []
+            for saveframe in item._frame_list:
+                results.extend(self._saveframe_values(saveframe))
+            return results
+
+        raise ValueError(f"A tag path can only be used on an entry, saveframe, or loop. Invalid item: {item!r}")
+
+    def __repr__(self) -> str:
+        return f"<pynmrstar.paths.TagPath '{self.category}.{self.tag}'>"
+
+    def column(self, loop: 'loop_mod.Loop') -> Optional['views.ColumnView']:
+        """ Returns a view of the values of the tag in the loop (see
+        :py:meth:`pynmrstar.Loop.column`), or None if the loop doesn't
+        have the tag. """
+
+        position = self._loop_position(loop)
+        return None if position is None else views.ColumnView(loop, position)
+
+    def _matches_category(self, category: Optional[str]) -> bool:
+        """ Returns whether a loop category or saveframe tag prefix is the
+        category of the path. """
+
+        try:
+            return self._categories[category]
+        except KeyError:
+            pass
+        matches = category is not None and category.lower() == self._category_lc
+        if len(self._categories) < _MAX_CATEGORIES:
+            self._categories[category] = matches
+        return matches
+
+    def _position(self, tag_names: Sequence[Any], name_of: Callable[[Any], str]) -> Optional[int]:
+        """ Returns the position of the tag among the tags of a loop or
+        saveframe (name_of gets the name of each), or None.
+
+        A loop or saveframe can't have two tags which only differ in case,
+        so if one of the positions the tag was found at before still has a
+        tag of the same name, that must be the tag. Otherwise search the tag
+        names, and remember where the tag was found. """
+
+        num_tags = len(tag_names)
+        for position, tag_name in self._positions:
+            if position < num_tags and name_of(tag_names[position]) == tag_name:
+                return position
+
+        for position, tag in enumerate(tag_names):
+            tag_name = name_of(tag)
+            if tag_name.lower() == self._tag_lc:
+                if len(self._positions) < _MAX_POSITIONS:
+                    self._positions.append((position, tag_name))
+                return position
+        return None
+
+    def _loop_position(self, loop: 'loop_mod.Loop') -> Optional[int]:
+        """ Returns the position of the tag in the loop, or None. """
+
+        if not self._matches_category(loop.category):
+            return None
+        return self._position(loop._tags, _name_of_loop_tag)
+
+    def _saveframe_values(self, saveframe: 'saveframe_mod.Saveframe') -> List[Any]:
+        """ Returns the values of the tag in the saveframe and its loops. """
+
+        results = []
+        for each_loop in saveframe._loops:
+            position = self._loop_position(each_loop)
+            if position is not None:
+                results.extend(each_loop._peek_column(position))
+
+        if self._matches_category(saveframe.tag_prefix):
+            position = self._position(saveframe._tags, _name_of_saveframe_tag)
+            if position is not None:
+                results.append(saveframe._tags[position][1])
+        return results
+
+
+def _name_of_loop_tag(tag: str) -> str:
+    return tag
+
+
+_name_of_saveframe_tag = itemgetter(0)
+
+
+@functools.lru_cache(maxsize=1024)
+def compile_path(path: str) -> TagPath:
+    """ Parses a full tag name (such as ``_Atom_chem_shift.Val``) once, and
+    returns a :py:class:`pynmrstar.paths.TagPath` which can be called on any
+    entry, saveframe, or loop to get the values of that tag. This is much
+    faster than calling get_tag() with the same tag name many times::
+
+        shift_value = pynmrstar.compile_path('_Atom_chem_shift.Val')
+        for entry in entries:
+            values = shift_value(entry)
+    """
+
+    return TagPath(path)
@@ -0,0 +1,108 @@
+""" Record classes for the rows of loops, generated from the schema. See
+:py:meth:`pynmrstar.Schema.row_class` and :py:meth:`pynmrstar.Loop.rows_as`. """
+
+import functools
+import keyword
+import re
+from operator import attrgetter
+from typing import Any, Callable, Dict, Iterator, Optional, Sequence, Tuple, Type
+
+
+class Row(object):
+    """ The base class of the generated row classes. Each tag of the
+    category is an attribute, so the values can be accessed by name. The
+    classes use __slots__, so rows take little memory and misspelled tag
+    names raise an AttributeError. """
+
+    __slots__ = ()
+
+    # Set on each generated class
+    category: str = None
+    _fields: Tuple[str, ...] = ()
+    _tags: Tuple[str, ...] = ()
+    _values: Callable[['Row'], Tuple[Any, ...]] = None
+
+    def __eq__(self, other) -> bool:
+        if other.__class__ is not self.__class__:
+            return NotImplemented
+        return tuple(self) == tuple(other)
+
+    def __iter__(self) -> Iterator[Any]:
+        """ Yields the values, in the order of the tags in the schema. """
+
+        values = self._values(self)
+        return iter(values if len(self._fields) > 1 else (values,))
+
+    def __repr__(self) -> str:
+        values = ', '.join(f"{field}={value!r}" for field, value in zip(self._fields, self))
+        return f"{self.__class__.__name__}({values})"
+
+    def as_dict(self) -> Dict[str, Any]:
+        """ Returns the values as a dictionary of full tag name to value. """
+
+        return {f"{self.category}.{tag}": value for tag, value in zip(self._tags, self)}
+
+
+def _field_name(tag: str) -> str:
+    """ Returns the attribute name used for a tag. Almost all tag names are
+    already valid identifiers. """
+
+    name = re.sub(r'\W', '_', tag)
+    if not name.isidentifier() or keyword.iskeyword(name):
+        name = '_' + name
+    return name
+
+
+def make_row_class(category: str, tags: Sequence[str], types: Sequence[type]) -> Type[Row]:
+    """ Generates a row class for a loop category, with an attribute for
+    each of the tags. The class is named after the category, so that
+    _Atom_chem_shift gives AtomChemShiftRow. types are used for the type
+    annotations of the attributes. """
+
+    fields = tuple(_field_name(_) for _ in tags)
+    name = ''.join(_[:1].upper() + _[1:] for _ in category.strip('_').split('_')) + 'Row'
+
+    # Generate __init__() in the same way as collections.namedtuple() does, as it is much faster than setattr()
+    arguments = ''.join(f", {_}=None" for _ in fields)
+    assignments = ''.join(f"\n    self.{_} = {_}" for _ in fields)
+    namespace: Dict[str, Any] = {}
+    exec(f"def __init__(self{arguments}):{assignments or ' pass'}\n", namespace)
+    namespace['__init__'].__qualname__ = f"{name}.__init__"
+
+    return type(name, (Row,), {'__slots__': fields,
+                               '__init__': namespace['__init__'],
+                               '__annotations__': {field: Optional[type_] for field, type_ in zip(fields, types)},
+                               '__module__': __name__,
+                               '__doc__': f"A row of the loop {category}. Generated from the schema.",
+                               'category': category,
+                               '_fields': fields,
+                               '_tags': tuple(tags),
+                               '_values': attrgetter(*fields) if fields else lambda _: ()})
+
+
+@functools.lru_cache(maxsize=256)
+def row_loader(row_class: Type[Row], loop_tags: Tuple[str, ...],
+               convert: Optional[Callable[[str, Any], Any]] = None) -> Callable[[Sequence[Any]], Row]:
+    """ Generates a function which creates a row object from a row of a
+    loop with the given tags, without going through a dictionary. Tags of
+    the loop which the row class doesn't have are left out, and tags the
+    loop doesn't have are None. If convert is given, it is called with the
+    full tag name and the value of each tag. """
+
+    positions = {}
+    for position, tag in enumerate(loop_tags):
+        positions.setdefault(tag.lower(), position)
+
+    arguments = []
+    for tag in row_class._tags:
+        position = positions.get(tag.lower())
+        if position is None:
+            arguments.append('None')
+        elif convert is not None:
+            arguments.append(f"convert({row_class.category + '.' + tag!r}, row[{position}])")
+        else:
+            arguments.append(f"row[{position}]")
+
+    namespace: Dict[str, Any] = {'row_class': row_class, 'convert': convert}
+    exec(f"def load(row):\n    return row_class({', '.join(arguments)})\n", namespace)
+    return namespace['load']
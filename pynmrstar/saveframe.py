@@ -1,15 +1,39 @@
-import json
+import sys
 import warnings
-from csv import reader as csv_reader, writer as csv_writer
+from csv import reader as csv_reader
 from io import StringIO
-from typing import TextIO, BinaryIO, Union, List, Optional, Any, Dict, Iterable, Tuple
+from itertools import chain
+from typing import TextIO, BinaryIO, Union, List, Optional, Any, Dict, Iterable, Iterator, Tuple
 
 from pynmrstar import definitions, entry as entry_mod, loop as loop_mod, parser as parser_mod, utils
-from pynmrstar._internal import _get_comments, _json_serialize, _interpret_file, get_clean_tag_list, write_to_file
+from pynmrstar._internal import _get_comments, _interpret_file, check_not_frozen, content_digest, dump_csv_rows, \
+    dump_json, get_clean_tag_list, load_json, same_objects, write_to_file
 from pynmrstar.exceptions import InvalidStateError
 from pynmrstar.schema import Schema
 
 
+def _restore_saveframe(name: str, category: Optional[str], tag_prefix: Optional[str], tag_names: Tuple[str, ...],
+                       tag_values: List[Any], loops: List['loop_mod.Loop'], frozen: bool,
+                       source: str) -> 'Saveframe':
+    """ Unpickles a saveframe pickled by Saveframe.__reduce_ex__(). """
+
+    saveframe = Saveframe.__new__(Saveframe)
+    if frozen:
+        saveframe._tags = tuple(zip(tag_names, tag_values))
+        saveframe._loops = tuple(loops)
+    else:
+        saveframe._tags = [list(_) for _ in zip(tag_names, tag_values)]
+        saveframe._loops = loops
+    saveframe._name = name
+    saveframe.source = source
+    saveframe._category = category
+    saveframe.tag_prefix = tag_prefix
+    saveframe._frozen = frozen
+    saveframe._hash = None
+    saveframe._digest = None
+    return saveframe
+
+
 class Saveframe(object):
     """A saveframe object. Create using the class methods, see below."""
 
@@ -70,8 +94,13 @@ class Saveframe(object):
         if not isinstance(other, Saveframe):
             return False
 
-        return (self.name, self._category, self._tags, self._loops) == \
-               (other.name, other._category, other._tags, other._loops)
+        # Only use the digests if both were worked out before, as working them out takes longer than comparing
+        if self._digest is not None and other._digest is not None and \
+                self._content_digest() == other._content_digest():
+            return True
+
+        return (self.name, self._category, [list(_) for _ in self._tags], list(self._loops)) == \
+               (other.name, other._category, [list(_) for _ in other._tags], list(other._loops))
 
     def __getitem__(self, item: Union[int, str]) -> Union[list, 'loop_mod.Loop']:
         """Get the indicated loop or tag."""
@@ -95,6 +124,15 @@ class Saveframe(object):
                     raise KeyError(f"No tag matching '{item}'.")
                 return results
 
+    def __hash__(self) -> int:
+        """ Only frozen saveframes are hashable. See :py:meth:`Saveframe.freeze`. """
+
+        if not self._frozen:
+            raise TypeError(f"{self!r} isn't frozen, so it isn't hashable. See Saveframe.freeze().")
+        if self._hash is None:
+            self._hash = hash((self.name, self._category, self._tags, self._loops))
+        return self._hash
+
     def __iter__(self) -> Iterable["loop_mod.Loop"]:
         """ Yields each of the loops contained within the saveframe. """
 
@@ -134,6 +172,11 @@ class Saveframe(object):
         self.source: str = "unknown"
         self._category: Optional[str] = None
         self.tag_prefix: Optional[str] = None
+        # See Saveframe.freeze()
+        self._frozen: bool = False
+        self._hash: Optional[int] = None
+        # What the content digest was worked out from, and the digest, see Saveframe._content_digest()
+        self._digest: Optional[Tuple[tuple, bytes]] = None
 
         star_buffer: StringIO = StringIO('')
 
@@ -257,6 +300,8 @@ class Saveframe(object):
         """ Updates the saveframe category. Sets the Sf_category tag if not present,
          updates it if present. """
 
+        check_not_frozen(self)
+
         if category in definitions.NULL_VALUES:
             raise ValueError("Cannot set the saveframe category to a null-equivalent value.")
 
@@ -310,6 +355,8 @@ class Saveframe(object):
     def name(self, name):
         """ Updates the saveframe name. """
 
+        check_not_frozen(self)
+
         for char in str(name):
             if char in utils.definitions.WHITESPACE:
                 raise ValueError("Saveframe names can not contain whitespace characters.")
@@ -384,7 +431,7 @@ class Saveframe(object):
         # If they provided a string, try to load it using JSON
         if not isinstance(json_dict, dict):
             try:
-                json_dict = json.loads(json_dict)
+                json_dict = load_json(json_dict)
             except (TypeError, ValueError):
                 raise ValueError("The JSON you provided was neither a Python dictionary nor a JSON string.")
 
@@ -469,9 +516,28 @@ class Saveframe(object):
 
         return f"<pynmrstar.Saveframe '{self.name}'>"
 
+    def __reduce_ex__(self, protocol: int) -> tuple:
+        """ Pickles (and copies) the saveframe with the tag names and values
+        as two flat sequences, rather than a list per tag. The hash isn't
+        kept, as str hashes differ between processes. """
+
+        return _restore_saveframe, (self._name, self._category, self.tag_prefix, tuple([_[0] for _ in self._tags]),
+                                    [_[1] for _ in self._tags], list(self._loops), self._frozen, self.source)
+
+    def __setstate__(self, state: dict) -> None:
+        """ Restores saveframes pickled by older versions, which pickled the
+        attributes of the saveframe. """
+
+        state.setdefault('_frozen', False)
+        state.setdefault('_hash', None)
+        state.setdefault('_digest', None)
+        self.__dict__.update(state)
+
     def __setitem__(self, key: Union[str, int], item: Union[str, 'loop_mod.Loop']) -> None:
         """Set the indicated loop or tag."""
 
+        check_not_frozen(self)
+
         # It's a loop
         if isinstance(item, loop_mod.Loop):
             try:
@@ -545,6 +611,8 @@ class Saveframe(object):
     def add_loop(self, loop_to_add: 'loop_mod.Loop') -> None:
         """Add a loop to the saveframe loops."""
 
+        check_not_frozen(self)
+
         if loop_to_add.category in self.loop_dict or str(loop_to_add.category).lower() in self.loop_dict:
             if loop_to_add.category is None:
                 raise ValueError("You cannot have two loops with the same category in one saveframe. You are getting "
@@ -573,6 +641,8 @@ class Saveframe(object):
         Optionally specify a schema if you don't want to use the default schema.
         """
 
+        check_not_frozen(self)
+
         if not isinstance(name, str):
             raise ValueError('Tag names must be strings.')
 
@@ -580,7 +650,7 @@ class Saveframe(object):
             if name[0] != ".":
                 prefix = utils.format_category(name)
                 if self.tag_prefix is None:
-                    self.tag_prefix = prefix
+                    self.tag_prefix = sys.intern(prefix)
                 elif self.tag_prefix != prefix:
                     raise ValueError(
                         "One saveframe cannot have tags with different categories (or tags that don't "
@@ -615,6 +685,9 @@ class Saveframe(object):
                 self.get_tag(name, whole_tag=True)[0][1] = value
                 return
 
+        # Tag names repeat in every saveframe of the category, so only keep one copy of each
+        name = sys.intern(name)
+
         # See if we need to convert the data type
         if convert_data_types:
             new_tag = [name, utils.get_schema(schema).convert_tag(self.tag_prefix + "." + name, value)]
@@ -658,6 +731,8 @@ class Saveframe(object):
         Set recursive to False to only operate on the tags in this saveframe,
         and not those in child loops."""
 
+        check_not_frozen(self)
+
         if not self.tag_prefix:
             raise InvalidStateError("You must first specify the tag prefix of this Saveframe before calling this "
                                     "method. You can do this by adding a fully qualified tag "
@@ -692,6 +767,20 @@ class Saveframe(object):
 
         self.sort_tags()
 
+    def clone(self) -> 'Saveframe':
+        """ Returns a copy of the saveframe. The tags are copied, and the
+        loops are cloned, so that they share their data with the loops of
+        this saveframe until either is modified. See :py:meth:`Loop.clone`.
+
+        The clone of a frozen saveframe is not frozen. """
+
+        result = Saveframe.from_scratch(self._name, source=self.source)
+        result._tags = [list(_) for _ in self._tags]
+        result._loops = [_.clone() for _ in self._loops]
+        result._category = self._category
+        result.tag_prefix = self.tag_prefix
+        return result
+
     def compare(self, other) -> List[str]:
         """Returns the differences between two saveframes as a list.
         Non-equal saveframes will always be detected, but specific
@@ -711,6 +800,9 @@ class Saveframe(object):
         elif not isinstance(other, Saveframe):
             return ['Other object is not of class Saveframe.']
 
+        if self._content_digest() == other._content_digest():
+            return []
+
         # We need to do this in case of an extra "\n" on the end of one tag
         if str(other) == str(self):
             return []
@@ -768,6 +860,31 @@ class Saveframe(object):
 
         return diffs
 
+    def content_hash(self) -> str:
+        """ Returns a hash of the contents of the saveframe (its name, tags,
+        and loops) as a hex string, which is the same in every process.
+        Saveframes with the same content hash are equal. It is worked out
+        from the tags and the content hashes of the loops (see
+        :py:meth:`pynmrstar.Loop.content_hash`), which are remembered until
+        the loops are modified. """
+
+        return self._content_digest().hex()
+
+    def _content_digest(self) -> bytes:
+        """ Returns the digest for Saveframe.content_hash(). It is remembered
+        along with the objects it was worked out from (the tags, and the
+        digests of the loops, which stay the same objects while the loops
+        don't change), so it is only worked out again once one of them
+        changes. """
+
+        loop_digests = [_._content_digest() for _ in self._loops]
+        key = (self.name, self._category, self.tag_prefix, len(self._tags), *chain.from_iterable(self._tags),
+               *loop_digests)
+        if self._digest is None or not same_objects(self._digest[0], key):
+            self._digest = (key, content_digest([self.name, self._category, self.tag_prefix,
+                                                 [list(_) for _ in self._tags], len(self._loops)], loop_digests))
+        return self._digest[1]
+
     def delete_tag(self, tag: str) -> None:
         """ Deprecated, please see :py:meth:`pynmrstar.Saveframe.remove_tag`. """
 
@@ -779,23 +896,14 @@ class Saveframe(object):
         string. Set header to False omit the header. Set show_category
         to False to omit the loop category from the headers."""
 
-        csv_buffer = StringIO()
-        csv_writer_object = csv_writer(csv_buffer)
-
+        csv_header = None
         if header:
             if show_category:
-                csv_writer_object.writerow([str(self.tag_prefix) + "." + str(x[0]) for x in self._tags])
+                csv_header = [str(self.tag_prefix) + "." + str(x[0]) for x in self._tags]
             else:
-                csv_writer_object.writerow([str(x[0]) for x in self._tags])
-
-        data = []
-        for each_tag in self._tags:
-            data.append(each_tag[1])
+                csv_header = [str(x[0]) for x in self._tags]
 
-        csv_writer_object.writerow(data)
-
-        csv_buffer.seek(0)
-        return csv_buffer.read().replace('\r\n', '\n')
+        return dump_csv_rows([[x[1] for x in self._tags]], csv_header)
 
     def format(self, skip_empty_loops: bool = True, skip_empty_tags: bool = False, show_comments: bool = True) -> str:
         """ The same as calling str(Saveframe), except that you can pass options
@@ -808,12 +916,30 @@ class Saveframe(object):
         return self.__str__(skip_empty_loops=skip_empty_loops, show_comments=show_comments,
                             skip_empty_tags=skip_empty_tags)
 
+    def freeze(self) -> None:
+        """ Makes the saveframe, and all of its loops, immutable. The tags
+        are stored as tuples, and methods which would modify the saveframe
+        raise an InvalidStateError instead. A frozen saveframe is hashable
+        and is safe to share between threads. See :py:meth:`Loop.freeze`."""
+
+        if self._frozen:
+            return
+
+        for each_loop in self._loops:
+            each_loop.freeze()
+        self._tags = tuple(tuple(_) for _ in self._tags)
+        self._loops = tuple(self._loops)
+        self._frozen = True
+
     def get_json(self, serialize: bool = True) -> Union[dict, str]:
         """ Returns the saveframe in JSON format. If serialize is set to
         False a dictionary representation of the saveframe that is
         serializeable is returned."""
 
-        saveframe_data = {
+        if serialize:
+            return dump_json(self._json_dict())
+
+        return {
             "name": self.name,
             "category": self._category,
             "tag_prefix": self.tag_prefix,
@@ -821,10 +947,17 @@ class Saveframe(object):
             "loops": [x.get_json(serialize=False) for x in self._loops]
         }
 
-        if serialize:
-            return json.dumps(saveframe_data, default=_json_serialize)
-        else:
-            return saveframe_data
+    def _json_dict(self) -> dict:
+        """ Returns what get_json(serialize=False) would, but leaves the
+        data of the loops as it is stored, for dump_json(). """
+
+        return {
+            "name": self.name,
+            "category": self._category,
+            "tag_prefix": self.tag_prefix,
+            "tags": self._tags,
+            "loops": [x._json_dict() for x in self._loops]
+        }
 
     def get_loop(self, name: str) -> 'loop_mod.Loop':
         """Return a loop based on the loop name (category)."""
@@ -875,6 +1008,23 @@ class Saveframe(object):
 
         return results
 
+    def iter_json(self, rows_per_chunk: int = 10000) -> Iterator[str]:
+        """ Yields the saveframe in JSON format in pieces, which joined
+        together are the same as get_json(). See
+        :py:meth:`pynmrstar.Loop.iter_json`. """
+
+        yield dump_json({
+            "name": self.name,
+            "category": self._category,
+            "tag_prefix": self.tag_prefix,
+            "tags": self._tags
+        })[:-1] + ', "loops": ['
+        for position, each_loop in enumerate(self._loops):
+            if position:
+                yield ", "
+            yield from each_loop.iter_json(rows_per_chunk)
+        yield "]}"
+
     def loop_iterator(self) -> Iterable['loop_mod.Loop']:
         """Returns an iterator for saveframe loops."""
 
@@ -892,6 +1042,8 @@ class Saveframe(object):
         """ Removes one or more loops from the saveframe. You can remove loops either by passing the loop object itself,
         the loop category (as a string), or a list or tuple of either."""
 
+        check_not_frozen(self)
+
         parsed_list: list
         if isinstance(item, tuple):
             parsed_list = list(item)
@@ -930,6 +1082,8 @@ class Saveframe(object):
         """Removes one or more tags from the saveframe based on tag name(s).
         Provide either a tag name or a list or tuple containing tag names. """
 
+        check_not_frozen(self)
+
         tags = get_clean_tag_list(item)
         lc_tags = self._lc_tags
 
@@ -944,6 +1098,8 @@ class Saveframe(object):
     def set_tag_prefix(self, tag_prefix: str) -> None:
         """Set the tag prefix for this saveframe."""
 
+        check_not_frozen(self)
+
         self.tag_prefix = utils.format_category(tag_prefix)
 
     def sort_tags(self, schema: Schema = None) -> None:
@@ -951,6 +1107,8 @@ class Saveframe(object):
         schema. Will automatically use the standard schema if none
         is provided."""
 
+        check_not_frozen(self)
+
         schema = utils.get_schema(schema)
 
         def sort_key(x) -> int:
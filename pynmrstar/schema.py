@@ -6,9 +6,9 @@ from csv import DictReader
 from datetime import date
 from functools import lru_cache
 from io import StringIO
-from typing import Union, List, Optional, Any, Dict, IO
+from typing import Union, List, Optional, Any, Dict, IO, Type
 
-from pynmrstar import definitions, utils
+from pynmrstar import definitions, rows, utils
 from pynmrstar._internal import _interpret_file
 
 logger = logging.getLogger('pynmrstar')
@@ -258,6 +258,39 @@ class Schema(object):
         # We don't know the data type, so just keep it a string
         return value
 
+    def row_class(self, category: str) -> Type['rows.Row']:
+        """ Returns a class for the rows of loops of the given category
+        (such as '_Atom_chem_shift'), generated from this schema. The class
+        has an attribute for each tag of the category, typed according to
+        the schema. Use it with :py:meth:`pynmrstar.Loop.rows_as`. The
+        class is only generated once. """
+
+        return self._row_class(utils.format_category(category).lower())
+
+    @lru_cache(maxsize=1024)
+    def _row_class(self, category_lc: str) -> Type['rows.Row']:
+        """ Generates the row class for a lower-case category name. """
+
+        tags = [self.schema[_.lower()]['Tag'] for _ in self.schema_order
+                if utils.format_category(_).lower() == category_lc and self.schema[_.lower()]['Loopflag'] == 'Y']
+        if not tags:
+            raise ValueError(f"The category '{category_lc}' is not the category of a loop in the schema.")
+
+        return rows.make_row_class(utils.format_category(tags[0]), [utils.format_tag(_) for _ in tags],
+                                   [self._python_type(_) for _ in tags])
+
+    def _python_type(self, tag: str) -> type:
+        """ Returns the type which convert_tag() converts values of the tag to. """
+
+        value_type = self.schema[tag.lower()]["Data Type"]
+        if "INTEGER" in value_type:
+            return int
+        if "FLOAT" in value_type:
+            return decimal.Decimal
+        if "DATETIME year to day" in value_type:
+            return date
+        return str
+
     def string_representation(self, search: bool = None) -> str:
         """ Prints all the tags in the schema if search is not specified
         and prints the tags that contain the search string if it is."""
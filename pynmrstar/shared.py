@@ -0,0 +1,520 @@
+""" Entries stored once, in shared memory or a memory-mapped file, and read
+by any number of processes without parsing or copying them. See
+:py:class:`pynmrstar.shared.SharedEntryStore`. """
+
+import json
+import mmap
+import os
+import struct
+import sys
+from array import array
+from collections import Counter
+from collections.abc import Sequence as SequenceABC
+from itertools import chain
+from typing import Any, Dict, IO, Iterable, Iterator, List, Optional, Tuple, Union
+
+from pynmrstar import entry as entry_mod, loop as loop_mod, saveframe as saveframe_mod, utils
+
+try:
+    from multiprocessing import shared_memory
+except ImportError:
+    # Python 3.7
+    shared_memory = None
+
+# The names of the entry stores in shared memory created by this process, which its resource tracker removes on exit
+_created_names: set = set()
+
+# The layout starts with the magic bytes, the version of the layout, the byte order, and the length of the header
+_MAGIC: bytes = b'NMRSTARB'
+_VERSION: int = 1
+_PREAMBLE: struct.Struct = struct.Struct('<8sII8sQ')
+# How many of the most common values are decoded once, rather than each time they are read
+_COMMON_VALUES: int = 4096
+# Stands in for the common values which haven't been decoded yet
+_NOT_DECODED: Any = object()
+
+
+def _align(position: int) -> int:
+    """ Returns the position rounded up to a multiple of 8 bytes. """
+
+    return (position + 7) & ~7
+
+
+def _string_value(value: Any) -> Optional[str]:
+    """ Values are stored as the strings they print as. """
+
+    if value is None or value.__class__ is str:
+        return value
+    return str(value)
+
+
+def encode_entries(entries: Iterable['entry_mod.Entry']) -> bytearray:
+    """ Returns the binary layout of the entries, which
+    :py:class:`SharedEntryStore` reads.
+
+    Every distinct value of the loops is stored once, in a table of UTF-8
+    strings ordered from the most to the least common, so that most
+    columns only need one byte per value. Each loop column is stored as an
+    array of positions in that table (with 0 meaning None). The structure
+    of each entry (the saveframes, their tags, and the tags of each loop)
+    is stored as JSON, which is only read when the entry is first used.
+    Values are stored as the strings they print as, so converted data types
+    are not kept. """
+
+    entries = list(entries)
+    entry_ids = [str(_.entry_id) for _ in entries]
+    if len(set(entry_ids)) != len(entry_ids):
+        raise ValueError(f"The entry IDs must be unique. Entry IDs: {', '.join(entry_ids)}")
+
+    # Count every value first, so the most common values get the smallest codes
+    counts: Counter = Counter()
+    for each_entry in entries:
+        for each_loop in chain.from_iterable(_._loops for _ in each_entry._frame_list):
+            each_loop._check_tags_match_data()
+            for position in range(len(each_loop._tags) if len(each_loop) else 0):
+                counts.update(map(_string_value, each_loop._peek_column(position)))
+    counts.pop(None, None)
+    strings = [_ for _, count in counts.most_common()]
+    codes_of: Dict[Optional[str], int] = {value: code for code, value in enumerate(strings, 1)}
+    codes_of[None] = 0
+
+    encoded = [_.encode('utf-8', 'surrogatepass') for _ in strings]
+    offsets = array('Q', [0])
+    total = 0
+    for value in encoded:
+        total += len(value)
+        offsets.append(total)
+
+    # The data section: the string table, followed by the codes of each column
+    sections: List[Union[bytes, array]] = [offsets, b''.join(encoded)]
+    position = _align(offsets.itemsize * len(offsets) + total)
+    sections.append(b'\0' * (position - offsets.itemsize * len(offsets) - total))
+
+    structures = []
+    for each_entry in entries:
+        frame_headers = []
+        for saveframe in each_entry._frame_list:
+            loop_headers = []
+            for each_loop in saveframe._loops:
+                columns = []
+                for column_position in range(len(each_loop._tags) if len(each_loop) else 0):
+                    codes = array('I', map(codes_of.__getitem__,
+                                           map(_string_value, each_loop._peek_column(column_position))))
+                    largest = max(codes, default=0)
+                    if largest < 256:
+                        codes = array('B', codes)
+                    elif largest < 65536:
+                        codes = array('H', codes)
+                    columns.append([codes.typecode, position])
+                    length = codes.itemsize * len(codes)
+                    sections.append(codes)
+                    sections.append(b'\0' * (_align(length) - length))
+                    position += _align(length)
+                loop_headers.append({'category': each_loop.category, 'tags': list(each_loop._tags),
+                                     'rows': len(each_loop), 'columns': columns, 'source': each_loop.source})
+            frame_headers.append({'name': saveframe._name, 'category': saveframe._category,
+                                  'tag_prefix': saveframe.tag_prefix, 'tags': [_[0] for _ in saveframe._tags],
+                                  'values': [_string_value(_[1]) for _ in saveframe._tags], 'loops': loop_headers,
+                                  'source': saveframe.source})
+        structures.append(json.dumps({'entry_id': each_entry._entry_id, 'source': each_entry.source,
+                                      'saveframes': frame_headers},
+                                     ensure_ascii=False, separators=(',', ':')).encode('utf-8', 'surrogatepass'))
+
+    # The header lists where the structure of each entry is, so that each process only reads the entries it uses
+    directory = []
+    structure_bytes = 0
+    for entry_id, structure in zip(entry_ids, structures):
+        directory.append([entry_id, structure_bytes, len(structure)])
+        structure_bytes += len(structure)
+    header = json.dumps({'strings': len(strings), 'string_bytes': total, 'structure_bytes': structure_bytes,
+                         'entries': directory}, ensure_ascii=False, separators=(',', ':')).encode('utf-8')
+    byte_order = sys.byteorder.encode().ljust(8, b'\0')
+
+    result = bytearray(_PREAMBLE.pack(_MAGIC, _VERSION, 0, byte_order, len(header)))
+    result += header
+    for structure in structures:
+        result += structure
+    result += b'\0' * (_align(len(result)) - len(result))
+    for section in sections:
+        result += section
+    return result
+
+
+def is_binary_file(the_file: Any) -> bool:
+    """ Returns whether the_file is the name of a file in the binary format
+    (see :py:meth:`pynmrstar.Entry.write_to_file`), or a seekable file
+    object opened in binary mode which is positioned at the start of one. """
+
+    if hasattr(the_file, 'read'):
+        if not hasattr(the_file, 'seekable') or not the_file.seekable():
+            return False
+        position = the_file.tell()
+        try:
+            return the_file.read(len(_MAGIC)) == _MAGIC
+        finally:
+            the_file.seek(position)
+    if not isinstance(the_file, str) or the_file.startswith(("http://", "https://", "ftp://")):
+        return False
+    try:
+        with open(the_file, 'rb') as binary_file:
+            return binary_file.read(len(_MAGIC)) == _MAGIC
+    except OSError:
+        return False
+
+
+def read_binary_file(file_name: Union[str, IO], convert_data_types: bool = False, schema: Any = None,
+                     readonly: bool = False) -> 'entry_mod.Entry':
+    """ Loads the entry from a file in the binary format. The file is
+    memory-mapped (a file object is read into memory instead), and the
+    values of each loop are only decoded when they are accessed. """
+
+    if hasattr(file_name, 'read'):
+        store = SharedEntryStore(file_name.read(), file_name=getattr(file_name, 'name', None))
+    else:
+        store = SharedEntryStore.from_file(file_name)
+    if len(store) != 1:
+        raise ValueError(f"The file '{file_name}' is an entry store of {len(store)} entries. Use "
+                         f"SharedEntryStore.from_file() to read it.")
+    result = store._build_entry(store.entry_ids[0], frozen=readonly and not convert_data_types)
+    result.source = f"from_file('{file_name}')"
+
+    if convert_data_types:
+        schema = utils.get_schema(schema)
+        for saveframe in result._frame_list:
+            saveframe._tags = [[name, schema.convert_tag(f"{saveframe.tag_prefix}.{name}", value)]
+                               for name, value in saveframe._tags]
+            for each_loop in saveframe._loops:
+                rows = each_loop._peek_data()
+                each_loop.data = []
+                if rows:
+                    each_loop.add_data(rows, convert_data_types=True, schema=schema)
+        if readonly:
+            result.freeze()
+    return result
+
+
+class _SharedBuffer(object):
+    """ The contents of a store, shared by its columns: the table of
+    distinct values, and views of the whole buffer as each type of code.
+    Values are decoded each time they are read, except for the most common
+    ones. """
+
+    __slots__ = ('_views', '_codes', '_offsets', '_data', '_common', '_owner')
+
+    def __init__(self, whole: memoryview, views: List[memoryview], strings: int, string_bytes: int, start: int,
+                 owner: Any) -> None:
+        self._owner: Any = owner
+        # Every view of the buffer, which must be released before it can be closed
+        self._views: List[memoryview] = views
+        whole = self._view(whole, 0, len(whole) // 8 * 8)
+        self._codes: Dict[str, memoryview] = {_: self._view(whole.cast(_)) for _ in 'BHI'}
+        offsets_end = start + 8 * (strings + 1)
+        self._offsets: memoryview = self._view(self._view(whole, start, offsets_end).cast('Q'))
+        self._data: memoryview = self._view(whole, offsets_end, offsets_end + string_bytes)
+        self._common: List[Any] = [None] + [_NOT_DECODED] * min(_COMMON_VALUES - 1, strings)
+
+    def __del__(self) -> None:
+        # The owner of the buffer can't close it while there are views of it
+        for view in reversed(self._views):
+            view.release()
+
+    def __getitem__(self, code: int) -> Optional[str]:
+        if code < _COMMON_VALUES:
+            value = self._common[code]
+            if value is _NOT_DECODED:
+                value = self._common[code] = self._decode(code)
+            return value
+        return self._decode(code)
+
+    def codes(self, typecode: str, position: int, length: int) -> memoryview:
+        """ Returns a view of the codes of a column, which starts at the
+        given position in the buffer. """
+
+        first = position // array(typecode).itemsize
+        return self._view(self._codes[typecode], first, first + length)
+
+    def _decode(self, code: int) -> Optional[str]:
+        if code == 0:
+            return None
+        return str(self._data[self._offsets[code - 1]:self._offsets[code]], 'utf-8', 'surrogatepass')
+
+    def _view(self, view: memoryview, start: Optional[int] = None, end: Optional[int] = None) -> memoryview:
+        """ Returns a view (or part of a view) that is released when the
+        store is closed. """
+
+        if start is not None:
+            view = view[start:end]
+        self._views.append(view)
+        return view
+
+
+class SharedColumn(SequenceABC):
+    """ A column of a loop read from a :py:class:`SharedEntryStore`. The
+    values are read from the shared buffer when they are accessed, so the
+    column takes almost no memory of its own. """
+
+    __slots__ = ('_codes', '_buffer', '_typecode', '_position', '_length')
+
+    def __init__(self, buffer: _SharedBuffer, typecode: str, position: int, length: int) -> None:
+        self._buffer: _SharedBuffer = buffer
+        # Most columns are never read, so the view of their codes is only created when needed
+        self._codes: Optional[memoryview] = None
+        self._typecode: str = typecode
+        self._position: int = position
+        self._length: int = length
+
+    def __getitem__(self, item: Union[int, slice]) -> Any:
+        codes = self._codes if self._codes is not None else self._load()
+        if isinstance(item, slice):
+            return list(map(self._buffer.__getitem__, codes[item]))
+        return self._buffer[codes[item]]
+
+    def __iter__(self) -> Iterator[Optional[str]]:
+        codes = self._codes if self._codes is not None else self._load()
+        if not self._buffer._views:
+            # Iterating over a released memoryview raises a SystemError rather than a ValueError
+            raise ValueError('The entry store has been closed.')
+        return map(self._buffer.__getitem__, codes)
+
+    def __len__(self) -> int:
+        return self._length
+
+    def __reduce__(self) -> tuple:
+        """ Pickled (and copied) as a tuple, as the copy may outlive the store. """
+
+        return tuple, (tuple(self),)
+
+    def __repr__(self) -> str:
+        return f"<pynmrstar.shared.SharedColumn of {len(self)} values>"
+
+    def _load(self) -> memoryview:
+        self._codes = self._buffer.codes(self._typecode, self._position, self._length)
+        return self._codes
+
+
+class SharedEntryStore(object):
+    """ A set of entries stored once, in shared memory (see
+    :py:meth:`SharedEntryStore.create`) or in a memory-mapped file (see
+    :py:meth:`SharedEntryStore.write_file`), which any number of processes
+    can read.
+
+    Each process attaches to the store, and gets frozen entries (see
+    :py:meth:`pynmrstar.Entry.freeze`) whose loop values are read straight
+    from the shared memory. Only the saveframes and their tags are created
+    in each process, when an entry is first used, so memory use doesn't
+    grow with the number of processes, and no entry is parsed again. A
+    store can be pickled, which attaches to it again in the receiving
+    process. Entries from the store (and clones of them, until they are
+    modified) can't be used after it is closed; use copy.deepcopy() or
+    pickle to keep a copy. """
+
+    def __init__(self, buffer: Any, shared: Optional['shared_memory.SharedMemory'] = None,
+                 file_name: Optional[str] = None) -> None:
+        """ You should not directly instantiate a SharedEntryStore. Instead
+        use the class methods: :py:meth:`SharedEntryStore.create`,
+        :py:meth:`SharedEntryStore.attach` and
+        :py:meth:`SharedEntryStore.from_file`. """
+
+        self._buffer: Any = buffer
+        self._shared: Optional['shared_memory.SharedMemory'] = shared
+        self._file_name: Optional[str] = file_name
+        # Every view of the buffer, which must be released before it can be closed
+        self._views: List[memoryview] = [memoryview(buffer)]
+        if not self._views[0].readonly:
+            self._views.append(self._views[0].toreadonly())
+        # The read-only view of the whole buffer
+        self._whole: memoryview = self._views[-1]
+        self._entries: Dict[str, 'entry_mod.Entry'] = {}
+
+        view = self._whole
+        if len(view) < _PREAMBLE.size:
+            raise ValueError('Not a pynmrstar entry store.')
+        magic, version, _, byte_order, header_length = _PREAMBLE.unpack_from(view)
+        if magic != _MAGIC:
+            raise ValueError('Not a pynmrstar entry store.')
+        if version > _VERSION:
+            raise ValueError(f"The entry store is of version {version}, but only versions up to {_VERSION} can be "
+                             f"read. Please upgrade pynmrstar.")
+        if byte_order.rstrip(b'\0').decode() != sys.byteorder:
+            raise ValueError('The entry store was written on a machine with a different byte order.')
+
+        header = json.loads(str(view[_PREAMBLE.size:_PREAMBLE.size + header_length], 'utf-8'))
+        structures_start = _PREAMBLE.size + header_length
+        # Where the structure of each entry is
+        self._directory: Dict[str, Tuple[int, int]] = {entry_id: (structures_start + position, length)
+                                                       for entry_id, position, length in header['entries']}
+        self._start: int = _align(structures_start + header['structure_bytes'])
+        self._contents: _SharedBuffer = _SharedBuffer(view, self._views, header['strings'], header['string_bytes'],
+                                                      self._start, shared if shared is not None else buffer)
+
+    def __contains__(self, entry_id: Union[str, int]) -> bool:
+        return str(entry_id) in self._directory
+
+    def __enter__(self) -> 'SharedEntryStore':
+        return self
+
+    def __exit__(self, *args) -> None:
+        self.close()
+
+    def __getitem__(self, entry_id: Union[str, int]) -> 'entry_mod.Entry':
+        """ Returns the entry with the given ID. """
+
+        return self.get_entry(entry_id)
+
+    def __iter__(self) -> Iterator['entry_mod.Entry']:
+        """ Yields each of the entries in the store. """
+
+        for entry_id in self._directory:
+            yield self.get_entry(entry_id)
+
+    def __len__(self) -> int:
+        return len(self._directory)
+
+    def __reduce__(self) -> tuple:
+        """ Pickling a store attaches to it again when it is unpickled. """
+
+        if self._shared is not None:
+            return SharedEntryStore.attach, (self._shared.name,)
+        if self._file_name is not None:
+            return SharedEntryStore.from_file, (self._file_name,)
+        raise TypeError('Only entry stores in shared memory or in a file can be pickled.')
+
+    def __repr__(self) -> str:
+        if self._shared is not None:
+            return f"<pynmrstar.SharedEntryStore '{self._shared.name}' of {len(self)} entries>"
+        return f"<pynmrstar.SharedEntryStore '{self._file_name}' of {len(self)} entries>"
+
+    @classmethod
+    def attach(cls, name: str) -> 'SharedEntryStore':
+        """ Attaches to an entry store in shared memory, created (usually
+        by another process) with :py:meth:`SharedEntryStore.create`. """
+
+        if shared_memory is None:
+            raise ValueError('Entry stores in shared memory require Python 3.8 or later.')
+        try:
+            shared = shared_memory.SharedMemory(name, track=False)
+        except TypeError:
+            # Before Python 3.13, attaching registers the shared memory with the resource tracker of the process,
+            #  which removes it when the process exits. Only the process which created it should do that.
+            #  The tracker only remembers each name once, so a store this process created is left registered.
+            shared = shared_memory.SharedMemory(name)
+            if os.name == 'posix' and shared.name not in _created_names:
+                # The tracker knows it by the name with the leading '/', which SharedMemory.name strips
+                shared_memory.resource_tracker.unregister(getattr(shared, '_name', '/' + shared.name),
+                                                          'shared_memory')
+        return cls(shared.buf, shared=shared)
+
+    @classmethod
+    def create(cls, entries: Iterable['entry_mod.Entry'], name: Optional[str] = None) -> 'SharedEntryStore':
+        """ Stores the entries in a new block of shared memory, and returns
+        the store. Other processes can use it by calling
+        :py:meth:`SharedEntryStore.attach` with the name of the store, by
+        unpickling it, or (if they are forked from this process) by using
+        the same object. Call :py:meth:`SharedEntryStore.unlink` once it is
+        no longer needed.
+
+        Values are stored as the strings they print as, so data types
+        converted with convert_data_types are read back as strings. """
+
+        if shared_memory is None:
+            raise ValueError('Entry stores in shared memory require Python 3.8 or later.')
+        contents = encode_entries(entries)
+        shared = shared_memory.SharedMemory(name, create=True, size=max(len(contents), 1))
+        shared.buf[:len(contents)] = contents
+        _created_names.add(shared.name)
+        return cls(shared.buf, shared=shared)
+
+    @classmethod
+    def from_file(cls, file_name: str) -> 'SharedEntryStore':
+        """ Opens an entry store written by
+        :py:meth:`SharedEntryStore.write_file`. The file is memory-mapped,
+        so every process which opens it shares one copy in memory. """
+
+        with open(file_name, 'rb') as store_file:
+            mapped = mmap.mmap(store_file.fileno(), 0, access=mmap.ACCESS_READ)
+        return cls(mapped, file_name=file_name)
+
+    @staticmethod
+    def write_file(entries: Iterable['entry_mod.Entry'], file_name: str) -> None:
+        """ Writes the entries to a file which can be opened with
+        :py:meth:`SharedEntryStore.from_file`. """
+
+        contents = encode_entries(entries)
+        with open(file_name, 'wb') as store_file:
+            store_file.write(contents)
+
+    @property
+    def entry_ids(self) -> List[str]:
+        """ The IDs of the entries in the store. """
+
+        return list(self._directory)
+
+    @property
+    def name(self) -> Optional[str]:
+        """ The name of the shared memory, or the name of the file. """
+
+        return self._shared.name if self._shared is not None else self._file_name
+
+    def close(self) -> None:
+        """ Closes the store in this process. Entries read from it can no
+        longer be used. """
+
+        for view in reversed(self._views):
+            view.release()
+        self._views.clear()
+        self._entries = {}
+        if self._shared is not None:
+            self._shared.close()
+        elif isinstance(self._buffer, mmap.mmap):
+            self._buffer.close()
+
+    def get_entry(self, entry_id: Union[str, int]) -> 'entry_mod.Entry':
+        """ Returns the entry with the given ID. The entry is frozen, and
+        the same object is returned each time. Use
+        :py:meth:`pynmrstar.Entry.clone` to get a copy which can be
+        modified. """
+
+        entry_id = str(entry_id)
+        try:
+            return self._entries[entry_id]
+        except KeyError:
+            pass
+        result = self._build_entry(entry_id, frozen=True)
+        self._entries[entry_id] = result
+        return result
+
+    def unlink(self) -> None:
+        """ Removes the shared memory once every process has closed it.
+        Only needs to be called once, by the process which created it. """
+
+        if self._shared is None:
+            raise ValueError('Only entry stores in shared memory can be unlinked.')
+        self._shared.unlink()
+        _created_names.discard(self._shared.name)
+
+    def _build_entry(self, entry_id: str, frozen: bool) -> 'entry_mod.Entry':
+        """ Creates the entry with the given ID from its structure. The
+        loops have columns which read their values from the buffer. """
+
+        if not self._views:
+            raise ValueError('The entry store has been closed.')
+        try:
+            position, length = self._directory[entry_id]
+        except KeyError:
+            raise KeyError(f"No entry with ID '{entry_id}' in the store.") from None
+        structure = json.loads(str(self._whole[position:position + length], 'utf-8', 'surrogatepass'))
+        contents, start = self._contents, self._start
+
+        saveframes = []
+        for frame in structure['saveframes']:
+            loops = []
+            for each_loop in frame['loops']:
+                rows = each_loop['rows']
+                columns = [SharedColumn(contents, typecode, start + position, rows)
+                           for typecode, position in each_loop['columns']]
+                loops.append(loop_mod._restore_loop(each_loop['category'], each_loop['tags'], None, columns, frozen,
+                                                    False, None, each_loop['source']))
+            saveframes.append(saveframe_mod._restore_saveframe(frame['name'], frame['category'], frame['tag_prefix'],
+                                                               tuple(map(sys.intern, frame['tags'])),
+                                                               frame['values'], loops, frozen, frame['source']))
+        return entry_mod._restore_entry(structure['entry_id'], saveframes, frozen, structure['source'])
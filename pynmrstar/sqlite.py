@@ -0,0 +1,241 @@
+""" Bulk export of entries to an SQLite database. See
+:py:func:`pynmrstar.export_sqlite`. """
+
+import decimal
+import os
+import sqlite3
+from datetime import date
+from typing import Any, Dict, Iterable, Iterator, List, Optional, Sequence, Tuple, Union
+
+from pynmrstar import cnmrstar, definitions, entry as entry_mod, utils
+from pynmrstar.schema import Schema
+
+# The columns every table starts with, which have the entry ID and the name of the saveframe of each row
+ENTRY_ID_COLUMN: str = '_entry_id'
+FRAMECODE_COLUMN: str = '_framecode'
+# The SQLite type of the columns of each type the schema converts values to
+_SQL_TYPES: Dict[type, str] = {int: 'INTEGER', decimal.Decimal: 'REAL', date: 'TEXT', str: 'TEXT'}
+# The types sqlite3 can store without converting them
+_STORABLE: frozenset = frozenset([str, int, float, type(None)])
+
+
+def _quote(name: str) -> str:
+    """ Quotes a table or column name. """
+
+    return '"' + name.replace('"', '""') + '"'
+
+
+def _null_if(parameter: str) -> str:
+    """ Returns the SQL which gives NULL for the null values, and otherwise
+    the value of the parameter, so that null values are recognized by
+    SQLite rather than checked in Python one at a time. """
+
+    for null_value in definitions.NULL_VALUES:
+        if isinstance(null_value, str):
+            escaped = null_value.replace("'", "''")
+            parameter = f"NULLIF({parameter}, '{escaped}')"
+    return parameter
+
+
+def _storable_rows(rows: Sequence[Sequence[Any]], all_str: bool) -> Iterable[Sequence[Any]]:
+    """ Returns the rows, with any values sqlite3 can't store (such as the
+    Decimals and dates convert_data_types gives) as the str they print as. """
+
+    if all_str or all(_.__class__ in _STORABLE for row in rows for _ in row):
+        return rows
+    return [[_ if _.__class__ in _STORABLE else str(_) for _ in row] for row in rows]
+
+
+class _Table(object):
+    """ A table of the database, and the columns it has. """
+
+    __slots__ = ('name', 'columns', 'inserts', 'num_rows')
+
+    def __init__(self, name: str, columns: Dict[str, str]) -> None:
+        self.name: str = name
+        # The name of each column, by its lower case name
+        self.columns: Dict[str, str] = columns
+        # The INSERT statement for each tuple of tag names
+        self.inserts: Dict[Tuple[str, ...], str] = {}
+        self.num_rows: int = 0
+
+
+class _Exporter(object):
+    """ Inserts the saveframes and loops of entries into a database, creating
+    and extending the tables as categories and tags are first seen. """
+
+    def __init__(self, connection: sqlite3.Connection, schema: Schema) -> None:
+        self.connection: sqlite3.Connection = connection
+        self.schema: Schema = schema
+        self.tables: Dict[str, _Table] = {}
+
+        # The tags of each category in the schema, in order, leaving out the internal ones
+        self.schema_tags: Dict[str, List[str]] = {}
+        for tag in schema.schema_order:
+            if schema.schema[tag.lower()]["public"] != "I":
+                self.schema_tags.setdefault(utils.format_category(tag).lower(), []).append(tag)
+
+    def _column_type(self, category: str, tag: str) -> str:
+        try:
+            return _SQL_TYPES.get(self.schema._python_type(f"{category}.{tag}"), 'TEXT')
+        except KeyError:
+            return 'TEXT'
+
+    def _add_columns(self, table: _Table, category: str, tags: Iterable[str]) -> None:
+        for tag in tags:
+            if tag.lower() in (ENTRY_ID_COLUMN, FRAMECODE_COLUMN):
+                raise ValueError(f"The tag '{category}.{tag}' has the same name as the column '{tag.lower()}' which "
+                                 f"every table has, so it can't be exported.")
+            if tag.lower() in table.columns:
+                continue
+            self.connection.execute(f"ALTER TABLE {_quote(table.name)} ADD COLUMN {_quote(tag)} "
+                                    f"{self._column_type(category, tag)}")
+            table.columns[tag.lower()] = tag
+
+    def _table(self, category: str) -> _Table:
+        """ Returns the table for a category, creating it with a column for
+        each of the tags the schema has for the category if it doesn't
+        exist. """
+
+        table = self.tables.get(category.lower())
+        if table is not None:
+            return table
+
+        name = category.lstrip('_')
+        existing = self.connection.execute(f"PRAGMA table_info({_quote(name)})").fetchall()
+        if existing:
+            table = _Table(name, {row[1].lower(): row[1] for row in existing})
+        else:
+            self.connection.execute(f"CREATE TABLE {_quote(name)} ({_quote(ENTRY_ID_COLUMN)} TEXT, "
+                                    f"{_quote(FRAMECODE_COLUMN)} TEXT)")
+            table = _Table(name, {ENTRY_ID_COLUMN: ENTRY_ID_COLUMN, FRAMECODE_COLUMN: FRAMECODE_COLUMN})
+        self._add_columns(table, category, (utils.format_tag(_) for _ in self.schema_tags.get(category.lower(), [])))
+        self.tables[category.lower()] = table
+        return table
+
+    def insert(self, category: str, tags: Sequence[str], entry_id: Any, framecode: str,
+               rows: Iterable[Sequence[Any]]) -> None:
+        """ Inserts rows of values of the tags of a category, all with the
+        same entry ID and framecode. """
+
+        table = self._table(category)
+        key = tuple(tags)
+        statement = table.inserts.get(key)
+        if statement is None:
+            self._add_columns(table, category, tags)
+            columns = ', '.join(_quote(_) for _ in (ENTRY_ID_COLUMN, FRAMECODE_COLUMN, *tags))
+            values = ', '.join(['?', '?'] + [_null_if('?')] * len(tags))
+            statement = table.inserts[key] = f"INSERT INTO {_quote(table.name)} ({columns}) VALUES ({values})"
+
+        entry_id = None if entry_id is None else str(entry_id)
+        cursor = self.connection.executemany(statement, ((entry_id, framecode, *row) for row in rows))
+        table.num_rows += cursor.rowcount
+
+    def insert_entry(self, entry: 'entry_mod.Entry') -> int:
+        """ Inserts the tags of each saveframe as a row of the table of its
+        category, and the rows of each loop into the table of the loop's
+        category. Returns the number of rows inserted. """
+
+        num_rows = 0
+        for saveframe in entry.frame_list:
+            if saveframe.tag_prefix and saveframe._tags:
+                values = [[_[1] for _ in saveframe._tags]]
+                self.insert(saveframe.tag_prefix, [_[0] for _ in saveframe._tags], entry.entry_id, saveframe.name,
+                            _storable_rows(values, False))
+                num_rows += 1
+
+            for each_loop in saveframe.loops:
+                if not each_loop.category:
+                    raise ValueError(f"Only loops with a category can be exported. Saveframe: '{saveframe.name}'")
+                if len(each_loop) == 0:
+                    continue
+                each_loop._check_tags_match_data()
+                # The values of lazily parsed loops are always str
+                lazy = cnmrstar is not None and isinstance(each_loop._stored_data(), cnmrstar.LoopValues)
+                self.insert(each_loop.category, each_loop.tags, entry.entry_id, saveframe.name,
+                            _storable_rows(each_loop._peek_data(), lazy))
+                num_rows += len(each_loop)
+        return num_rows
+
+    def create_indexes(self) -> None:
+        """ Indexes every table by entry ID and framecode. """
+
+        for table in self.tables.values():
+            index = _quote(f"{table.name}_keys")
+            self.connection.execute(f"CREATE INDEX IF NOT EXISTS {index} ON {_quote(table.name)} "
+                                    f"({_quote(ENTRY_ID_COLUMN)}, {_quote(FRAMECODE_COLUMN)})")
+
+
+def _entries(entries_or_paths: Iterable[Union['entry_mod.Entry', str, os.PathLike]],
+             workers: Optional[int]) -> Iterator['entry_mod.Entry']:
+    """ Yields the entries, parsing the paths (up to the next Entry object)
+    with parse_many(). """
+
+    paths = []
+    for item in entries_or_paths:
+        if isinstance(item, entry_mod.Entry):
+            if paths:
+                yield from utils.parse_many(paths, workers=workers, lazy=True)
+                paths = []
+            yield item
+        else:
+            paths.append(os.fspath(item))
+    if paths:
+        yield from utils.parse_many(paths, workers=workers, lazy=True)
+
+
+def export_sqlite(entries_or_paths: Iterable[Union['entry_mod.Entry', str, os.PathLike]],
+                  db_path: Union[str, os.PathLike],
+                  schema: Schema = None,
+                  workers: Optional[int] = None,
+                  rows_per_transaction: int = 1000000) -> Dict[str, int]:
+    """ Loads entries into an SQLite database, which is created if it
+    doesn't exist. Entries may be given as Entry objects or as the paths of
+    files, which are parsed with :py:func:`pynmrstar.parse_many` by a pool
+    of `workers` threads (one per CPU by default; use 1 to parse the files
+    one at a time).
+
+    There is one table for each saveframe category and each loop category
+    (named after the category, without the leading underscore), with a
+    column for each of the tags the schema has for the category, plus any
+    other tags found in the entries. The tags of each saveframe are one row
+    of the table of its category, and the rows of each loop are rows of the
+    table of the loop's category. Every table also starts with the columns
+    _entry_id and _framecode (the name of the saveframe the row comes from),
+    and is indexed by them.
+
+    Columns of tags the schema defines as integers are INTEGER columns, and
+    floats REAL columns, so SQLite stores their values as numbers. Null
+    values ('.', '?' and '') are stored as NULL. The rows are inserted with
+    prepared statements, rows_per_transaction rows per transaction, and
+    the database isn't synced to disk until the end, so a database which is
+    being loaded when the process is killed should be deleted.
+
+    Returns the number of rows inserted into each table. Tables which
+    already exist are added to, gaining columns for any new tags."""
+
+    schema = utils.get_schema(schema)
+    connection = sqlite3.connect(os.fspath(db_path), isolation_level=None)
+    try:
+        connection.execute("PRAGMA synchronous = OFF")
+        connection.execute("PRAGMA journal_mode = MEMORY")
+        exporter = _Exporter(connection, schema)
+
+        pending = 0
+        connection.execute("BEGIN")
+        for entry in _entries(entries_or_paths, workers):
+            pending += exporter.insert_entry(entry)
+            if pending >= rows_per_transaction:
+                connection.execute("COMMIT")
+                connection.execute("BEGIN")
+                pending = 0
+        exporter.create_indexes()
+        connection.execute("COMMIT")
+    except BaseException:
+        if connection.in_transaction:
+            connection.execute("ROLLBACK")
+        raise
+    finally:
+        connection.close()
+
+    return {table.name: table.num_rows for table in exporter.tables.values()}
@@ -1,16 +1,25 @@
 #!/usr/bin/env python3
 
+import asyncio
 import json
 import logging
 import os
+import pickle
 import random
+import sqlite3
+import tempfile
 import unittest
+from contextlib import redirect_stdout
 from copy import deepcopy as copy
 from decimal import Decimal
+from io import StringIO
+from unittest import mock
 
-from pynmrstar import utils, definitions, Saveframe, Entry, Schema, Loop, _Parser
-from pynmrstar._internal import _interpret_file
-from pynmrstar.exceptions import ParsingError
+from pynmrstar import utils, definitions, Saveframe, Entry, Schema, Loop, _Parser, parse_many, cnmrstar, compile_path, \
+    SharedEntryStore, export_sqlite
+from pynmrstar._internal import _interpret_file, _json_serialize
+from pynmrstar.columns import CategoricalColumn
+from pynmrstar.exceptions import InvalidStateError, ParsingError
 
 logging.getLogger('pynmrstar').setLevel(logging.ERROR)
 
@@ -973,6 +982,1038 @@ _Entry.multi2
         self.assertEqual((parser.token, parser.delimiter), ("\n;\nsomething\nto shift", ';'))
 
 
+    def test_parse_many(self):
+        """ Make sure that parsing many files at once matches parsing them one by one. """
+
+        files = [sample_file_location,
+                 sample_file_location + ".gz",
+                 os.path.join(our_path, "sample_files", "bmr15000_3_denormalized.str")] * 3
+        expected = [Entry.from_file(_) for _ in files]
+
+        parsed = list(parse_many(files, workers=2))
+        self.assertEqual(parsed, expected)
+        self.assertEqual(parsed[1].source, f"from_file('{files[1]}')")
+        self.assertEqual(len(list(parse_many(files, workers=4, ordered=False))), len(files))
+        self.assertEqual(list(parse_many([])), [])
+        self.assertRaises(ValueError, list, parse_many(files, workers=0))
+
+        # Files in the binary format are loaded too
+        with tempfile.TemporaryDirectory() as directory:
+            binary_file = os.path.join(directory, 'entry.nmrb')
+            file_entry.write_to_file(binary_file, format_='binary')
+            parsed = list(parse_many([binary_file, sample_file_location], workers=2))
+            self.assertEqual(parsed, [file_entry, file_entry])
+            self.assertEqual(parsed[0].source, f"from_file('{binary_file}')")
+            self.assertEqual(export_sqlite([binary_file], os.path.join(directory, 'entries.db'))['Entry'], 1)
+            del parsed
+
+        # Errors are raised for the file they occur in
+        bad_file = os.path.join(our_path, "sample_files", "3fke.cif")
+        results = parse_many([sample_file_location, bad_file], workers=2)
+        self.assertEqual(next(results), file_entry)
+        self.assertRaises(ParsingError, next, results)
+
+    def test_parallel_tokenize(self):
+        """ Make sure splitting a file between threads doesn't change the result. """
+
+        with open(sample_file_location) as sample_file:
+            sample_data = sample_file.read()
+
+        threads, chunk_size = definitions.PARSE_THREADS, definitions.PARSE_CHUNK_SIZE
+        try:
+            definitions.PARSE_THREADS, definitions.PARSE_CHUNK_SIZE = 8, 1000
+            self.assertEqual(Entry.from_string(sample_data), file_entry)
+            self.assertEqual(Entry.from_string(sample_data).format(), file_entry.format())
+
+            # Errors still report the absolute line number
+            bad_data = sample_data.replace("save_assembly\n", "save_assembly\n'unterminated\n", 1)
+            bad_line = bad_data[:bad_data.index("'unterminated")].count("\n") + 1
+            with self.assertRaises(ParsingError) as context:
+                Entry.from_string(bad_data)
+            self.assertIn(f"Error on line: {bad_line}", str(context.exception))
+        finally:
+            definitions.PARSE_THREADS, definitions.PARSE_CHUNK_SIZE = threads, chunk_size
+
+    def test_async_loading(self):
+        """ Make sure the coroutine versions of from_file and from_string work. """
+
+        with open(sample_file_location) as sample_file:
+            sample_data = sample_file.read()
+
+        async def load_both():
+            return await asyncio.gather(Entry.from_file_async(sample_file_location),
+                                        Entry.from_string_async(sample_data, yield_control=False))
+
+        event_loop = asyncio.new_event_loop()
+        try:
+            from_file, from_string = event_loop.run_until_complete(load_both())
+            self.assertEqual(from_file, file_entry)
+            self.assertEqual(from_file.source, file_entry.source)
+            self.assertEqual(from_string, file_entry)
+            self.assertEqual(from_string.source, "from_string()")
+            self.assertRaises(ParsingError, event_loop.run_until_complete,
+                              Entry.from_string_async("data_test\nsave_test\n"))
+
+            # Files in the binary format are loaded too
+            with tempfile.TemporaryDirectory() as directory:
+                binary_file = os.path.join(directory, 'entry.nmrb')
+                file_entry.write_to_file(binary_file, format_='binary')
+                from_binary = event_loop.run_until_complete(Entry.from_file_async(binary_file))
+                self.assertEqual(from_binary, file_entry)
+                self.assertEqual(from_binary.source, f"from_file('{binary_file}')")
+                del from_binary
+        finally:
+            event_loop.close()
+
+    def test_token_kinds(self):
+        """ Make sure the tokenizer classifies tokens correctly. """
+
+        tokens = cnmrstar.tokenize("DATA_1 global_ save_frame _Tag.a value 'loop_' $ref $ loop_ _Loop.a "
+                                   "Stop_ stop_x save_ data_ \n;\n_not_a_tag\n;\n")
+        kinds = []
+        token = tokens.get_token_typed()
+        while token[0] is not None:
+            kinds.append((token[0], token[3]))
+            token = tokens.get_token_typed()
+        self.assertEqual(token, (None, 4, '?', None))
+        self.assertEqual(kinds, [('DATA_1', cnmrstar.DATA), ('global_', cnmrstar.GLOBAL),
+                                 ('save_frame', cnmrstar.SAVE_START), ('_Tag.a', cnmrstar.TAG),
+                                 ('value', cnmrstar.VALUE), ('loop_', cnmrstar.LOOP), ('$ref', cnmrstar.REF),
+                                 ('$', cnmrstar.VALUE), ('loop_', cnmrstar.LOOP), ('_Loop.a', cnmrstar.TAG),
+                                 ('Stop_', cnmrstar.STOP), ('stop_x', cnmrstar.VALUE), ('save_', cnmrstar.SAVE_END),
+                                 ('data_', cnmrstar.DATA), ('_not_a_tag\n', cnmrstar.TAG)])
+
+    def test_string_stats(self):
+        """ Make sure the ASCII fast path is used when it should be. """
+
+        cnmrstar.string_stats(reset=True)
+        Entry.from_string("data_test save_test _Test.Sf_category test _Test.Name 'ASCII only' save_")
+        Entry.from_string("data_test save_test _Test.Sf_category test _Test.Name 'Über' save_")
+        utils.quote_value.cache_clear()
+        self.assertEqual(utils.quote_value("two words"), "'two words'")
+        self.assertEqual(utils.quote_value("zwei Wörter"), "'zwei Wörter'")
+        self.assertEqual(cnmrstar.string_stats(), {'tokens_ascii': 13, 'tokens_unicode': 1,
+                                                   'quoted_ascii': 1, 'quoted_unicode': 1})
+        cnmrstar.string_stats(reset=True)
+        self.assertEqual(cnmrstar.string_stats(), {'tokens_ascii': 0, 'tokens_unicode': 0,
+                                                   'quoted_ascii': 0, 'quoted_unicode': 0})
+
+    def test_lazy_loading(self):
+        """ Make sure loops parsed with lazy=True behave like normal loops. """
+
+        lazy_entry = Entry.from_file(sample_file_location, lazy=True)
+        self.assertEqual(lazy_entry, self.file_entry)
+        self.assertEqual(str(lazy_entry), str(self.file_entry))
+
+        lazy_loop = lazy_entry.get_loops_by_category('_Atom_chem_shift')[0]
+        normal_loop = self.file_entry.get_loops_by_category('_Atom_chem_shift')[0]
+        self.assertIsNotNone(lazy_loop._lazy_values)
+        self.assertEqual(len(lazy_loop), len(normal_loop))
+        self.assertEqual(lazy_loop['Val'], normal_loop['Val'])
+        self.assertEqual(lazy_loop[['Atom_ID', 'Val']], normal_loop[['Atom_ID', 'Val']])
+        self.assertEqual(copy(lazy_loop), normal_loop)
+        self.assertIsNotNone(lazy_loop._lazy_values)
+
+        # Accessing the data creates all of the values, which can then be modified
+        lazy_loop.data[0][0] = 'changed'
+        self.assertIsNone(lazy_loop._lazy_values)
+        self.assertEqual(lazy_loop.data[0][0], 'changed')
+        self.assertIn("changed", str(lazy_loop))
+
+        # The values are quoted the same way as normal values
+        values = ["'quoted value'", '"a \'b\' c"', ";\nmulti\nline\n;", 'loop_x', 'a"b\'c', "data_x", "Über"]
+        loop_string = "loop_ _Test.Value " + " ".join(values) + " stop_"
+        lazy_test = Entry.from_string(f"data_test save_test _Test.Sf_category test {loop_string} save_", lazy=True)
+        normal_test = Entry.from_string(f"data_test save_test _Test.Sf_category test {loop_string} save_")
+        self.assertEqual(str(lazy_test), str(normal_test))
+        with self.assertRaises(ParsingError):
+            Entry.from_string("data_test save_test _Test.Sf_category test loop_ _Test.Value a b save_", lazy=True)
+
+    def test_interning(self):
+        """ Make sure repeated short values and tag names share one str. """
+
+        parser = _Parser()
+        parsed = parser.parse("data_test save_test _Test.Sf_category test _Test.Name test loop_ _Loop.ID _Loop.Val "
+                              "1 . 2 . 3 'a long value that should not be interned at all' stop_ save_")
+        loop = parsed[0][0]
+        self.assertIs(loop.data[0][1], loop.data[1][1])
+        self.assertIs(parsed[0]['Sf_category'][0], parsed[0]['Name'][0])
+        self.assertEqual(parser.intern_stats, {'interned': 2, 'added': 13, 'not_interned': 2, 'entries': 13})
+
+        second = Loop.from_string("loop_ _Loop.ID _Loop.Val 1 . stop_")
+        self.assertIs(second.tags[1], loop.tags[1])
+        self.assertIs(second.category, loop.category)
+
+    def test_categorical_columns(self):
+        """ Make sure a categorical loop behaves the same as one stored in rows. """
+
+        rows = Loop.from_string("loop_ _Loop.ID _Loop.Res _Loop.Val 1 ALA 3.5 2 GLY 1.0 3 ALA . 4 'A B' 2.0 "
+                                "5 GLY 10 stop_")
+        loop = Loop.from_string(str(rows))
+        loop.make_categorical()
+        self.assertIsInstance(loop._columns[1], CategoricalColumn)
+        self.assertEqual(loop._columns[1].values, ('ALA', 'GLY', 'A B'))
+        self.assertEqual(str(loop), str(rows))
+        self.assertEqual(loop, rows)
+        self.assertEqual(loop.get_tag('Res'), ['ALA', 'GLY', 'ALA', 'A B', 'GLY'])
+        self.assertEqual(loop.filter_rows('Res', 'ALA').get_tag('ID'), ['1', '3'])
+        self.assertEqual({k: v.get_tag('ID') for k, v in loop.group_by('Res').items()},
+                         {'ALA': ['1', '3'], 'GLY': ['2', '5'], 'A B': ['4']})
+        self.assertEqual(loop.filter(['Res']).get_tag('Res'), rows.get_tag('Res'))
+        self.assertIsNotNone(loop._columns)
+
+        loop.sort_rows('Val')
+        rows.sort_rows('Val')
+        self.assertEqual(loop.get_tag('ID'), rows.get_tag('ID'))
+        self.assertEqual(loop.remove_data_by_tag_value('Res', 'GLY'), rows.remove_data_by_tag_value('Res', 'GLY'))
+        self.assertEqual(str(loop), str(rows))
+        self.assertEqual(pickle.loads(pickle.dumps(loop)), rows)
+
+        # Modifying the data turns the columns back into rows
+        loop.data[0][1] = 'VAL'
+        self.assertIsNone(loop._columns)
+        self.assertEqual(loop.get_tag('Res')[0], 'VAL')
+        loop.data[0][2] = 1.0
+        with self.assertRaises(ValueError):
+            loop.make_categorical('Val')
+        self.assertIsNone(loop._columns)
+        loop.make_categorical('Res')
+        self.assertIsInstance(loop._columns[1], CategoricalColumn)
+        loop.make_categorical()
+        self.assertNotIsInstance(loop._columns[2], CategoricalColumn)
+
+    def test_freeze(self):
+        """ Make sure a frozen entry matches the original, can't be modified, and is hashable. """
+
+        file_name = os.path.join(our_path, "sample_files", "bmr15000_3.str")
+        original = Entry.from_file(file_name)
+        frozen = Entry.from_file(file_name, readonly=True)
+        self.assertEqual(frozen, original)
+        self.assertEqual(str(frozen), str(original))
+        self.assertEqual(frozen.get_json(), original.get_json())
+        self.assertEqual(frozen.compare(original), [])
+
+        loop = frozen.get_loops_by_category('_Atom_chem_shift')[0]
+        original_loop = original.get_loops_by_category('_Atom_chem_shift')[0]
+        self.assertEqual(loop.data[0], tuple(original_loop.data[0]))
+        self.assertEqual(loop.data, original_loop.data)
+        self.assertEqual(loop.get_tag(['Comp_ID', 'Val']), original_loop.get_tag(['Comp_ID', 'Val']))
+        self.assertIs(frozen[0].tags[0][0], original[0].tags[0][0])
+
+        for modify in [lambda: frozen.add_saveframe(original[0]),
+                       lambda: frozen.remove_saveframe(frozen[0]),
+                       lambda: frozen.normalize(),
+                       lambda: setattr(frozen, 'entry_id', 1),
+                       lambda: frozen[0].add_tag('Test', 1),
+                       lambda: setattr(frozen[0], 'name', 'test'),
+                       lambda: loop.add_data(list(original_loop.data[0])),
+                       lambda: loop.sort_rows('Val'),
+                       lambda: loop.make_categorical(),
+                       lambda: loop.clear_data()]:
+            with self.assertRaises(InvalidStateError):
+                modify()
+        self.assertIsInstance(loop._columns, tuple)
+
+        with self.assertRaises(TypeError):
+            hash(original)
+        self.assertEqual(hash(frozen), hash(frozen))
+        self.assertEqual({frozen: 1}[copy(frozen)], 1)
+        self.assertTrue(copy(frozen)._frozen)
+
+        thawed = copy(original)
+        thawed.freeze()
+        self.assertEqual(hash(thawed), hash(frozen))
+
+    def test_clone(self):
+        """ Make sure clones share data until modified, and then don't affect each other. """
+
+        original = Entry.from_file(os.path.join(our_path, "sample_files", "bmr15000_3.str"))
+        printed = str(original)
+        clone = original.clone()
+        self.assertEqual(clone, original)
+        loop = clone.get_loops_by_category('_Atom_chem_shift')[0]
+        original_loop = original.get_loops_by_category('_Atom_chem_shift')[0]
+        self.assertIs(loop._data, original_loop._data)
+
+        loop.data[0][1] = 'changed'
+        loop.add_tag('New_tag', update_data=True)
+        clone[0]['Title'] = 'changed'
+        clone.remove_saveframe(clone[1])
+        self.assertEqual(str(original), printed)
+        self.assertNotEqual(clone, original)
+
+        # The original copies its rows too, since the other clone still shares them
+        second = original.clone()
+        original_loop.data[0][1] = 'changed'
+        self.assertEqual(str(second), printed)
+
+        # Rows held from Loop.data before cloning don't change the clone
+        rows = original_loop.data
+        third = original_loop.clone()
+        third_printed = str(third)
+        rows[0][1] = 'changed again'
+        self.assertEqual(str(third), third_printed)
+        self.assertNotEqual(third.data[0][1], 'changed again')
+
+        # The clone of a frozen entry can be modified, and shares the columns
+        frozen = Entry.from_file(os.path.join(our_path, "sample_files", "bmr15000_3.str"), readonly=True)
+        thawed = frozen.clone()
+        self.assertFalse(thawed._frozen)
+        self.assertIs(thawed[0][0]._columns[0], frozen[0][0]._columns[0])
+        thawed[0][0].data[0][0] = 'changed'
+        self.assertEqual(str(frozen), printed)
+
+    def test_views(self):
+        """ Make sure column and select views match get_tag(), whatever the loop's storage. """
+
+        file_name = os.path.join(our_path, "sample_files", "bmr15000_3.str")
+        original = Entry.from_file(file_name).get_loops_by_category('_Atom_chem_shift')[0]
+        for kwargs in [{}, {'lazy': True}, {'readonly': True}]:
+            loop = Entry.from_file(file_name, **kwargs).get_loops_by_category('_Atom_chem_shift')[0]
+            column = loop.column('_Atom_chem_shift.Val')
+            self.assertEqual(column.to_list(), original.get_tag('Val'))
+            self.assertEqual(len(column), len(original))
+            self.assertEqual(column[-1], original.data[-1][original.tag_index('Val')])
+            self.assertEqual(column.tag, '_Atom_chem_shift.Val')
+
+            selected = loop.select(['Comp_ID', 'Atom_ID', 'Val'])
+            self.assertEqual(selected.to_list(), original.get_tag(['Comp_ID', 'Atom_ID', 'Val']))
+            self.assertEqual(selected[0], tuple(original.get_tag(['Comp_ID', 'Atom_ID', 'Val'])[0]))
+            self.assertEqual(selected.column('Atom_ID'), original.get_tag('Atom_ID'))
+            self.assertEqual(selected.to_loop(), original.filter(['Comp_ID', 'Atom_ID', 'Val']))
+            with self.assertRaises(ValueError):
+                selected.column('ID')
+            # The same error, however the loop is stored
+            for view in (column, selected):
+                for index in (len(original), -len(original) - 1):
+                    with self.assertRaisesRegex(IndexError, 'Row index out of range.'):
+                        _ = view[index]
+            # Reading through the views doesn't create the rows
+            if kwargs:
+                self.assertEqual(loop._data, [])
+
+        # Views reflect changes to the loop
+        column = original.column('Val')
+        original.data[0][original.tag_index('Val')] = 'changed'
+        self.assertEqual(column[0], 'changed')
+
+    def test_compile_path(self):
+        """ Make sure compiled paths get the same values as get_tag(). """
+
+        entry = Entry.from_file(os.path.join(our_path, "sample_files", "bmr15000_3.str"))
+        for path in ['_Atom_chem_shift.Val', '_atom_chem_shift.comp_id', '_Entry.Title', '_Entity.Name',
+                     '_Entity_comp_index.Comp_ID']:
+            compiled = compile_path(path)
+            self.assertIs(compiled, compile_path(path))
+            self.assertEqual(compiled(entry), entry.get_tag(path))
+            for saveframe in entry:
+                self.assertEqual(compiled(saveframe), saveframe.get_tag(path))
+                for loop in saveframe:
+                    if loop.category.lower() == compiled.category.lower():
+                        self.assertEqual(compiled(loop), loop.get_tag(path))
+                        self.assertEqual(compiled.column(loop), loop.get_tag(path))
+                    else:
+                        self.assertEqual(compiled(loop), [])
+                        self.assertIsNone(compiled.column(loop))
+
+        # The same path works on a loop with the tags in a different order
+        compiled = compile_path('_Atom_chem_shift.Val')
+        loop = entry.get_loops_by_category('_Atom_chem_shift')[0]
+        moved = loop.filter(['Val', 'ID'])
+        self.assertEqual(compiled(moved), loop.get_tag('Val'))
+        self.assertEqual(compiled(loop), loop.get_tag('Val'))
+        with self.assertRaises(ValueError):
+            compile_path('Val')
+
+    def test_row_classes(self):
+        schema = utils.get_schema()
+        row_class = schema.row_class('_Atom_chem_shift')
+        self.assertIs(row_class, schema.row_class('_atom_chem_shift.Val'))
+        self.assertEqual(row_class.__name__, 'AtomChemShiftRow')
+        self.assertEqual(row_class.category, '_Atom_chem_shift')
+        self.assertEqual(row_class._fields[0], 'ID')
+        with self.assertRaises(ValueError):
+            schema.row_class('_Entry')
+        with self.assertRaises(ValueError):
+            schema.row_class('_Not_a_category')
+
+        # Invalid identifiers in the tag names are replaced
+        self.assertIn('Herzfeld_Berger_span_val', schema.row_class('_Tensor')._fields)
+
+        for kwargs in [{}, {'lazy': True}, {'readonly': True}]:
+            entry = Entry.from_file(sample_file_location, **kwargs)
+            loop = entry.get_loops_by_category('_Atom_chem_shift')[0]
+            rows = list(loop.rows_as())
+            self.assertEqual(len(rows), len(loop))
+            self.assertEqual([_.Val for _ in rows], loop.get_tag('Val'))
+            self.assertEqual([_.Comp_ID for _ in rows], loop.get_tag('Comp_ID'))
+            self.assertEqual(rows[0].as_dict()['_Atom_chem_shift.Atom_ID'], loop.get_tag('Atom_ID')[0])
+            self.assertEqual(list(rows[0])[0], rows[0].ID)
+            self.assertEqual(rows, list(loop.rows_as(row_class)))
+
+        # Tags missing from the loop are None, tags not in the schema are left out
+        loop = Loop.from_scratch('_Atom_chem_shift')
+        loop.add_tag(['Val', 'Atom_ID', 'Not_a_tag'])
+        loop.add_data([['1.5', 'CA', 'x'], ['.', 'CB', 'y']])
+        rows = list(loop.rows_as())
+        self.assertEqual(rows[0].Atom_ID, 'CA')
+        self.assertIsNone(rows[0].Comp_ID)
+        self.assertFalse(hasattr(rows[0], 'Not_a_tag'))
+        with self.assertRaises(AttributeError):
+            rows[0].Not_a_tag = 'x'
+        converted = list(loop.rows_as(convert_data_types=True))
+        self.assertEqual(converted[0].Val, Decimal('1.5'))
+        self.assertIsNone(converted[1].Val)
+        self.assertEqual(loop.data[0], ['1.5', 'CA', 'x'])
+        with self.assertRaises(ValueError):
+            next(loop.rows_as(schema.row_class('_Atom')))
+
+    def test_column_stats(self):
+        loop = Loop.from_scratch('_Test')
+        loop.add_tag(['A', 'B'])
+        loop.add_data([['.', 'x'], [None, '?']])
+        self.assertFalse(loop.empty)
+        self.assertEqual(loop._null_counts(), [2, 1])
+
+        # Kept up to date by the methods which modify the loop
+        loop.add_data([['a', '.']])
+        self.assertEqual(loop._null_counts(), [2, 2])
+        loop.add_tag('C', update_data=True)
+        self.assertEqual([_.nulls for _ in loop._stats[1]], [2, 2, 3])
+        self.assertEqual(loop._null_counts(), [2, 2, 3])
+        loop.remove_data_by_tag_value('B', 'x')
+        self.assertEqual(loop._null_counts(), [1, 2, 2])
+        loop.remove_tag('A')
+        self.assertEqual(loop._null_counts(), [2, 2])
+        self.assertTrue(loop.empty)
+        self.assertEqual(loop.format(skip_empty_tags=True), '')
+
+        # The widths when printed are remembered, and grow as data is added
+        printed = loop.format()
+        self.assertEqual([_.width for _ in loop._column_stats()], [4, 4])
+        loop.add_data([['wider', '.']])
+        self.assertEqual([_.width for _ in loop._column_stats()], [8, 4])
+        self.assertNotEqual(loop.format(), printed)
+        self.assertEqual(loop.format(), Loop.from_string(loop.format()).format())
+
+        # The rows can be modified directly through Loop.data
+        loop.data[0][0] = 'a'
+        self.assertFalse(loop.empty)
+        loop.data[0][0] = '.'
+        self.assertEqual(loop._null_counts(), [2, 3])
+
+        # As do changes to what counts as null
+        try:
+            definitions.NULL_VALUES.append('wider')
+            self.assertTrue(loop.empty)
+            self.assertEqual(loop.format(skip_empty_tags=True), '')
+        finally:
+            definitions.NULL_VALUES.remove('wider')
+        self.assertFalse(loop.empty)
+
+        # Once the rows are handed out, whole columns aren't counted just to check for data
+        loop = Loop.from_scratch('_Test')
+        loop.add_tag(['A', 'B'])
+        loop.add_data([['a', '.']] + [['.', '.']] * 1000)
+        for _ in loop:
+            pass
+        with mock.patch('pynmrstar.loop.count_nulls', side_effect=AssertionError):
+            self.assertFalse(loop.empty)
+            loop.data[0][0] = '.'
+            self.assertTrue(loop.empty)
+
+        # Rows held on to from Loop.data can still be changed after the statistics are worked out
+        loop = Loop.from_scratch('_Test')
+        loop.add_tag(['A', 'B'])
+        loop.add_data([['a', 'b']])
+        rows = loop.data
+        str(loop)
+        rows[0][0] = 'abcdefghij'
+        self.assertEqual(Loop.from_string(str(loop)).data, [['abcdefghij', 'b']])
+        rows[0] = ['.', '.']
+        self.assertTrue(loop.empty)
+        rows[0][1] = 'x'
+        self.assertFalse(loop.empty)
+        self.assertEqual(loop.format(skip_empty_tags=True), Loop.from_string(loop.format(skip_empty_tags=True)).format())
+        self.assertIn('x', loop.format(skip_empty_tags=True))
+        # As can rows set as Loop.data, while rows given to add_data() are copied
+        rows = [['.', '.']]
+        loop.data = rows
+        self.assertTrue(loop.empty)
+        rows[0][0] = 'y'
+        self.assertFalse(loop.empty)
+        row = ['.', '.']
+        loop.clear_data()
+        loop.add_data([row])
+        self.assertTrue(loop.empty)
+        row[0] = 'z'
+        self.assertTrue(loop.empty)
+        self.assertEqual(loop._null_counts(), [1, 1])
+
+        # Parsed loops and loops stored as columns
+        for kwargs in [{}, {'lazy': True}, {'readonly': True}]:
+            entry = Entry.from_file(sample_file_location, **kwargs)
+            loop = entry.get_loops_by_category('_Atom_chem_shift')[0]
+            self.assertFalse(loop.empty)
+            self.assertEqual(loop._null_counts()[loop.tag_index('Val')], 0)
+            self.assertEqual(loop._null_counts()[loop.tag_index('Details')], len(loop))
+            self.assertEqual(loop.format(skip_empty_tags=True), loop.format(skip_empty_tags=True))
+            self.assertNotIn('Details', loop.format(skip_empty_tags=True))
+
+    def test_content_hash(self):
+        entry = Entry.from_file(sample_file_location)
+        content_hash = entry.content_hash()
+        self.assertEqual(len(content_hash), 32)
+        self.assertEqual(content_hash, Entry.from_file(sample_file_location, lazy=True).content_hash())
+        self.assertEqual(content_hash, Entry.from_file(sample_file_location, readonly=True).content_hash())
+        self.assertEqual(content_hash, pickle.loads(pickle.dumps(entry)).content_hash())
+        self.assertEqual(content_hash, entry.clone().content_hash())
+
+        # Values which print the same, but aren't equal, don't hash the same
+        loop = Loop.from_scratch('_Test')
+        loop.add_tag(['A', 'B'])
+        loop.add_data([['1.0', None]])
+        other = Loop.from_scratch('_Test')
+        other.add_tag(['A', 'B'])
+        other.add_data([[Decimal('1.0'), '.']])
+        self.assertNotEqual(loop.content_hash(), other.content_hash())
+        self.assertNotEqual(loop, other)
+
+        # Modifying a loop changes the hash of the loop, saveframe, and entry
+        saveframe = entry.get_saveframes_by_category('assigned_chemical_shifts')[0]
+        saveframe_hash = saveframe.content_hash()
+        loop = saveframe['_Atom_chem_shift']
+        loop_hash = loop.content_hash()
+        loop.sort_rows('Val')
+        self.assertNotEqual(loop.content_hash(), loop_hash)
+        self.assertNotEqual(saveframe.content_hash(), saveframe_hash)
+        self.assertNotEqual(entry.content_hash(), content_hash)
+        loop_hash = loop.content_hash()
+        loop.data[0][0] = 'changed'
+        self.assertNotEqual(loop.content_hash(), loop_hash)
+        loop_hash = loop.content_hash()
+        loop.category = '_Changed'
+        self.assertNotEqual(loop.content_hash(), loop_hash)
+
+        # Comparisons skip the parts with equal hashes
+        entry = Entry.from_file(sample_file_location)
+        other = Entry.from_file(sample_file_location)
+        self.assertEqual(entry.compare(other), [])
+        self.assertEqual(entry, other)
+        other[0]['_Entry.Title'] = 'Changed'
+        self.assertNotEqual(entry, other)
+        self.assertEqual(len(entry.compare(other)), 2)
+        loop = other.get_loops_by_category('_Atom_chem_shift')[0]
+        loop.add_data([['1'] * len(loop.tags)])
+        self.assertIn("\tLoops do not match: '_Atom_chem_shift'.", entry.compare(other))
+
+        # Rows held from Loop.data can change the loop after its hash was worked out
+        loop = Loop.from_scratch('_Test')
+        loop.add_tag(['A', 'B'])
+        loop.add_data([['1', '2']])
+        other = loop.clone()
+        rows = loop.data
+        self.assertEqual(loop, other)
+        self.assertEqual(loop.compare(other), [])
+        loop_hash = loop.content_hash()
+        rows[0][0] = 'changed'
+        self.assertNotEqual(loop.content_hash(), loop_hash)
+        self.assertNotEqual(loop, other)
+        self.assertNotEqual(loop.compare(other), [])
+        self.assertEqual(pickle.loads(pickle.dumps(loop)).data, [['changed', '2']])
+
+        # The digests of saveframes and entries are remembered until something in them changes
+        entry = Entry.from_file(sample_file_location)
+        other = Entry.from_file(sample_file_location)
+        content_hash = entry.content_hash()
+        self.assertEqual(content_hash, other.content_hash())
+        self.assertIs(entry._content_digest(), entry._content_digest())
+        self.assertEqual(entry, other)
+        saveframe = entry.get_saveframes_by_category('assigned_chemical_shifts')[0]
+        saveframe_digest = saveframe._content_digest()
+        saveframe.tags[0][1] = 'changed'
+        self.assertNotEqual(saveframe._content_digest(), saveframe_digest)
+        self.assertNotEqual(entry.content_hash(), content_hash)
+        self.assertNotEqual(entry, other)
+        saveframe.tags[0][1] = other.get_saveframes_by_category('assigned_chemical_shifts')[0].tags[0][1]
+        self.assertEqual(entry.content_hash(), content_hash)
+        other.get_loops_by_category('_Atom_chem_shift')[0].data[0][0] = 'changed'
+        self.assertNotEqual(other.content_hash(), content_hash)
+        self.assertNotEqual(entry, other)
+
+    def test_loop_diff(self):
+        entry = Entry.from_file(sample_file_location)
+        loop = entry.get_loops_by_category('_Atom_chem_shift')[0]
+        self.assertFalse(loop.diff(loop.clone()))
+        self.assertFalse(loop.diff(loop.clone(), key='ID'))
+
+        other = Entry.from_file(sample_file_location, lazy=True)
+        other_loop = other.get_loops_by_category('_Atom_chem_shift')[0]
+        other_loop.data[3][other_loop.tag_index('Val')] = '1.234'
+        other_loop.add_data([['x'] * len(other_loop.tags)])
+        deleted = other_loop.remove_data_by_tag_value('ID', '10')
+
+        result = loop.diff(other_loop, key=['_Atom_chem_shift.ID'])
+        self.assertTrue(result)
+        self.assertEqual(result.key, ['ID'])
+        self.assertEqual(result.deleted, deleted)
+        self.assertEqual(result.inserted, [['x'] * len(other_loop.tags)])
+        self.assertEqual(len(result.modified), 1)
+        self.assertEqual(result.modified[0].key, ('4',))
+        self.assertEqual(result.modified[0].changes, [('Val', '4.0550', '1.234')])
+        self.assertEqual(result.modified[0].new, other_loop.data[3])
+        self.assertIn("~ ID='4': Val '4.0550' -> '1.234'", str(result))
+
+        # Without a key, a modified row is deleted and inserted
+        result = loop.diff(other_loop)
+        self.assertEqual((len(result.deleted), len(result.inserted), len(result.modified)), (2, 2, 0))
+
+        # Rows with the same key are paired in order, and only common tags are compared
+        first = Loop.from_scratch('_Test')
+        first.add_tag(['ID', 'Val', 'Old'])
+        first.add_data([['1', 'a', '.'], ['1', 'b', '.'], ['2', 'c', '.']])
+        second = Loop.from_scratch('_Test')
+        second.add_tag(['val', 'id', 'New'])
+        second.add_data([['a', '1', '.'], ['B', '1', '.'], ['b', '1', '.']])
+        result = first.diff(second, key='ID')
+        self.assertEqual(result.removed_tags, ['Old'])
+        self.assertEqual(result.added_tags, ['New'])
+        self.assertEqual(result.deleted, [['2', 'c', '.']])
+        self.assertEqual(result.inserted, [['b', '1', '.']])
+        self.assertEqual([_.changes for _ in result.modified], [[('Val', 'b', 'B')]])
+        with self.assertRaises(ValueError):
+            first.diff(second, key='Old')
+
+        # Row differences from utils.diff()
+        output = StringIO()
+        with redirect_stdout(output):
+            utils.diff(entry, other, keys={'Atom_chem_shift': ['ID']})
+        self.assertIn("Rows of loop '_Atom_chem_shift' inserted: 1, deleted: 1, modified: 1.", output.getvalue())
+        output = StringIO()
+        with redirect_stdout(output):
+            utils.diff(entry, other)
+        self.assertNotIn("Rows of loop", output.getvalue())
+
+
+    def test_pickle(self):
+        entry = Entry.from_file(sample_file_location)
+        entry.get_loops_by_category('_Atom_chem_shift')[0].make_categorical()
+        lazy = Entry.from_file(sample_file_location, lazy=True)
+        frozen = Entry.from_file(sample_file_location)
+        frozen.freeze()
+
+        for protocol in range(2, pickle.HIGHEST_PROTOCOL + 1):
+            for each_entry in (entry, lazy, frozen):
+                restored = pickle.loads(pickle.dumps(each_entry, protocol=protocol))
+                self.assertEqual(restored, file_entry)
+                self.assertEqual(restored._frozen, each_entry._frozen)
+                self.assertEqual(restored.content_hash(), file_entry.content_hash())
+                self.assertEqual(str(restored), str(file_entry))
+        self.assertEqual(hash(pickle.loads(pickle.dumps(frozen))), hash(frozen))
+
+        # The codes of categorical columns can be passed out-of-band
+        if pickle.HIGHEST_PROTOCOL >= 5:
+            buffers = []
+            data = pickle.dumps(frozen, protocol=5, buffer_callback=buffers.append)
+            self.assertTrue(buffers)
+            self.assertEqual(pickle.loads(data, buffers=buffers), frozen)
+
+        # Copies don't share values with the original
+        restored = copy(entry)
+        restored[0]['Title'] = 'changed'
+        restored.get_loops_by_category('_Atom_chem_shift')[0].data[0][0] = 'changed'
+        self.assertEqual(entry, file_entry)
+        loop = Loop.from_scratch('_Test')
+        loop.add_tag(['ID', 'Val'])
+        loop.add_data([['1', 'a']])
+        restored = copy(loop.clone())
+        restored.add_data([['2', 'b']])
+        restored.data[0][1] = 'changed'
+        self.assertEqual(loop.data, [['1', 'a']])
+
+        # Loops pickled by older versions
+        old = Loop.__new__(Loop)
+        old.__setstate__({'_tags': ['ID', 'Val'], 'data': [['1', 'a']], 'category': '_Test', 'source': 'unknown'})
+        self.assertEqual(old, loop)
+
+    def test_shared_store(self):
+        lazy = Entry.from_file(sample_file_location, lazy=True)
+        other = Entry.from_scratch('other')
+        other.add_saveframe(Saveframe.from_scratch('test', '_Test'))
+        other[0].add_tag('Name', 'value')
+        loop = Loop.from_scratch('_Test_loop')
+        loop.add_tag(['ID', 'Val'])
+        loop.add_data([[str(_), None if _ % 2 else 'é'] for _ in range(300)])
+        other[0].add_loop(loop)
+
+        store = SharedEntryStore.create([lazy, other])
+        try:
+            self.assertEqual(len(store), 2)
+            self.assertEqual(store.entry_ids, ['15000', 'other'])
+            self.assertIn(15000, store)
+
+            # Attaching by name, or by unpickling the store
+            for attached in (SharedEntryStore.attach(store.name), pickle.loads(pickle.dumps(store))):
+                entry = attached[15000]
+                self.assertIs(entry, attached.get_entry('15000'))
+                self.assertEqual(entry, file_entry)
+                self.assertEqual(str(entry), str(file_entry))
+                self.assertEqual(entry.content_hash(), file_entry.content_hash())
+                self.assertEqual(attached['other'].get_loops_by_category('_Test_loop')[0].data, loop.data)
+                with self.assertRaises(InvalidStateError):
+                    entry[0]['Title'] = 'changed'
+                with self.assertRaises(KeyError):
+                    attached.get_entry('missing')
+                attached.close()
+            self.assertEqual(store['other'].get_tag('_Test.Name'), ['value'])
+
+            # Deep copies don't depend on the store
+            copied = copy(store[15000]), pickle.loads(pickle.dumps(store[15000]))
+        finally:
+            store.close()
+            store.unlink()
+        for each_entry in copied:
+            self.assertEqual(each_entry, file_entry)
+        with self.assertRaises(ValueError):
+            store.get_entry(15000)
+
+        # Memory-mapped files
+        file_name = os.path.join(our_path, 'sample_files', 'test_store.nmrb')
+        try:
+            SharedEntryStore.write_file([file_entry], file_name)
+            file_store = SharedEntryStore.from_file(file_name)
+            entry = file_store[15000]
+            self.assertEqual(entry, file_entry)
+            file_store.close()
+            with self.assertRaises(ValueError):
+                str(entry)
+        finally:
+            os.unlink(file_name)
+        with self.assertRaises(ValueError):
+            SharedEntryStore.create([file_entry, file_entry])
+
+    def test_binary_format(self):
+        file_name = os.path.join(our_path, 'sample_files', 'test_entry.nmrb')
+        try:
+            file_entry.write_to_file(file_name, format_='binary')
+            entry = Entry.from_file(file_name)
+            self.assertEqual(entry, file_entry)
+            self.assertEqual(str(entry), str(file_entry))
+            self.assertEqual(entry.source, f"from_file('{file_name}')")
+
+            # Loaded entries can be modified, unless they are read-only
+            entry[0]['Title'] = 'changed'
+            entry.get_loops_by_category('_Atom_chem_shift')[0].data[0][0] = 'changed'
+            self.assertEqual(Entry.from_file(file_name), file_entry)
+            readonly = Entry.from_file(file_name, readonly=True)
+            self.assertEqual(readonly, file_entry)
+            with self.assertRaises(InvalidStateError):
+                readonly[0]['Title'] = 'changed'
+
+            self.assertEqual(Entry.from_file(file_name, convert_data_types=True),
+                             Entry.from_file(sample_file_location, convert_data_types=True))
+
+            # As are open binary files
+            with open(file_name, 'rb') as binary_file:
+                self.assertEqual(Entry.from_file(binary_file), file_entry)
+
+            with self.assertRaises(ValueError):
+                file_entry[0].write_to_file(file_name, format_='binary')
+            SharedEntryStore.write_file([file_entry, Entry.from_scratch('other')], file_name)
+            with self.assertRaises(ValueError):
+                Entry.from_file(file_name)
+        finally:
+            os.unlink(file_name)
+
+    def test_json(self):
+        expected = json.dumps(copy(file_entry).get_json(serialize=False), default=_json_serialize)
+        lazy = Entry.from_file(sample_file_location, lazy=True)
+        frozen = copy(file_entry)
+        frozen.freeze()
+        for entry in (file_entry, lazy, frozen):
+            self.assertEqual(entry.get_json(), expected)
+        # Writing JSON doesn't turn the data of a lazily parsed loop into rows
+        self.assertIsNotNone(lazy[0].loops[0]._lazy_values)
+
+        entry = Entry.from_json(expected)
+        self.assertEqual(entry, file_entry)
+        self.assertEqual(entry.get_json(), expected)
+        shifts = entry.get_loops_by_category('_Atom_chem_shift')[0]
+        self.assertIsNotNone(shifts._lazy_values)
+        shifts.data[0][0] = 'changed'
+        self.assertEqual(shifts.data[0][0], 'changed')
+
+        # Values which aren't strings, escapes, and characters outside of ASCII
+        loop = Loop.from_scratch('_Test')
+        loop.add_tag(['a', 'b', 'c'])
+        loop.data = [['\u00e9\n"\\', None, 1], ['\U0001f600', Decimal('1.50'), 2.5], ['\x7f', True, float('inf')]]
+        self.assertEqual(loop.get_json(), json.dumps(loop.get_json(serialize=False), default=_json_serialize))
+        self.assertEqual(Loop.from_json(loop.get_json()).data,
+                         [['\u00e9\n"\\', None, 1], ['\U0001f600', '1.50', 2.5], ['\x7f', True, float('inf')]])
+        loop.data = [['\u00e9\t', 'x', '\U0001f600'], ['a', 'b', 'c']]
+        self.assertIsNotNone(Loop.from_json(loop.get_json())._lazy_values)
+        self.assertEqual(Loop.from_json(loop.get_json()).data, loop.data)
+
+        # Invalid JSON gives the same errors as before
+        with self.assertRaises(ValueError):
+            Entry.from_json('{"entry_id": "1", "saveframes": [}')
+        with self.assertRaises(ValueError):
+            Loop.from_json('{"category": "_Test", "tags": ["a"], "data": [["a"]]} extra')
+
+    def test_iter_json(self):
+        lazy = Entry.from_file(sample_file_location, lazy=True)
+        frozen = copy(file_entry)
+        frozen.freeze()
+        for entry in (file_entry, lazy, frozen):
+            self.assertEqual(''.join(entry.iter_json(rows_per_chunk=7)), file_entry.get_json())
+            self.assertEqual(''.join(entry[0].iter_json()), file_entry[0].get_json())
+        self.assertEqual(''.join(Loop.from_scratch('_Test').iter_json()), Loop.from_scratch('_Test').get_json())
+
+        shifts = file_entry.get_loops_by_category('_Atom_chem_shift')[0]
+        ndjson = StringIO()
+        self.assertEqual(shifts.write_ndjson(ndjson, entry_id='15000', saveframe='assigned_chem_shift_list_1',
+                                             rows_per_chunk=10), len(shifts))
+        records = [json.loads(_) for _ in ndjson.getvalue().splitlines()]
+        self.assertEqual(len(records), len(shifts))
+        self.assertEqual(list(records[0])[:3], ['entry_id', 'saveframe', 'category'])
+        self.assertEqual(records[0]['category'], '_Atom_chem_shift')
+        self.assertEqual([[_[tag] for tag in shifts.tags] for _ in records], shifts.data)
+
+        # Loops with a tag named like the metadata can't be written
+        loop = Loop.from_scratch('_Test')
+        loop.add_tag('category')
+        loop.add_data([['a']])
+        with self.assertRaises(ValueError):
+            loop.write_ndjson(StringIO())
+
+        with tempfile.TemporaryDirectory() as directory:
+            paths = lazy.write_ndjson(os.path.join(directory, 'ndjson'))
+            self.assertEqual(set(paths), {each_loop.category for saveframe in lazy for each_loop in saveframe})
+            with open(paths['_Atom_chem_shift']) as ndjson_file:
+                self.assertEqual(ndjson_file.read(), ndjson.getvalue())
+
+    def test_arrow(self):
+        shifts = file_entry.get_loops_by_category('_Atom_chem_shift')[0]
+        table = shifts.to_arrow()
+        self.assertEqual(len(table), len(shifts))
+        self.assertEqual(table.category, '_Atom_chem_shift')
+        self.assertEqual(table.column_names, shifts.tags)
+        self.assertEqual(table._table.column_formats[shifts.tag_index('ID')], 'l')
+        self.assertEqual(table._table.column_formats[shifts.tag_index('Val')], 'g')
+        self.assertEqual(table._table.column_formats[shifts.tag_index('Comp_ID')], 'u')
+        self.assertEqual(set(shifts.to_arrow(convert_data_types=False)._table.column_formats), {'u'})
+
+        # Importing gives back the values, with the nulls as '.'
+        def normalized(rows):
+            return [['.' if _ in definitions.NULL_VALUES else str(_) for _ in row] for row in rows]
+
+        for storage in ('rows', 'lazy', 'frozen', 'categorical'):
+            entry = Entry.from_file(sample_file_location, lazy=storage == 'lazy', readonly=storage == 'frozen')
+            for saveframe in entry:
+                for each_loop in saveframe:
+                    if storage == 'categorical':
+                        each_loop.make_categorical()
+                    loop = Loop.from_arrow(each_loop.to_arrow(convert_data_types=False))
+                    self.assertEqual(loop.category, each_loop.category)
+                    self.assertEqual(loop.tags, list(each_loop.tags))
+                    self.assertEqual(loop.data, normalized(each_loop.data))
+                    self.assertEqual(Loop.from_arrow(each_loop.to_arrow(), category='_Other').category, '_Other')
+
+        # Values which don't fit the type of their tag make it a column of strings
+        loop = Loop.from_scratch('_Atom_chem_shift')
+        loop.add_tag(['ID', 'Val', 'Comp_ID'])
+        loop.add_data([[1, Decimal('1.50'), 'ALA'], ['x', '?', None]])
+        table = loop.to_arrow()
+        self.assertEqual(table._table.column_formats, ['u', 'g', 'u'])
+        self.assertEqual(Loop.from_arrow(table).data, [['1', '1.5', 'ALA'], ['x', '.', '.']])
+
+        # Loops of the same category are combined, with nulls for the tags a loop doesn't have
+        entry = Entry.from_scratch('test')
+        for position, (tags, row) in enumerate(((['ID', 'Val'], ['1', '2.5']), (['Val', 'Details'], ['3', 'b']))):
+            saveframe = Saveframe.from_scratch(f'list_{position}', '_Assigned_chem_shift_list')
+            loop = Loop.from_scratch('_Atom_chem_shift')
+            loop.add_tag(tags)
+            loop.add_data([row])
+            saveframe.add_loop(loop)
+            entry.add_saveframe(saveframe)
+        tables = entry.to_arrow_tables()
+        self.assertEqual(list(tables), ['_Atom_chem_shift'])
+        self.assertEqual(tables['_Atom_chem_shift'].column_names, ['ID', 'Val', 'Details'])
+        self.assertEqual(Loop.from_arrow(tables['_Atom_chem_shift']).data, [['1', '2.5', '.'], ['.', '3.0', 'b']])
+        with self.assertRaises(ValueError):
+            Loop.from_arrow([[1, 2]])
+
+        try:
+            import pyarrow
+        except ImportError:
+            return
+        arrow_table = table.to_pyarrow()
+        self.assertEqual(arrow_table.column('ID').to_pylist(), ['1', 'x'])
+        self.assertEqual(arrow_table.column('Val').to_pylist(), [1.5, None])
+        self.assertEqual(arrow_table.schema.metadata, {b'pynmrstar.category': b'_Atom_chem_shift'})
+        self.assertEqual(shifts.to_arrow().to_pyarrow().column('Seq_ID').to_pylist(),
+                         [int(_) for _ in shifts.get_tag('Seq_ID')])
+
+        dates = pyarrow.table({'_Release.Date': pyarrow.array([0, None, 18000], pyarrow.date32()),
+                               '_Release.Detail': pyarrow.array(['a', 'b', 'a']).dictionary_encode(),
+                               '_Release.Flag': [True, False, None]})
+        loop = Loop.from_arrow(dates.slice(1))
+        self.assertEqual(loop.category, '_Release')
+        self.assertEqual(loop.data, [['.', 'b', 'no'], ['2019-04-14', 'a', '.']])
+        self.assertEqual(Loop.from_arrow(dates.to_batches()[0]).data[0], ['1970-01-01', 'a', 'yes'])
+        with self.assertRaises(ValueError):
+            Loop.from_arrow(pyarrow.table({'Data': pyarrow.array([b'binary'])}))
+
+    def test_as_array(self):
+        for storage in ('rows', 'lazy', 'frozen', 'categorical'):
+            entry = Entry.from_file(sample_file_location, lazy=storage == 'lazy', readonly=storage == 'frozen')
+            shifts = entry.get_loops_by_category('_Atom_chem_shift')[0]
+            if storage == 'categorical':
+                shifts.make_categorical()
+            values = shifts.as_array('Val')
+            self.assertEqual(values.typecode, 'd')
+            self.assertEqual(values.tolist(), [float(_) for _ in shifts.get_tag('Val')])
+            self.assertEqual(shifts.as_array('_Atom_chem_shift.Seq_ID', 'i4').tolist(),
+                             [int(_) for _ in shifts.get_tag('Seq_ID')])
+            self.assertEqual(memoryview(shifts.as_array('Seq_ID', int)).format, 'q')
+            self.assertEqual(shifts.as_array('Val', 'f4').typecode, 'f')
+
+            # Nulls are NaN, or null_value, and integers need a null_value
+            self.assertTrue(all(_ != _ for _ in shifts.as_array('Assembly_atom_ID')))
+            self.assertEqual(set(shifts.as_array('Assembly_atom_ID', 'i8', null_value=-1)), {-1})
+            with self.assertRaises(ValueError):
+                shifts.as_array('Assembly_atom_ID', 'i8')
+            with self.assertRaises(ValueError):
+                shifts.as_array('Atom_ID')
+            with self.assertRaises(ValueError):
+                shifts.as_array('Val', 'i8')
+            with self.assertRaises(ValueError):
+                shifts.as_array('Val', 'U')
+            with self.assertRaises(ValueError):
+                shifts.as_array('Missing')
+
+        loop = Loop.from_scratch('_Test')
+        loop.add_tag(['A', 'B'])
+        loop.add_data([[1, Decimal('2.5')], [None, '?'], ['3', 4]])
+        self.assertEqual(loop.as_array('A', 'i8', null_value=0).tolist(), [1, 0, 3])
+        self.assertEqual(loop.as_array('B', null_value=-1.0).tolist(), [2.5, -1.0, 4.0])
+        with self.assertRaises(ValueError):
+            loop.as_array('A', 'i4', null_value=2 ** 40)
+        self.assertEqual(loop.as_array('A').tolist()[::2], [1.0, 3.0])
+
+    def test_export_sqlite(self):
+        with tempfile.TemporaryDirectory() as directory:
+            db_path = os.path.join(directory, 'entries.db')
+            entry = Entry.from_file(sample_file_location)
+            entry.entry_id = 'a'
+            counts = export_sqlite([entry, sample_file_location], db_path, workers=1)
+            shifts = entry.get_loops_by_category('_Atom_chem_shift')[0]
+            self.assertEqual(counts['Atom_chem_shift'], len(shifts) * 2)
+            self.assertEqual(counts['Entry'], 2)
+
+            connection = sqlite3.connect(db_path)
+            try:
+                rows = connection.execute('SELECT "_framecode", "Val", "Seq_ID", "Assembly_atom_ID" FROM '
+                                          '"Atom_chem_shift" WHERE "_entry_id" = \'a\'').fetchall()
+                self.assertEqual([_[1] for _ in rows], [float(_) for _ in shifts.get_tag('Val')])
+                self.assertEqual([_[2] for _ in rows], [int(_) for _ in shifts.get_tag('Seq_ID')])
+                self.assertEqual({_[0] for _ in rows}, {entry.get_saveframes_by_category('assigned_chemical_shifts')[0].name})
+                self.assertEqual({_[3] for _ in rows}, {None})
+                self.assertEqual(connection.execute('SELECT "_entry_id" FROM "Entry" ORDER BY rowid').fetchall(),
+                                 [('a',), ('15000',)])
+                # Schema tags the entries don't have are columns too
+                columns = [_[1] for _ in connection.execute('PRAGMA table_info("Atom_chem_shift")')]
+                self.assertEqual(columns[:2], ['_entry_id', '_framecode'])
+                self.assertIn('Details', columns)
+                indexes = [_[1] for _ in connection.execute('PRAGMA index_list("Atom_chem_shift")')]
+                self.assertEqual(indexes, ['Atom_chem_shift_keys'])
+            finally:
+                connection.close()
+
+            # Converted values, and adding to existing tables
+            converted = Entry.from_file(sample_file_location, convert_data_types=True)
+            converted.entry_id = 'b'
+            self.assertEqual(export_sqlite([converted], db_path)['Atom_chem_shift'], len(shifts))
+            connection = sqlite3.connect(db_path)
+            try:
+                self.assertEqual(connection.execute('SELECT COUNT(*), SUM("Val" IS NULL) FROM "Atom_chem_shift" '
+                                                    'WHERE "_entry_id" = \'b\'').fetchone(), (len(shifts), 0))
+            finally:
+                connection.close()
+
+            loop = Loop.from_scratch('_Test')
+            loop.add_tag(['_entry_id'])
+            loop.add_data([['1']])
+            frame = Saveframe.from_scratch('test', '_Test_frame')
+            frame.add_loop(loop)
+            bad = Entry.from_scratch('c')
+            bad.add_saveframe(frame)
+            with self.assertRaises(ValueError):
+                export_sqlite([bad], os.path.join(directory, 'bad.db'))
+
+            # Null values which need escaping in SQL
+            loop = Loop.from_scratch('_Test')
+            loop.add_tag(['A', 'B'])
+            loop.add_data([["n'a", "it's"]])
+            frame = Saveframe.from_scratch('test', '_Test_frame')
+            frame.add_loop(loop)
+            quoted = Entry.from_scratch('d')
+            quoted.add_saveframe(frame)
+            try:
+                definitions.NULL_VALUES.append("n'a")
+                export_sqlite([quoted], os.path.join(directory, 'quoted.db'))
+            finally:
+                definitions.NULL_VALUES.remove("n'a")
+            connection = sqlite3.connect(os.path.join(directory, 'quoted.db'))
+            try:
+                self.assertEqual(connection.execute('SELECT "A", "B" FROM "Test"').fetchall(), [(None, "it's")])
+            finally:
+                connection.close()
+
+    def test_csv(self):
+        shifts = file_entry.get_loops_by_category('_Atom_chem_shift')[0]
+        text = shifts.get_data_as_csv()
+        loaded = Loop.from_string(text, csv=True)
+        self.assertEqual(loaded, shifts)
+        self.assertEqual(loaded.category, '_Atom_chem_shift')
+        if cnmrstar is not None:
+            self.assertIsInstance(loaded._lazy_values, cnmrstar.LoopValues)
+        # Every form of storage is written the same, and write_csv() streams the same text
+        for storage in ('lazy', 'frozen', 'categorical'):
+            entry = Entry.from_file(sample_file_location, lazy=storage == 'lazy', readonly=storage == 'frozen')
+            other = entry.get_loops_by_category('_Atom_chem_shift')[0]
+            if storage == 'categorical':
+                other.make_categorical()
+            self.assertEqual(other.get_data_as_csv(), text)
+            written = StringIO()
+            self.assertEqual(other.write_csv(written, rows_per_chunk=100), len(shifts))
+            self.assertEqual(written.getvalue(), text)
+        written = StringIO()
+        shifts.write_csv(written, header=False, show_category=False)
+        self.assertEqual(written.getvalue(), shifts.get_data_as_csv(header=False))
+
+        # Quoting, as the csv module does it
+        loop = Loop.from_scratch('_Test')
+        loop.add_tag(['A', 'B'])
+        loop.add_data([['a,b', 'say "hi"'], ['line\nbreak', None], ['', 1.5]])
+        text = loop.get_data_as_csv()
+        self.assertEqual(text, '_Test.A,_Test.B\n"a,b","say ""hi"""\n"line\nbreak",\n,1.5\n')
+        self.assertEqual(Loop.from_string(text, csv=True).data, [['a,b', 'say "hi"'], ['line\nbreak', ''],
+                                                                 ['', '1.5']])
+
+        # Blank lines are skipped, and "\r\n" ends rows too
+        self.assertEqual(Loop.from_string('_Test.A,_Test.B\r\n\r\n1,2\r\n\n3,4', csv=True).data,
+                         [['1', '2'], ['3', '4']])
+        with self.assertRaises(ValueError):
+            Loop.from_string('_Test.A,_Test.B\n1,2\n3\n', csv=True)
+        with self.assertRaises(ValueError):
+            Loop.from_string('\n', csv=True)
+        self.assertEqual(len(Loop.from_string('_Test.A,_Test.B\n', csv=True)), 0)
+
+        converted = Loop.from_string(shifts.get_data_as_csv(), csv=True, convert_data_types=True)
+        self.assertEqual(converted.get_tag('Val')[:2], [Decimal(_) for _ in shifts.get_tag('Val')[:2]])
+        self.assertEqual(converted.get_tag('Seq_ID')[0], int(shifts.get_tag('Seq_ID')[0]))
+        self.assertEqual(converted.get_tag('Assembly_atom_ID')[0], None)
 
 # Allow unit testing from other modules
 def start_tests():
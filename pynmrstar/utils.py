@@ -4,21 +4,29 @@
 import functools
 import json
 import os
-from typing import Iterable, Any, Dict
+from concurrent.futures import ThreadPoolExecutor, wait, FIRST_COMPLETED
+from typing import Iterable, Any, Dict, List, Optional, Union, IO
 from urllib.error import HTTPError, URLError
 
-from pynmrstar import definitions, cnmrstar, entry as entry_mod
+from pynmrstar import definitions, cnmrstar, entry as entry_mod, parser as parser_mod, shared
 from pynmrstar._internal import _interpret_file
 from pynmrstar.schema import Schema
 
 # Set this to allow import * from pynmrstar to work sensibly
-__all__ = ['diff', 'format_category', 'format_tag', 'get_schema', 'iter_entries', 'quote_value', 'validate']
+__all__ = ['diff', 'format_category', 'format_tag', 'get_schema', 'iter_entries', 'parse_many', 'quote_value',
+           'validate']
 
 
-def diff(entry1: 'entry_mod.Entry', entry2: 'entry_mod.Entry') -> None:
+def diff(entry1: 'entry_mod.Entry', entry2: 'entry_mod.Entry', rows: bool = False,
+         keys: Dict[str, List[str]] = None) -> None:
     """Prints the differences between two entries. Non-equal entries
     will always be detected, but specific differences detected depends
-    on the order of entries."""
+    on the order of entries.
+
+    Set rows=True to also print which rows were inserted, deleted, or
+    modified in each loop which differs (see :py:meth:`pynmrstar.Loop.diff`).
+    keys gives the key tags to match the rows of a loop category by, such as
+    ``{'_Atom_chem_shift': ['ID']}``, and implies rows=True."""
 
     diffs = entry1.compare(entry2)
     if len(diffs) == 0:
@@ -26,6 +34,24 @@ def diff(entry1: 'entry_mod.Entry', entry2: 'entry_mod.Entry') -> None:
     for difference in diffs:
         print(difference)
 
+    if not diffs or not (rows or keys):
+        return
+    keys = {format_category(category).lower(): key for category, key in (keys or {}).items()}
+    other_frames = entry2.frame_dict
+    for frame in entry1:
+        if frame.name not in other_frames:
+            continue
+        other_loops = other_frames[frame.name].loop_dict
+        for each_loop in frame:
+            other_loop = other_loops.get(str(each_loop.category).lower())
+            if other_loop is None or each_loop._content_digest() == other_loop._content_digest():
+                continue
+            loop_diff = each_loop.diff(other_loop, key=keys.get(str(each_loop.category).lower()))
+            if loop_diff:
+                print(f"In saveframe '{frame.name}':")
+                for line in loop_diff.lines(indent="\t"):
+                    print(line)
+
 
 @functools.lru_cache(maxsize=1024)
 def format_category(tag: str) -> str:
@@ -96,6 +122,95 @@ def iter_entries(metabolomics: bool = False) -> Iterable['entry_mod.Entry']:
         yield entry_mod.Entry.from_database(entry)
 
 
+def _tokenize_file(the_file: Union[str, IO], threads: int = 1) -> 'cnmrstar.TokenStream':
+    """ Reads and tokenizes a file. Meant to be run in a worker thread."""
+
+    return cnmrstar.tokenize(_interpret_file(the_file).read(), threads, definitions.PARSE_CHUNK_SIZE)
+
+
+def _read_file(the_file: Union[str, IO], threads: int = 1) -> Optional['cnmrstar.TokenStream']:
+    """ Reads and tokenizes a file for parse_many() or
+    Entry.from_file_async(). Files in the binary format aren't tokenized,
+    so None is returned for them. Meant to be run in a worker thread."""
+
+    if shared.is_binary_file(the_file):
+        return None
+    return _tokenize_file(the_file, threads)
+
+
+def _entry_from_tokens(the_file: Union[str, IO], token_stream: Optional['cnmrstar.TokenStream'],
+                       **kwargs) -> 'entry_mod.Entry':
+    """ Builds the Entry for a file read by _read_file()."""
+
+    if token_stream is None:
+        return shared.read_binary_file(the_file, convert_data_types=kwargs['convert_data_types'],
+                                       schema=kwargs['schema'])
+
+    entry = entry_mod.Entry.from_scratch(0)
+    entry.source = f"from_file('{the_file}')"
+    parser_mod.Parser(entry_to_parse_into=entry).parse_tokens(token_stream, source=entry.source, **kwargs)
+    return entry
+
+
+def parse_many(files: Iterable[Union[str, IO]],
+               workers: int = None,
+               ordered: bool = True,
+               convert_data_types: bool = False,
+               raise_parse_warnings: bool = False,
+               schema: 'Schema' = None,
+               lazy: bool = False) -> Iterable['entry_mod.Entry']:
+    """ Returns a generator that will yield an Entry object for each of the
+    provided files, which may be anything accepted by
+    :py:meth:`pynmrstar.Entry.from_file`.
+
+    Reading and tokenizing happens in a pool of `workers` threads (one per
+    CPU by default) with the GIL released, so loading many entries scales
+    across cores without the cost of shipping entries between processes.
+    Files in the binary format are memory-mapped rather than tokenized.
+    The Entry objects are then built in the calling thread. Set
+    `ordered=False` to get the entries as soon as they are ready rather than
+    in the order the files were provided.
+
+    The remaining arguments have the same meaning as in
+    :py:meth:`pynmrstar.Entry.from_file`. Any exception raised while loading
+    a file is raised when that file's entry would have been yielded."""
+
+    if workers is None:
+        workers = os.cpu_count() or 1
+    if workers < 1:
+        raise ValueError("There must be at least one worker.")
+    parse_args = {'convert_data_types': convert_data_types,
+                  'raise_parse_warnings': raise_parse_warnings,
+                  'schema': schema,
+                  'lazy': lazy}
+
+    # Only tokenize a bit ahead of the consumer to bound the memory used
+    max_pending = workers * 2
+    pending = {}
+
+    def next_finished():
+        if ordered:
+            return [next(iter(pending))]
+        return wait(pending, return_when=FIRST_COMPLETED).done
+
+    with ThreadPoolExecutor(max_workers=workers) as executor:
+        try:
+            for the_file in files:
+                pending[executor.submit(_read_file, the_file)] = the_file
+                if len(pending) < max_pending:
+                    continue
+                for future in next_finished():
+                    yield _entry_from_tokens(pending.pop(future), future.result(), **parse_args)
+
+            # Drain whatever is left
+            while pending:
+                for future in next_finished():
+                    yield _entry_from_tokens(pending.pop(future), future.result(), **parse_args)
+        finally:
+            for future in pending:
+                future.cancel()
+
+
 @functools.lru_cache(maxsize=65536, typed=True)
 def quote_value(value: Any) -> str:
     """Automatically quotes the value in the appropriate way. Don't
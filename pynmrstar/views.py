@@ -0,0 +1,140 @@
+""" Read-only views of the data in a loop, which read the values straight
+from the loop's storage rather than copying them. See
+:py:meth:`pynmrstar.Loop.column` and :py:meth:`pynmrstar.Loop.select`. """
+
+from collections.abc import Sequence as SequenceABC
+from operator import itemgetter
+from typing import Any, Iterator, List, Tuple, Union
+
+from pynmrstar import loop as loop_mod
+
+
+def _check_index(item: int, length: int) -> int:
+    """ Returns the positive version of an index, or raises an IndexError. """
+
+    if item < 0:
+        item += length
+    if not 0 <= item < length:
+        raise IndexError('Row index out of range.')
+    return item
+
+
+class ColumnView(SequenceABC):
+    """ The values of one tag of a loop. Supports len(), indexing and
+    iteration, and always reflects the current data in the loop. Use
+    to_list() (or list()) to get a copy of the values. """
+
+    __slots__ = ('_loop', '_position')
+
+    def __init__(self, loop: 'loop_mod.Loop', position: int) -> None:
+        self._loop: 'loop_mod.Loop' = loop
+        self._position: int = position
+
+    def __eq__(self, other) -> bool:
+        if not isinstance(other, (ColumnView, list, tuple)):
+            return NotImplemented
+        return len(self) == len(other) and all(a == b for a, b in zip(self, other))
+
+    def __getitem__(self, item: Union[int, slice]) -> Any:
+        if isinstance(item, slice):
+            return [self[_] for _ in range(*item.indices(len(self)))]
+
+        loop = self._loop
+        item = _check_index(item, len(loop))
+        if loop._lazy_values is not None:
+            return loop._lazy_values[item * loop._lazy_values.width + self._position]
+        if loop._columns is not None:
+            return loop._columns[self._position][item]
+        return loop._data[item][self._position]
+
+    def __iter__(self) -> Iterator[Any]:
+        loop = self._loop
+        if loop._lazy_values is not None:
+            values = loop._lazy_values
+            return map(values.__getitem__, range(self._position, len(values), values.width))
+        if loop._columns is not None:
+            return iter(loop._columns[self._position])
+        return map(itemgetter(self._position), loop._data)
+
+    def __len__(self) -> int:
+        return len(self._loop)
+
+    def __repr__(self) -> str:
+        return f"<pynmrstar.views.ColumnView '{self.tag}' of {len(self)} values>"
+
+    @property
+    def tag(self) -> str:
+        """ The full name of the tag. """
+
+        return f"{self._loop.category}.{self._loop.tags[self._position]}"
+
+    def to_list(self) -> List[Any]:
+        """ Returns a copy of the values, the same as Loop.get_tag() would. """
+
+        return list(self)
+
+
+class SelectView(SequenceABC):
+    """ The values of some of the tags of a loop, as rows. Supports len(),
+    indexing and iteration (each row is a tuple), and always reflects the
+    current data in the loop. Use column() to view one of the tags, to_list()
+    to get a copy of the rows, or to_loop() to get a new loop. """
+
+    __slots__ = ('_loop', '_positions')
+
+    def __init__(self, loop: 'loop_mod.Loop', positions: List[int]) -> None:
+        self._loop: 'loop_mod.Loop' = loop
+        self._positions: List[int] = positions
+
+    def __eq__(self, other) -> bool:
+        if not isinstance(other, (SelectView, list, tuple)):
+            return NotImplemented
+        return len(self) == len(other) and all(list(a) == list(b) for a, b in zip(self, other))
+
+    def __getitem__(self, item: Union[int, slice]) -> Union[Tuple[Any, ...], List[Tuple[Any, ...]]]:
+        if isinstance(item, slice):
+            return [self[_] for _ in range(*item.indices(len(self)))]
+
+        loop = self._loop
+        item = _check_index(item, len(loop))
+        if loop._lazy_values is not None or loop._columns is not None:
+            return tuple([ColumnView(loop, _)[item] for _ in self._positions])
+        row = loop._data[item]
+        return tuple([row[_] for _ in self._positions])
+
+    def __iter__(self) -> Iterator[Tuple[Any, ...]]:
+        loop = self._loop
+        if loop._lazy_values is None and loop._columns is None and len(self._positions) > 1:
+            return map(itemgetter(*self._positions), loop._data)
+        return zip(*[ColumnView(loop, _) for _ in self._positions])
+
+    def __len__(self) -> int:
+        return len(self._loop)
+
+    def __repr__(self) -> str:
+        return f"<pynmrstar.views.SelectView of {len(self._positions)} tags and {len(self)} rows>"
+
+    @property
+    def tags(self) -> List[str]:
+        """ The full names of the tags. """
+
+        return [f"{self._loop.category}.{self._loop.tags[_]}" for _ in self._positions]
+
+    def column(self, tag: str) -> ColumnView:
+        """ Returns a view of one of the selected tags. """
+
+        position = self._loop._find_tag_position(tag)
+        if position not in self._positions:
+            raise ValueError(f"The tag '{tag}' isn't one of the selected tags.")
+        return ColumnView(self._loop, position)
+
+    def to_list(self) -> List[List[Any]]:
+        """ Returns a copy of the rows, the same as Loop.get_tag() would. """
+
+        return [list(_) for _ in self]
+
+    def to_loop(self) -> 'loop_mod.Loop':
+        """ Returns a new loop with only the selected tags. See
+        :py:meth:`pynmrstar.Loop.filter`. """
+
+        return self._loop.filter([self._loop.tags[_] for _ in self._positions])